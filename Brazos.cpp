@@ -17,6 +17,7 @@
 #include "PCIRegObject.h"
 #include "MSRObject.h"
 #include "PerformanceCounter.h"
+#include "TSCClock.h"
 
 //Brazos class constructor
 Brazos::Brazos () {
@@ -1519,15 +1520,81 @@ void Brazos::perfMonitorCPUUsage () {
 
 }
 
-void Brazos::perfMonitorFPUUsage () {
+void Brazos::perfMonitorFPUUsage (DWORD profilePeriod) {
 
-	Brazos::K10PerformanceCounters::perfMonitorFPUUsage(this);
+	Brazos::K10PerformanceCounters::perfMonitorFPUUsage(this, profilePeriod);
 
 }
 
-void Brazos::perfMonitorDCMA () {
+void Brazos::perfMonitorDCMA (DWORD profilePeriod) {
 
-	Brazos::K10PerformanceCounters::perfMonitorDCMA(this);
+	Brazos::K10PerformanceCounters::perfMonitorDCMA(this, profilePeriod);
+
+}
+
+void Brazos::perfMonitorEffectiveFrequency () {
+
+	Brazos::K10PerformanceCounters::perfMonitorEffectiveFrequency(this);
+
+}
+
+void Brazos::perfMonitorCoherence () {
+
+	Brazos::K10PerformanceCounters::perfMonitorCoherence(this);
+
+}
+
+void Brazos::perfMonitorDTLB () {
+
+	Brazos::K10PerformanceCounters::perfMonitorDTLB(this);
+
+}
+
+void Brazos::perfMonitorCacheMPKI () {
+
+	Brazos::K10PerformanceCounters::perfMonitorCacheMPKI(this);
+
+}
+
+void Brazos::perfMonitorIPC () {
+
+	Brazos::K10PerformanceCounters::perfMonitorIPC(this);
+
+}
+
+void Brazos::perfMonitorSamples (const char *eventSpec, DWORD period) {
+
+	Brazos::K10PerformanceCounters::perfMonitorSamples(this, eventSpec, period);
+
+}
+
+void Brazos::perfMonitorIBS (DWORD period) {
+
+	Brazos::K10PerformanceCounters::perfMonitorIBS(this, period);
+
+}
+
+void Brazos::perfMonitorMemoryBandwidth () {
+
+	Brazos::K10PerformanceCounters::perfMonitorMemoryBandwidth(this);
+
+}
+
+void Brazos::perfMonitorNorthbridge (const char *eventList) {
+
+	Brazos::K10PerformanceCounters::perfMonitorNorthbridge(this, eventList);
+
+}
+
+void Brazos::perfCounterBenchmark () {
+
+	Brazos::K10PerformanceCounters::perfCounterBenchmark(this);
+
+}
+
+void Brazos::perfMonitorEvents (const char *eventList, DWORD quantum, const char *attribution) {
+
+	Brazos::K10PerformanceCounters::perfMonitorEvents(this, eventList, quantum, attribution);
 
 }
 
@@ -1814,10 +1881,10 @@ void Brazos::checkMode () {
 
 	DWORD i,pstate,vid,fid,did;
 	DWORD eaxMsr,edxMsr;
-	DWORD timestamp;
+	uint64_t timestamp;
 	DWORD states[2][8];
 	DWORD minTemp,maxTemp,temp;
-	DWORD oTimeStamp;
+	uint64_t oTimeStamp;
 	float curVcore;
 	DWORD maxPState;
 	unsigned int cid;
@@ -1833,13 +1900,13 @@ void Brazos::checkMode () {
 
 	minTemp=getTctlRegister();
 	maxTemp=minTemp;
-	oTimeStamp=GetTickCount ();
+	oTimeStamp=TSCClock::getMilliseconds();
 
 	while (1) {
 
-		timestamp=GetTickCount ();
+		timestamp=TSCClock::getMilliseconds();
 
-		printf (" \rTs:%d - ",timestamp);
+		printf (" \rTs:%llu - ",(unsigned long long)timestamp);
 		for (i=0;i<processorCores;i++) {
 
 			/*RdmsrPx (0xc0010063,&eaxMsr,&edxMsr,i+1);
@@ -102,8 +102,19 @@ public:
 	void perfCounterGetInfo ();
 	void perfCounterGetValue (unsigned int);
 	void perfMonitorCPUUsage ();
-	void perfMonitorFPUUsage ();
-	void perfMonitorDCMA ();
+	void perfMonitorFPUUsage (DWORD profilePeriod);
+	void perfMonitorDCMA (DWORD profilePeriod);
+	void perfMonitorEffectiveFrequency ();
+	void perfMonitorCoherence ();
+	void perfMonitorDTLB ();
+	void perfMonitorCacheMPKI ();
+	void perfMonitorIPC ();
+	void perfMonitorSamples (const char *eventSpec, DWORD period);
+	void perfMonitorIBS (DWORD period);
+	void perfMonitorMemoryBandwidth ();
+	void perfMonitorNorthbridge (const char *eventList);
+	void perfCounterBenchmark ();
+	void perfMonitorEvents (const char *eventList, DWORD quantum, const char *attribution);
 
 	//Scaler helper methods
 	void getCurrentStatus (struct procStatus *pStatus, DWORD core);
@@ -17,6 +17,7 @@
 #include "MSRObject.h"
 #include "PCIRegObject.h"
 #include "PerformanceCounter.h"
+#include "TSCClock.h"
 
 //Griffin Class constructor
 Griffin::Griffin () {
@@ -2350,15 +2351,81 @@ void Griffin::perfMonitorCPUUsage () {
 
 }
 
-void Griffin::perfMonitorFPUUsage () {
+void Griffin::perfMonitorFPUUsage (DWORD profilePeriod) {
 
-	Griffin::K10PerformanceCounters::perfMonitorFPUUsage(this);
+	Griffin::K10PerformanceCounters::perfMonitorFPUUsage(this, profilePeriod);
 
 }
 
-void Griffin::perfMonitorDCMA () {
+void Griffin::perfMonitorDCMA (DWORD profilePeriod) {
 
-	Griffin::K10PerformanceCounters::perfMonitorDCMA(this);
+	Griffin::K10PerformanceCounters::perfMonitorDCMA(this, profilePeriod);
+
+}
+
+void Griffin::perfMonitorEffectiveFrequency () {
+
+	Griffin::K10PerformanceCounters::perfMonitorEffectiveFrequency(this);
+
+}
+
+void Griffin::perfMonitorCoherence () {
+
+	Griffin::K10PerformanceCounters::perfMonitorCoherence(this);
+
+}
+
+void Griffin::perfMonitorDTLB () {
+
+	Griffin::K10PerformanceCounters::perfMonitorDTLB(this);
+
+}
+
+void Griffin::perfMonitorCacheMPKI () {
+
+	Griffin::K10PerformanceCounters::perfMonitorCacheMPKI(this);
+
+}
+
+void Griffin::perfMonitorIPC () {
+
+	Griffin::K10PerformanceCounters::perfMonitorIPC(this);
+
+}
+
+void Griffin::perfMonitorSamples (const char *eventSpec, DWORD period) {
+
+	Griffin::K10PerformanceCounters::perfMonitorSamples(this, eventSpec, period);
+
+}
+
+void Griffin::perfMonitorIBS (DWORD period) {
+
+	Griffin::K10PerformanceCounters::perfMonitorIBS(this, period);
+
+}
+
+void Griffin::perfMonitorMemoryBandwidth () {
+
+	Griffin::K10PerformanceCounters::perfMonitorMemoryBandwidth(this);
+
+}
+
+void Griffin::perfMonitorNorthbridge (const char *eventList) {
+
+	Griffin::K10PerformanceCounters::perfMonitorNorthbridge(this, eventList);
+
+}
+
+void Griffin::perfCounterBenchmark () {
+
+	Griffin::K10PerformanceCounters::perfCounterBenchmark(this);
+
+}
+
+void Griffin::perfMonitorEvents (const char *eventList, DWORD quantum, const char *attribution) {
+
+	Griffin::K10PerformanceCounters::perfMonitorEvents(this, eventList, quantum, attribution);
 
 }
 
@@ -2366,10 +2433,10 @@ void Griffin::checkMode () {
 
 	DWORD i,pstate,vid,fid,did;
 	DWORD eaxMsr,edxMsr;
-	DWORD timestamp;
+	uint64_t timestamp;
 	DWORD states[2][8];
 	DWORD minTemp,maxTemp,temp;
-	DWORD oTimeStamp;
+	uint64_t oTimeStamp;
 	float curVcore;
 	DWORD curFreq;
 	DWORD maxPState;
@@ -2385,13 +2452,13 @@ void Griffin::checkMode () {
 
 	minTemp=getTctlRegister();
 	maxTemp=minTemp;
-	oTimeStamp=GetTickCount ();
+	oTimeStamp=TSCClock::getMilliseconds();
 
 	while (1) {
 
-		timestamp=GetTickCount ();
+		timestamp=TSCClock::getMilliseconds();
 
-		printf (" \rTimestamp: %d - ",timestamp);
+		printf (" \rTimestamp: %llu - ",(unsigned long long)timestamp);
 		for (i=0;i<processorCores;i++) {
 			
 			/*RdmsrPx (0xc0010063,&eaxMsr,&edxMsr,i+1);
@@ -0,0 +1,558 @@
+/*
+ * IBSSampler.cpp
+ *
+ * Instruction-Based Sampling (IBS) tags one op every period dispatched ops (or cycles, on processors
+ * without IbsOpCntCtl) and, when the tagged op retires, stores in the IBS op registers
+ * (MSRC001_1033 to MSRC001_1039) its address, whether it was a load or a store, whether it missed
+ * the data cache, the miss latency, where the data came from and the linear and physical address
+ * accessed. IbsOpVal is then set and no other op is tagged until software clears it.
+ *
+ * Without an interrupt handler the valid bit must be polled: for each cpu in the mask a thread is
+ * pinned on that cpu and, every IBS_POLL_INTERVAL microseconds, collects the tagged op, if any, and
+ * re-arms IBS. The sample rate is then bounded by the poll interval, whatever the period. Samples are
+ * aggregated by each thread in per-cpu statistics and latency histograms, published under a sequence
+ * counter like RdpmcSampler does.
+ *
+ * Data cache misses serviced by the cache of another core and missing locked ops are counted as
+ * contended: their cache lines are kept in a small per-cpu table of the most frequent ones (space
+ * saving, like SampleProfiler), together with the words of the line that were accessed, to point
+ * out true and false sharing.
+ *
+ * Instructions on how to use:
+ *
+ * 1 - Instantiate the object giving a cpuMask
+ * 2 - Call start() with the sampling period
+ * 3 - Read statistics with getStats() at any time
+ * 4 - Call stop() to disarm IBS and join the threads
+ *
+ */
+
+#include <string.h>
+
+#include "IBSSampler.h"
+#include "MSRObject.h"
+
+#ifdef __linux
+#include <sched.h>
+#include <time.h>
+
+#define IBS_BARRIER() __sync_synchronize()
+#else
+#define IBS_BARRIER() MemoryBarrier()
+#endif
+
+IBSSampler::IBSSampler (PROCESSORMASK cpuMask)
+{
+	DWORD eax, ebx, ecx, edx;
+	DWORD cpu;
+
+	this->cpuMask = cpuMask;
+	this->cpuCount = 0;
+
+	for (cpu = 0; cpu < MAX_CORES; cpu++)
+		if (cpuMask & ((PROCESSORMASK)1 << cpu))
+			this->cpuCount++;
+
+	this->cpuNumbers = (DWORD *) calloc(cpuCount, sizeof(DWORD));
+
+	this->cpuCount = 0;
+	for (cpu = 0; cpu < MAX_CORES; cpu++)
+		if (cpuMask & ((PROCESSORMASK)1 << cpu))
+			this->cpuNumbers[this->cpuCount++] = cpu;
+
+	this->period = IBS_DEFAULT_PERIOD;
+	this->running = false;
+
+	//CPUID Function 8000_001B reg EAX: bit 4 is OpCnt, bit 6 is OpCntExt
+	this->countOps = false;
+	this->extendedCount = false;
+
+	if (isSupported() && Cpuid(0x8000001b, &eax, &ebx, &ecx, &edx) == TRUE)
+	{
+		this->countOps = (eax >> 4) & 0x1;
+		this->extendedCount = (eax >> 6) & 0x1;
+	}
+
+	this->stats = (struct IBSCpuStats *) calloc(cpuCount, sizeof(struct IBSCpuStats));
+
+#ifdef __linux
+	this->threads = (pthread_t *) calloc(cpuCount, sizeof(pthread_t));
+	this->threadArgs = (struct IBSThread *) calloc(cpuCount, sizeof(struct IBSThread));
+#endif
+}
+
+/*
+ * IBS availability is reported by CPUID Function 8000_0001 reg ECX bit 10 (IBS), op sampling by
+ * CPUID Function 8000_001B reg EAX bit 2 (OpSam)
+ */
+bool IBSSampler::isSupported ()
+{
+	DWORD eax, ebx, ecx, edx;
+
+	if (Cpuid(0x80000001, &eax, &ebx, &ecx, &edx) != TRUE)
+		return false;
+
+	if (((ecx >> 10) & 0x1) == 0)
+		return false;
+
+	if (Cpuid(0x8000001b, &eax, &ebx, &ecx, &edx) != TRUE)
+		return false;
+
+	return (eax >> 2) & 0x1;
+}
+
+//Bucket n holds latencies from 2^n to 2^(n+1)-1 cycles, the last bucket holds all the others
+unsigned int IBSSampler::getLatencyBucket (DWORD latency)
+{
+	unsigned int bucket;
+
+	bucket = 0;
+
+	while (latency > 1 && bucket < IBS_LATENCY_BUCKETS - 1)
+	{
+		latency >>= 1;
+		bucket++;
+	}
+
+	return bucket;
+}
+
+const char *IBSSampler::getSourceName (DWORD source)
+{
+	switch (source)
+	{
+	case IBS_SOURCE_L3:
+		return "L3";
+	case IBS_SOURCE_CACHE:
+		return "cache";
+	case IBS_SOURCE_DRAM:
+		return "DRAM";
+	case IBS_SOURCE_OTHER:
+		return "other";
+	default:
+		return "none";
+	}
+}
+
+/*
+ * A sample is contended if the line was held by the cache of another core, or if it is a locked op
+ * that missed the data cache (the line was owned elsewhere or evicted while contended)
+ */
+bool IBSSampler::isContended (const struct IBSOpSample *sample)
+{
+	if (!sample->dcMiss)
+		return false;
+
+	return sample->dataSource == IBS_SOURCE_CACHE || sample->locked;
+}
+
+/*
+ * Arms IBS op sampling on cpu: writes the period in IbsOpMaxCnt (period bits 19:4, and bits 26:20
+ * where available), clears IbsOpVal and IbsOpCurCnt and sets IbsOpEn
+ */
+bool IBSSampler::arm (DWORD cpu)
+{
+	MSRObject *ibsOpCtl;
+	bool result;
+
+	ibsOpCtl = new MSRObject();
+
+	if (!ibsOpCtl->readMSR(IBS_OP_CTL_REG, (PROCESSORMASK)1 << cpu))
+	{
+		delete ibsOpCtl;
+		return false;
+	}
+
+	ibsOpCtl->setBits(0, 16, period >> 4); //IbsOpMaxCnt[19:4]
+	if (extendedCount)
+		ibsOpCtl->setBits(20, 7, period >> 20); //IbsOpMaxCnt[26:20]
+	ibsOpCtl->setBits(17, 1, 1); //IbsOpEn
+	ibsOpCtl->setBits(18, 1, 0); //IbsOpVal
+	ibsOpCtl->setBits(19, 1, countOps ? 1 : 0); //IbsOpCntCtl
+	ibsOpCtl->setBits(32, 27, 0); //IbsOpCurCnt
+
+	result = ibsOpCtl->writeMSR();
+
+	delete ibsOpCtl;
+
+	return result;
+}
+
+bool IBSSampler::disarm (DWORD cpu)
+{
+	MSRObject *ibsOpCtl;
+	bool result;
+
+	ibsOpCtl = new MSRObject();
+
+	if (!ibsOpCtl->readMSR(IBS_OP_CTL_REG, (PROCESSORMASK)1 << cpu))
+	{
+		delete ibsOpCtl;
+		return false;
+	}
+
+	ibsOpCtl->setBits(17, 1, 0); //IbsOpEn
+	ibsOpCtl->setBits(18, 1, 0); //IbsOpVal
+
+	result = ibsOpCtl->writeMSR();
+
+	delete ibsOpCtl;
+
+	return result;
+}
+
+//Reads a whole IBS register of cpu
+static bool readIBSRegister (DWORD reg, DWORD cpu, uint64_t *value)
+{
+	MSRObject *msrObject;
+
+	msrObject = new MSRObject();
+
+	if (!msrObject->readMSR(reg, (PROCESSORMASK)1 << cpu))
+	{
+		delete msrObject;
+		return false;
+	}
+
+	*value = msrObject->getBits(0, 0, 64);
+
+	delete msrObject;
+
+	return true;
+}
+
+/*
+ * Reads the tagged op of cpu, if IbsOpVal is set. Returns false if there is no valid sample
+ * or in case of error.
+ */
+bool IBSSampler::readSample (DWORD cpu, struct IBSOpSample *sample)
+{
+	uint64_t value;
+
+	memset(sample, 0, sizeof(struct IBSOpSample));
+
+	//IbsOpVal
+	if (!readIBSRegister(IBS_OP_CTL_REG, cpu, &value) || ((value >> 18) & 0x1) == 0)
+		return false;
+
+	if (!readIBSRegister(IBS_OP_RIP_REG, cpu, &sample->rip))
+		return false;
+
+	if (!readIBSRegister(IBS_OP_DATA3_REG, cpu, &value))
+		return false;
+
+	sample->load = value & 0x1; //IbsLdOp
+	sample->store = (value >> 1) & 0x1; //IbsStOp
+	sample->dcMiss = (value >> 7) & 0x1; //IbsDcMiss
+	sample->locked = (value >> 15) & 0x1; //IbsDcLockedOp
+	sample->linearValid = (value >> 17) & 0x1; //IbsDcLinAddrValid
+	sample->physicalValid = (value >> 18) & 0x1; //IbsDcPhyAddrValid
+	sample->missLatency = (value >> 32) & 0xffff; //IbsDcMissLat
+
+	//Data source is valid only for loads that missed the data cache
+	if (sample->load && sample->dcMiss)
+	{
+		if (!readIBSRegister(IBS_OP_DATA2_REG, cpu, &value))
+			return false;
+
+		sample->dataSource = value & 0x7; //NbIbsReqSrc
+		sample->remote = (value >> 4) & 0x1; //NbIbsReqDstProc
+	}
+
+	if (sample->linearValid && !readIBSRegister(IBS_DC_LIN_AD_REG, cpu, &sample->linearAddress))
+		return false;
+
+	if (sample->physicalValid)
+	{
+		if (!readIBSRegister(IBS_DC_PHYS_AD_REG, cpu, &value))
+			return false;
+
+		sample->physicalAddress = value & 0xffffffffffffULL; //Bits 47:0
+	}
+
+	return true;
+}
+
+/*
+ * Counts the cache line of a contended sample in the hot lines table. When the table is full the
+ * least frequent line is replaced and the new one inherits its count, so frequent lines can't be
+ * pushed out by a burst of rare ones
+ */
+void IBSSampler::addHotLine (struct IBSCpuStats *cpuStats, const struct IBSOpSample *sample)
+{
+	struct IBSHotLine *entry, *minimum;
+	uint64_t address, line;
+	bool physical;
+	unsigned int i;
+
+	if (!sample->physicalValid && !sample->linearValid)
+		return;
+
+	physical = sample->physicalValid;
+	address = physical ? sample->physicalAddress : sample->linearAddress;
+	line = address & ~0x3fULL;
+
+	entry = NULL;
+	minimum = &cpuStats->hotLines[0];
+
+	for (i = 0; i < IBS_HOT_LINES; i++)
+	{
+		if (cpuStats->hotLines[i].count != 0 && cpuStats->hotLines[i].line == line &&
+				cpuStats->hotLines[i].physical == physical)
+		{
+			entry = &cpuStats->hotLines[i];
+			break;
+		}
+
+		if (cpuStats->hotLines[i].count < minimum->count)
+			minimum = &cpuStats->hotLines[i];
+	}
+
+	if (entry == NULL)
+	{
+		entry = minimum;
+		entry->line = line;
+		entry->physical = physical;
+		entry->words = 0;
+	}
+
+	entry->count++;
+	entry->rip = sample->rip;
+	entry->words |= 1 << ((address & 0x3f) >> 3);
+}
+
+//Aggregates a sample in the statistics of cpuIndex
+void IBSSampler::addSample (DWORD cpuIndex, const struct IBSOpSample *sample)
+{
+	struct IBSCpuStats *cpuStats;
+
+	cpuStats = &stats[cpuIndex];
+
+	cpuStats->sequence++;
+	IBS_BARRIER();
+
+	cpuStats->samples++;
+
+	if (sample->load)
+		cpuStats->loads++;
+
+	if (sample->store)
+		cpuStats->stores++;
+
+	if (sample->locked)
+		cpuStats->locked++;
+
+	if (isContended(sample))
+	{
+		cpuStats->contended++;
+		addHotLine(cpuStats, sample);
+	}
+
+	if (sample->dcMiss)
+	{
+		cpuStats->dcMisses++;
+		cpuStats->latencySum += sample->missLatency;
+		cpuStats->latency[getLatencyBucket(sample->missLatency)]++;
+		cpuStats->lastMiss = *sample;
+	}
+
+	if (sample->dataSource != IBS_SOURCE_NONE)
+	{
+		cpuStats->sources[sample->dataSource & (IBS_DATA_SOURCES - 1)]++;
+
+		if (sample->remote)
+			cpuStats->remote++;
+		else
+			cpuStats->local++;
+	}
+
+	IBS_BARRIER();
+	cpuStats->sequence++;
+}
+
+#ifdef __linux
+void *IBSSampler::samplerThread (void *arg)
+{
+	struct IBSThread *thread;
+
+	thread = (struct IBSThread *) arg;
+	thread->sampler->sampleLoop(thread->cpuIndex);
+
+	return NULL;
+}
+#endif
+
+/*
+ * Body of the sampler thread of cpuIndex: pins the thread on its cpu, so that IBS registers
+ * are accessed locally, arms IBS and collects a sample each time IbsOpVal is found set
+ */
+void IBSSampler::sampleLoop (DWORD cpuIndex)
+{
+#ifdef __linux
+	struct IBSOpSample sample;
+	struct timespec pause;
+	cpu_set_t cpuSet;
+	DWORD cpu;
+
+	cpu = cpuNumbers[cpuIndex];
+
+	CPU_ZERO(&cpuSet);
+	CPU_SET(cpu, &cpuSet);
+
+	if (pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) != 0 || !arm(cpu))
+	{
+		stats[cpuIndex].failed = true;
+		return;
+	}
+
+	pause.tv_sec = 0;
+	pause.tv_nsec = IBS_POLL_INTERVAL * 1000;
+
+	while (running)
+	{
+		nanosleep(&pause, NULL);
+
+		if (!readSample(cpu, &sample))
+			continue;
+
+		addSample(cpuIndex, &sample);
+
+		if (!arm(cpu))
+		{
+			stats[cpuIndex].failed = true;
+			break;
+		}
+	}
+
+	disarm(cpu);
+#endif
+}
+
+/*
+ * Starts one sampler thread per cpu, tagging an op every period ops (or cycles).
+ *
+ * Returns true if all the threads are sampling, else stops them and returns false
+ */
+bool IBSSampler::start (DWORD period)
+{
+#ifdef __linux
+	DWORD cpuIndex;
+
+	if (running || !isSupported())
+		return false;
+
+	//IbsOpMaxCnt counts in units of 16, the minimum period is 0x90
+	if (period < 0x90)
+		period = 0x90;
+
+	this->period = period;
+
+	memset(stats, 0, cpuCount * sizeof(struct IBSCpuStats));
+
+	running = true;
+
+	for (cpuIndex = 0; cpuIndex < cpuCount; cpuIndex++)
+	{
+		threadArgs[cpuIndex].sampler = this;
+		threadArgs[cpuIndex].cpuIndex = cpuIndex;
+
+		if (pthread_create(&threads[cpuIndex], NULL, samplerThread, &threadArgs[cpuIndex]) != 0)
+		{
+			running = false;
+
+			while (cpuIndex > 0)
+				pthread_join(threads[--cpuIndex], NULL);
+
+			return false;
+		}
+	}
+
+	//Gives the threads the time to arm IBS
+	Sleep(10);
+
+	for (cpuIndex = 0; cpuIndex < cpuCount; cpuIndex++)
+	{
+		if (stats[cpuIndex].failed)
+		{
+			stop();
+			return false;
+		}
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+void IBSSampler::stop ()
+{
+#ifdef __linux
+	DWORD cpuIndex;
+
+	if (!running)
+		return;
+
+	running = false;
+
+	for (cpuIndex = 0; cpuIndex < cpuCount; cpuIndex++)
+		pthread_join(threads[cpuIndex], NULL);
+#endif
+}
+
+/*
+ * Getters
+ */
+
+DWORD IBSSampler::getCount () const
+{
+	return cpuCount;
+}
+
+DWORD IBSSampler::getCpuNumber (DWORD cpuIndex) const
+{
+	return cpuNumbers[cpuIndex];
+}
+
+/*
+ * Copies the statistics of cpuIndex. A copy is consistent if the sequence counter is even and
+ * does not change while copying it.
+ *
+ * Returns false if the sampler thread has failed
+ */
+bool IBSSampler::getStats (DWORD cpuIndex, struct IBSCpuStats *cpuStats) const
+{
+	unsigned int sequence;
+
+	if (stats[cpuIndex].failed)
+		return false;
+
+	do {
+		sequence = stats[cpuIndex].sequence;
+		IBS_BARRIER();
+
+		memcpy(cpuStats, &stats[cpuIndex], sizeof(struct IBSCpuStats));
+
+		IBS_BARRIER();
+	} while ((sequence & 1) || sequence != stats[cpuIndex].sequence);
+
+	return true;
+}
+
+/*
+ * Destructor. Stops the threads, if still running, and frees resources.
+ *
+ */
+
+IBSSampler::~IBSSampler ()
+{
+	stop();
+
+	free(stats);
+	free(cpuNumbers);
+
+#ifdef __linux
+	free(threads);
+	free(threadArgs);
+#endif
+}
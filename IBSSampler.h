@@ -0,0 +1,127 @@
+/*
+ * IBSSampler.h
+ *
+ * Instruction-Based Sampling of ops, polled by per-cpu threads
+ *
+ */
+
+#ifndef IBSSAMPLER_H_
+#define IBSSAMPLER_H_
+
+#include "Processor.h"
+
+#ifdef __linux
+#include <pthread.h>
+#endif
+
+#define IBS_LATENCY_BUCKETS 12 //Power of two buckets, last one is 2048 cycles and over
+#define IBS_DATA_SOURCES 8 //NbIbsReqSrc values
+
+#define IBS_DEFAULT_PERIOD 0x10000 //Ops (or cycles) between two tagged ops
+#define IBS_POLL_INTERVAL 1000 //Microseconds between two checks of IbsOpVal
+#define IBS_HOT_LINES 8 //Contended cache lines tracked per cpu
+
+//IBS data sources, from the NbIbsReqSrc field
+#define IBS_SOURCE_NONE 0x0
+#define IBS_SOURCE_L3 0x1
+#define IBS_SOURCE_CACHE 0x2 //Cache of another core of the same node
+#define IBS_SOURCE_DRAM 0x3
+#define IBS_SOURCE_OTHER 0x7 //MMIO, config space or APIC
+
+//A tagged op, decoded from the IBS op registers
+struct IBSOpSample {
+	uint64_t rip;
+	uint64_t linearAddress;
+	uint64_t physicalAddress;
+	DWORD dataSource; //IBS_SOURCE_*, valid for loads serviced by the northbridge
+	DWORD missLatency; //Cycles from the DC miss to the refill
+	bool load;
+	bool store;
+	bool dcMiss;
+	bool remote; //Serviced by another node
+	bool locked; //Locked op
+	bool linearValid;
+	bool physicalValid;
+};
+
+//Cache line hit in the cache of another core or accessed by a missing locked op
+struct IBSHotLine {
+	uint64_t line; //Physical address of the line, or linear if the physical one is not valid
+	uint64_t rip; //Last op that accessed the line
+	uint64_t count;
+	DWORD words; //Bitmask of the 8-byte words of the line accessed
+	bool physical;
+};
+
+//Samples aggregated by a sampler thread, protected by a sequence counter
+struct IBSCpuStats {
+	volatile unsigned int sequence; //Odd while the thread is writing
+	uint64_t samples;
+	uint64_t loads;
+	uint64_t stores;
+	uint64_t dcMisses;
+	uint64_t local;
+	uint64_t remote;
+	uint64_t latencySum; //Sum of the miss latency of DC misses
+	uint64_t locked; //Locked ops
+	uint64_t contended; //DC misses serviced by another cache or locked
+	uint64_t latency[IBS_LATENCY_BUCKETS];
+	uint64_t sources[IBS_DATA_SOURCES];
+	struct IBSOpSample lastMiss;
+	struct IBSHotLine hotLines[IBS_HOT_LINES];
+	volatile bool failed;
+};
+
+class IBSSampler {
+protected:
+
+	PROCESSORMASK cpuMask;
+	DWORD cpuCount;
+	DWORD *cpuNumbers; //Absolute cpu number of each cpuIndex
+
+	DWORD period;
+	bool countOps; //Period counts dispatched ops instead of cycles
+	bool extendedCount; //IbsOpMaxCnt has bits 26:20
+
+	volatile bool running;
+
+	struct IBSCpuStats *stats;
+
+#ifdef __linux
+	struct IBSThread {
+		IBSSampler *sampler;
+		DWORD cpuIndex;
+	};
+
+	pthread_t *threads;
+	struct IBSThread *threadArgs;
+
+	static void *samplerThread (void *arg);
+#endif
+
+	bool arm (DWORD cpu);
+	bool disarm (DWORD cpu);
+	bool readSample (DWORD cpu, struct IBSOpSample *sample);
+	void addSample (DWORD cpuIndex, const struct IBSOpSample *sample);
+	void addHotLine (struct IBSCpuStats *cpuStats, const struct IBSOpSample *sample);
+	void sampleLoop (DWORD cpuIndex);
+
+public:
+	IBSSampler (PROCESSORMASK cpuMask);
+
+	static bool isSupported ();
+	static unsigned int getLatencyBucket (DWORD latency);
+	static const char *getSourceName (DWORD source);
+	static bool isContended (const struct IBSOpSample *sample);
+
+	bool start (DWORD period);
+	void stop ();
+
+	DWORD getCount () const;
+	DWORD getCpuNumber (DWORD cpuIndex) const;
+	bool getStats (DWORD cpuIndex, struct IBSCpuStats *cpuStats) const;
+
+	virtual ~IBSSampler ();
+};
+
+#endif /* IBSSAMPLER_H_ */
@@ -17,6 +17,7 @@
 #include "PCIRegObject.h"
 #include "MSRObject.h"
 #include "PerformanceCounter.h"
+#include "TSCClock.h"
 
 #include "sysdep.h"
 
@@ -1375,6 +1376,155 @@ DWORD Interlagos::getTDP(void)
 	return(TDP);
 }
 
+/*
+ * Cores per compute unit are reported by CPUID Function 8000_001E reg EBX bits 9:8
+ * (CoresPerComputeUnit) when TopologyExtensions, CPUID Function 8000_0001 reg ECX bit 22, is set.
+ * Else two cores share each compute unit.
+ */
+DWORD Interlagos::getCoresPerComputeUnit(void)
+{
+	DWORD eax, ebx, ecx, edx;
+	DWORD coresPerUnit = 2;
+
+	if (Cpuid(0x80000001, &eax, &ebx, &ecx, &edx) == TRUE && ((ecx >> 22) & 0x1))
+		if (Cpuid(0x8000001e, &eax, &ebx, &ecx, &edx) == TRUE)
+			coresPerUnit = ((ebx >> 8) & 0x3) + 1;
+
+	return coresPerUnit;
+}
+
+/*
+ * Node TDP in Watts, as getTDP() computes it: D18F4x1B8 bits 15:0 in TDP units,
+ * D18F5xE8 bits 9:0 (TdpToWatt) converting TDP units to 1/1024 Watts
+ */
+float Interlagos::getNodeTDPWatts(void)
+{
+	PCIRegObject *TDPReg = new PCIRegObject();
+	PCIRegObject *TDP2Watt = new PCIRegObject();
+	float tdpwatt;
+
+	if (!TDPReg->readPCIReg(PCI_DEV_NORTHBRIDGE, PCI_FUNC_LINK_CONTROL, 0x1B8, getNodeMask()) ||
+		!TDP2Watt->readPCIReg(PCI_DEV_NORTHBRIDGE, PCI_FUNC_MISC_CONTROL_5, 0xE8, getNodeMask()))
+	{
+		printf("Interlagos::getNodeTDPWatts unable to read TDP registers\n");
+		delete TDPReg;
+		delete TDP2Watt;
+		return -1;
+	}
+
+	tdpwatt = ((float)TDP2Watt->getBits(0, 0, 10) / 1024) * TDPReg->getBits(0, 0, 16);
+
+	delete TDPReg;
+	delete TDP2Watt;
+
+	return tdpwatt;
+}
+
+/*
+ * APM TDP limit of the selected node, in Watts. The limit is stored in APML_TDP_LIMIT_REG_15
+ * bits 28:16 (ApmTdpLimit), in TDP units converted with D18F5xE8 (TdpToWatt)
+ */
+float Interlagos::getPowerLimit(void)
+{
+	PCIRegObject *TDP2Watt = new PCIRegObject();
+	MSRObject *msrObject = new MSRObject();
+	float limit;
+
+	if (!TDP2Watt->readPCIReg(PCI_DEV_NORTHBRIDGE, PCI_FUNC_MISC_CONTROL_5, 0xE8, getNodeMask()))
+	{
+		printf("Interlagos::getPowerLimit unable to read TDP2Watt control register\n");
+		delete TDP2Watt;
+		delete msrObject;
+		return -1;
+	}
+
+	if (!msrObject->readMSR(APML_TDP_LIMIT_REG_15, getMask(0, selectedNode)))
+	{
+		printf("Interlagos::getPowerLimit unable to read MSR\n");
+		delete TDP2Watt;
+		delete msrObject;
+		return -1;
+	}
+
+	limit = ((float)TDP2Watt->getBits(0, 0, 10) / 1024) * msrObject->getBitsLow(0, 16, 13);
+
+	delete TDP2Watt;
+	delete msrObject;
+
+	return limit;
+}
+
+/*
+ * Programs the APM TDP limit of the selected node. The limit is enforced only when APM is
+ * enabled (D18F4x15C bit 7, see setBoost()). Returns false if APM is disabled or the limit
+ * does not read back as written.
+ */
+bool Interlagos::setPowerLimit(float watts)
+{
+	PCIRegObject *boostControl = new PCIRegObject();
+	PCIRegObject *TDP2Watt = new PCIRegObject();
+	MSRObject *msrObject;
+	DWORD tdp2watt, limit;
+	bool apmEnabled;
+
+	if (!boostControl->readPCIReg(PCI_DEV_NORTHBRIDGE, PCI_FUNC_LINK_CONTROL, 0x15C, getNodeMask()) ||
+		!TDP2Watt->readPCIReg(PCI_DEV_NORTHBRIDGE, PCI_FUNC_MISC_CONTROL_5, 0xE8, getNodeMask()))
+	{
+		printf("Interlagos::setPowerLimit unable to read PCI registers\n");
+		delete boostControl;
+		delete TDP2Watt;
+		return false;
+	}
+
+	apmEnabled = boostControl->getBits(0, 7, 1);
+	tdp2watt = TDP2Watt->getBits(0, 0, 10);
+
+	delete boostControl;
+	delete TDP2Watt;
+
+	if (!apmEnabled || tdp2watt == 0)
+		return false;
+
+	limit = (DWORD)(watts * 1024 / tdp2watt + 0.5f);
+
+	if (limit > 0x1fff)
+		limit = 0x1fff;
+
+	msrObject = new MSRObject();
+
+	if (!msrObject->readMSR(APML_TDP_LIMIT_REG_15, getMask(ALL_CORES, selectedNode)))
+	{
+		printf("Interlagos::setPowerLimit unable to read MSR\n");
+		delete msrObject;
+		return false;
+	}
+
+	msrObject->setBitsLow(16, 13, limit);
+
+	if (!msrObject->writeMSR())
+	{
+		printf("Interlagos::setPowerLimit unable to write MSR\n");
+		delete msrObject;
+		return false;
+	}
+
+	if (!msrObject->readMSR(APML_TDP_LIMIT_REG_15, getMask(0, selectedNode)))
+	{
+		delete msrObject;
+		return false;
+	}
+
+	if (msrObject->getBitsLow(0, 16, 13) != limit)
+	{
+		delete msrObject;
+		return false;
+	}
+
+	delete msrObject;
+
+	return true;
+}
+
 //DRAM Timings tweaking ----------------
 DWORD Interlagos::setDramTiming(DWORD device, /* 0 or 1 */
 		DWORD Tcl, DWORD Trcd, DWORD Trp, DWORD Trtp, DWORD Tras, DWORD Trc,
@@ -2832,14 +2982,224 @@ void Interlagos::perfMonitorCPUUsage()
 	Interlagos::K10PerformanceCounters::perfMonitorCPUUsage(this);
 }
 
-void Interlagos::perfMonitorFPUUsage()
+void Interlagos::perfMonitorFPUUsage(DWORD profilePeriod)
+{
+	Interlagos::K10PerformanceCounters::perfMonitorFPUUsage(this, profilePeriod);
+}
+
+//The cores of a compute unit share its FPU
+void Interlagos::perfMonitorFPUModules()
+{
+	Interlagos::K10PerformanceCounters::perfMonitorFPUModules(this, getCoresPerComputeUnit());
+}
+
+void Interlagos::perfMonitorDCMA(DWORD profilePeriod)
+{
+	Interlagos::K10PerformanceCounters::perfMonitorDCMA(this, profilePeriod);
+}
+
+void Interlagos::perfMonitorEffectiveFrequency()
+{
+	Interlagos::K10PerformanceCounters::perfMonitorEffectiveFrequency(this);
+}
+
+void Interlagos::perfMonitorCoherence()
+{
+	Interlagos::K10PerformanceCounters::perfMonitorCoherence(this);
+}
+
+void Interlagos::perfMonitorDTLB()
+{
+	Interlagos::K10PerformanceCounters::perfMonitorDTLB(this);
+}
+
+void Interlagos::perfMonitorCacheMPKI()
+{
+	Interlagos::K10PerformanceCounters::perfMonitorCacheMPKI(this);
+}
+
+void Interlagos::perfMonitorIPC()
+{
+	Interlagos::K10PerformanceCounters::perfMonitorIPC(this);
+}
+
+void Interlagos::perfMonitorSamples(const char *eventSpec, DWORD period)
+{
+	Interlagos::K10PerformanceCounters::perfMonitorSamples(this, eventSpec, period);
+}
+
+void Interlagos::perfMonitorIBS(DWORD period)
+{
+	Interlagos::K10PerformanceCounters::perfMonitorIBS(this, period);
+}
+
+void Interlagos::perfMonitorMemoryBandwidth()
+{
+	Interlagos::K10PerformanceCounters::perfMonitorMemoryBandwidth(this);
+}
+
+void Interlagos::perfMonitorHTLink()
+{
+	Interlagos::K10PerformanceCounters::perfMonitorHTLink(this);
+}
+
+/*
+ * Reads the request routes of each node to each node from the HyperTransport routing table
+ * (register 0x40 + 0x4 * destination node). routes is a nodes by nodes matrix.
+ */
+bool Interlagos::getHTRequestRoutes(DWORD nodes, DWORD *routes)
+{
+
+	PCIRegObject *routingTableRegObject;
+	DWORD node, destNode;
+
+	for (node = 0; node < nodes; node++) {
+
+		setNode(node);
+
+		for (destNode = 0; destNode < nodes; destNode++) {
+
+			routingTableRegObject = new PCIRegObject();
+
+			if (!routingTableRegObject->readPCIReg(PCI_DEV_NORTHBRIDGE, PCI_FUNC_HT_CONFIG,
+					0x40 + (0x4 * destNode), getNodeMask())) {
+				printf("Interlagos::getHTRequestRoutes - unable to read Routing Table PCI Register\n");
+				delete routingTableRegObject;
+				return false;
+			}
+
+			//Request Route is set in bits 0-8
+			routes[node * nodes + destNode] = routingTableRegObject->getBits(0, 0, 9);
+
+			delete routingTableRegObject;
+		}
+	}
+
+	return true;
+}
+
+void Interlagos::showNUMADistance()
+{
+
+	DWORD nodes = getProcessorNodes();
+	DWORD *routes, *hops;
+
+	if (nodes > HT_ROUTE_MAX_NODES)
+		nodes = HT_ROUTE_MAX_NODES;
+
+	routes = (DWORD *) calloc(nodes * nodes, sizeof(DWORD));
+	hops = (DWORD *) calloc(nodes * nodes, sizeof(DWORD));
+
+	if (getHTRequestRoutes(nodes, routes)) {
+		computeNUMAHops(nodes, routes, hops);
+		printNUMADistance(nodes, hops);
+	}
+
+	free(routes);
+	free(hops);
+
+}
+
+void Interlagos::perfMonitorNUMATraffic()
+{
+
+	DWORD nodes = getProcessorNodes();
+	DWORD *routes, *hops;
+
+	if (nodes > HT_ROUTE_MAX_NODES)
+		nodes = HT_ROUTE_MAX_NODES;
+
+	routes = (DWORD *) calloc(nodes * nodes, sizeof(DWORD));
+	hops = (DWORD *) calloc(nodes * nodes, sizeof(DWORD));
+
+	if (getHTRequestRoutes(nodes, routes)) {
+		computeNUMAHops(nodes, routes, hops);
+		Interlagos::K10PerformanceCounters::perfMonitorNUMATraffic(this, hops);
+	}
+
+	free(routes);
+	free(hops);
+
+}
+
+/*
+ * Collects the static settings of each DCT (timings, bank swizzle from DRAM Configuration High
+ * F2x94 bit 22, DctSelIntLvEn from DRAM Controller Select Low F2x110) and monitors page hits,
+ * misses and conflicts against them
+ */
+void Interlagos::perfMonitorDramPages()
+{
+	DWORD nodes = getProcessorNodes();
+	DWORD node_index, dct_index;
+	DWORD Trtp, Trc, Twr, Trrd, Tcwl, T_mode, Tfaw, TrwtWB, TrwtTO, Twtr, Twrrd;
+	DWORD Twrwrsdsc, Trdrdsdsc, Tref, Trfc0, Trfc1, Trfc2, Trfc3, MaxRdLatency;
+	struct dramPageSettings *settings, *dctSettings;
+	PCIRegObject *dctSelectLow, *dramConfigurationHigh;
+
+	settings = (struct dramPageSettings *) calloc(nodes * 2, sizeof(struct dramPageSettings));
+
+	dctSelectLow = new PCIRegObject();
+	dramConfigurationHigh = new PCIRegObject();
+
+	for (node_index = 0; node_index < nodes; node_index++)
+	{
+		setNode(node_index);
+
+		if (!dctSelectLow->readPCIReg(PCI_DEV_NORTHBRIDGE, PCI_FUNC_DRAM_CONTROLLER, 0x110, getNodeMask()))
+		{
+			printf("Interlagos::perfMonitorDramPages - unable to read PCI registers\n");
+			break;
+		}
+
+		for (dct_index = 0; dct_index < 2; dct_index++)
+		{
+			dctSettings = &settings[node_index * 2 + dct_index];
+
+			//Selects the DCT too
+			if (!getDramValid(dct_index))
+				continue;
+
+			if (!dramConfigurationHigh->readPCIReg(PCI_DEV_NORTHBRIDGE, PCI_FUNC_DRAM_CONTROLLER, 0x94, getNodeMask()))
+			{
+				printf("Interlagos::perfMonitorDramPages - unable to read PCI registers\n");
+				continue;
+			}
+
+			dctSettings->bankSwizzle = dramConfigurationHigh->getBits(0, 22, 1);
+			//MemClkFreq already encodes the data rate (eg: 0x12 is DDR3-1600)
+			dctSettings->dataRate = getDramFrequency(dct_index, &T_mode);
+
+			getDramTiming(dct_index, &dctSettings->Tcl, &dctSettings->Trcd, &dctSettings->Trp, &Trtp,
+					&dctSettings->Tras, &Trc, &Twr, &Trrd, &Tcwl, &Tfaw, &TrwtWB, &TrwtTO, &Twtr, &Twrrd,
+					&Twrwrsdsc, &Trdrdsdsc, &Tref, &Trfc0, &Trfc1, &Trfc2, &Trfc3, &MaxRdLatency);
+
+			dctSettings->valid = true;
+			dctSettings->channelInterleave = dctSelectLow->getBits(0, 2, 1);
+			dctSettings->ganged = false;
+		}
+	}
+
+	delete dctSelectLow;
+	delete dramConfigurationHigh;
+
+	Interlagos::K10PerformanceCounters::perfMonitorDramPages(this, settings);
+
+	free(settings);
+}
+
+void Interlagos::perfMonitorNorthbridge(const char *eventList)
+{
+	Interlagos::K10PerformanceCounters::perfMonitorNorthbridge(this, eventList);
+}
+
+void Interlagos::perfCounterBenchmark()
 {
-	Interlagos::K10PerformanceCounters::perfMonitorFPUUsage(this);
+	Interlagos::K10PerformanceCounters::perfCounterBenchmark(this);
 }
 
-void Interlagos::perfMonitorDCMA()
+void Interlagos::perfMonitorEvents(const char *eventList, DWORD quantum, const char *attribution)
 {
-	Interlagos::K10PerformanceCounters::perfMonitorDCMA(this);
+	Interlagos::K10PerformanceCounters::perfMonitorEvents(this, eventList, quantum, attribution);
 }
 
 
@@ -2860,7 +3220,7 @@ void Interlagos::checkMode()
 {
 	DWORD a, b, c, i, j, k, pstate, vid, fid, did;
 	DWORD eaxMsr, edxMsr;
-	DWORD timestamp;
+	uint64_t timestamp;
 
 	DWORD *states;
 	DWORD *savedstates;
@@ -2869,23 +3229,23 @@ void Interlagos::checkMode()
 #define SAVEDSTATES(NODE, CORE, PSTATE) STATEACCESS(savedstates, NODE, CORE, PSTATE)
 
 	DWORD minTemp, maxTemp, temp, savedMinTemp, savedMaxTemp;
-	DWORD oTimeStamp, iTimeStamp;
+	uint64_t oTimeStamp, iTimeStamp;
 
 	states = new DWORD[processorNodes * processorCores * getPowerStates()]();
 	savedstates = new DWORD[processorNodes * processorCores * getPowerStates()]();
 
 	minTemp = getTctlRegister();
 	maxTemp = minTemp;
-	iTimeStamp = GetTickCount();
+	iTimeStamp = TSCClock::getMilliseconds();
 	oTimeStamp = iTimeStamp;
 
 	while(1)
 	{
 		ClearScreen(CLEARSCREEN_FLAG_SMART);
 
-		timestamp=GetTickCount ();
+		timestamp=TSCClock::getMilliseconds();
 
-		printf ("\nTs:%u - ",timestamp);
+		printf ("\nTs:%llu - ",(unsigned long long)timestamp);
 		for (i = 0; i < processorNodes; i++)
 		{
 			setNode(i);
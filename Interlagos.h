@@ -8,6 +8,7 @@ private:
 	DWORD getHTLinkDistributionTarget(DWORD link, DWORD *DstLnk, DWORD *DstNode);
 
 	void printRoute(DWORD);
+	bool getHTRequestRoutes(DWORD nodes, DWORD *routes);
 
 	bool setDramController(DWORD device);
 	int getDramFrequency(DWORD device, DWORD *T_mode);
@@ -31,6 +32,7 @@ public:
 	void showFamilySpecs();
 	void showHTC();
 	void showHTLink();
+	void showNUMADistance();
 	void showDramTimings ();
 
 	float convertVIDtoVcore(DWORD);
@@ -93,6 +95,10 @@ public:
 	DWORD getBoost(void);
 	void setBoost(bool);
 	DWORD getTDP(void);
+	DWORD getCoresPerComputeUnit(void);
+	float getNodeTDPWatts(void);
+	float getPowerLimit(void);
+	bool setPowerLimit(float);
 
 	//Virtual method to modify DRAM timings -- Needs testing, only for DDR3 at the moment
 	DWORD setDramTiming(DWORD device, /* 0 or 1 */ DWORD Tcl, DWORD Trcd, DWORD Trp, DWORD Trtp, DWORD Tras, 
@@ -147,8 +153,23 @@ public:
 	void perfCounterGetInfo();
 	void perfCounterGetValue(unsigned int);
 	void perfMonitorCPUUsage();
-	void perfMonitorFPUUsage();
-	void perfMonitorDCMA();
+	void perfMonitorFPUUsage(DWORD profilePeriod);
+	void perfMonitorFPUModules();
+	void perfMonitorDCMA(DWORD profilePeriod);
+	void perfMonitorEffectiveFrequency();
+	void perfMonitorCoherence();
+	void perfMonitorDTLB();
+	void perfMonitorCacheMPKI();
+	void perfMonitorIPC();
+	void perfMonitorSamples(const char *eventSpec, DWORD period);
+	void perfMonitorIBS(DWORD period);
+	void perfMonitorMemoryBandwidth();
+	void perfMonitorHTLink();
+	void perfMonitorNUMATraffic();
+	void perfMonitorDramPages();
+	void perfMonitorNorthbridge(const char *eventList);
+	void perfCounterBenchmark();
+	void perfMonitorEvents(const char *eventList, DWORD quantum, const char *attribution);
 
 	//Scaler helper methods
 	void getCurrentStatus(struct procStatus *pStatus, DWORD core);
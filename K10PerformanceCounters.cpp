@@ -14,6 +14,138 @@
 #include "PCIRegObject.h"
 #include "MSRObject.h"
 #include "Signal.h"
+#include "PerformanceSampler.h"
+#include "PerformanceEvents.h"
+#include "PerformanceMultiplexer.h"
+#include "RdpmcSampler.h"
+#include "NorthbridgeCounter.h"
+#include "IBSSampler.h"
+#include "SampleProfiler.h"
+#include "TaskCounters.h"
+#include "TSCClock.h"
+
+#include <string.h>
+
+#define PROFILER_TOP_SHOWN 3 //Top offenders printed for each core
+#define PROFILER_DRAIN_INTERVAL 100 //Milliseconds between two drains of the ring buffers
+
+/*
+ * Sleeps ms milliseconds, draining the profiler ring buffers meanwhile so that they don't
+ * fill up. Profiler may be NULL.
+ */
+static void profilerSleep(SampleProfiler *profiler, DWORD ms)
+{
+	DWORD slept;
+
+	if (profiler == NULL)
+	{
+		Sleep(ms);
+		return;
+	}
+
+	for (slept = 0; slept < ms; slept += PROFILER_DRAIN_INTERVAL)
+	{
+		Sleep(PROFILER_DRAIN_INTERVAL);
+		profiler->drain();
+	}
+}
+
+/*
+ * Prints for each core the processes and the instruction pointers that caused most of the
+ * samples since the last call, then begins a new window
+ */
+static void printTopOffenders(class Processor *p, SampleProfiler *profiler)
+{
+	struct ProfilerEntry entries[PROFILER_TOP_SHOWN];
+	char name[32];
+	DWORD nodeId, coreId, cpuIndex;
+	unsigned int entry, entryCount;
+	uint64_t samples;
+
+	cpuIndex = 0;
+
+	for (nodeId = 0; nodeId < p->getProcessorNodes(); nodeId++)
+	{
+		for (coreId = 0x0; coreId < p->getProcessorCores(); coreId++)
+		{
+			samples = profiler->getSamples(cpuIndex);
+
+			printf("\tNode %u c%u - samples:%llu", nodeId, coreId, (unsigned long long) samples);
+
+			if (profiler->getLost(cpuIndex) != 0)
+				printf(" lost:%llu", (unsigned long long) profiler->getLost(cpuIndex));
+
+			entryCount = profiler->getTopPids(cpuIndex, entries, PROFILER_TOP_SHOWN);
+
+			for (entry = 0; entry < entryCount; entry++)
+			{
+				if (!SampleProfiler::getProcessName(entries[entry].pid, name, sizeof(name)))
+					strcpy(name, "?");
+
+				printf(" %s(%u):%llu%%", name, entries[entry].pid,
+						(unsigned long long) ((entries[entry].count * 100) / samples));
+			}
+
+			entryCount = profiler->getTopIps(cpuIndex, entries, PROFILER_TOP_SHOWN);
+
+			if (entryCount > 0)
+				printf(" |");
+
+			for (entry = 0; entry < entryCount; entry++)
+				printf(" 0x%llx:%llu", (unsigned long long) entries[entry].key, (unsigned long long) entries[entry].count);
+
+			printf("\n");
+
+			cpuIndex++;
+		}
+	}
+
+	profiler->reset();
+}
+
+/*
+ * Options opening perf events on the core counters (sampling, attribution) can't run along
+ * counters programmed through MSRs: the kernel does not know those slots are taken and could
+ * schedule its events on them. Returns true if the monitor counters use the perf backend, else
+ * prints why option can't be used by method and returns false.
+ */
+static bool requirePerfBackend(const char *method, const char *option)
+{
+	if (PerformanceCounter::getBackend() == PERFCOUNTER_BACKEND_PERF)
+		return true;
+
+	printf("K10PerformanceCounters.cpp::%s - %s requires -pcbackend perf, perf events would share the counters programmed through MSRs\n",
+			method, option);
+
+	return false;
+}
+
+/*
+ * Returns a profiler sampling the event every period events on all the cores, or NULL if
+ * period is zero. Throws if the profiler can't be started.
+ */
+static SampleProfiler *startProfiler(class Processor *p, unsigned short int eventSelect, unsigned char unitMask, DWORD period)
+{
+	SampleProfiler *profiler;
+
+	if (period == 0)
+		return NULL;
+
+	if (!SampleProfiler::isSupported())
+		throw "sampling profiler is not available on this system";
+
+	profiler = new SampleProfiler(p->getMask(p->ALL_CORES, p->ALL_NODES));
+
+	if (!profiler->start(eventSelect, unitMask, period))
+	{
+		delete profiler;
+		throw "unable to open sampling events, check perf_event_paranoid";
+	}
+
+	printf("Sampling an event every %u events\n", period);
+
+	return profiler;
+}
 
 void Processor::K10PerformanceCounters::perfMonitorCPUUsage(class Processor *p)
 {
@@ -139,7 +271,7 @@ void Processor::K10PerformanceCounters::perfMonitorCPUUsage(class Processor *p)
 
 				for (coreId = 0x0; coreId < p->getProcessorCores(); coreId++)
 				{
- 					usage = ((perfCounter->getCounter(cpuIndex)) - prevPerfCounters[cpuIndex]) * 100;
+ 					usage = PerformanceCounter::counterDelta(prevPerfCounters[cpuIndex], perfCounter->getCounter(cpuIndex)) * 100;
  					usage /= tscCounter->getBits(cpuIndex, 0, 64) - prevTSCCounters[cpuIndex];
  
  					printf(" c%d:%d%%", coreId, (unsigned int) usage);
@@ -164,7 +296,7 @@ void Processor::K10PerformanceCounters::perfMonitorCPUUsage(class Processor *p)
 
 	}
 
-	free(perfCounter);
+	delete perfCounter;
 	free(tscCounter);
 	free(prevPerfCounters);
 	free(prevTSCCounters);
@@ -173,9 +305,11 @@ void Processor::K10PerformanceCounters::perfMonitorCPUUsage(class Processor *p)
 
 }
 
-void Processor::K10PerformanceCounters::perfMonitorFPUUsage(class Processor *p)
+void Processor::K10PerformanceCounters::perfMonitorFPUUsage(class Processor *p, DWORD profilePeriod)
 {
 	PerformanceCounter *perfCounter;
+	SampleProfiler *profiler;
+	const struct PerformanceEvent *fpuOps;
 	MSRObject *tscCounter; //We need the timestamp counter too to determine the cpu usage in percentage
 
 	DWORD cpuIndex, nodeId, coreId;
@@ -189,6 +323,11 @@ void Processor::K10PerformanceCounters::perfMonitorFPUUsage(class Processor *p)
 	uint64_t *prevPerfCounters;
 	uint64_t *prevTSCCounters;
 
+	profiler = NULL;
+
+	if (profilePeriod != 0 && !requirePerfBackend("perfMonitorFPUUsage", "-pcprofile"))
+		return;
+
 	try {
 
 		p->setNode(p->ALL_NODES);
@@ -265,6 +404,18 @@ void Processor::K10PerformanceCounters::perfMonitorFPUUsage(class Processor *p)
 			}
 		}
 
+		//Samples the FPU operations to show who uses the FPU, the empty cycles counted above
+		//would point at the processes that don't
+		if (profilePeriod != 0)
+		{
+			fpuOps = PerformanceEvents::find("fpu-ops", PerformanceEvents::getFamilyFlag(p->getSpecFamilyExtended()));
+
+			if (fpuOps == NULL)
+				throw "FPU operations event is not available on this processor";
+
+			profiler = startProfiler(p, fpuOps->eventSelect, fpuOps->unitMask, profilePeriod);
+		}
+
 		Signal::activateUserSignalsHandler();
 
 		while (!Signal::getSignalStatus())
@@ -284,7 +435,7 @@ void Processor::K10PerformanceCounters::perfMonitorFPUUsage(class Processor *p)
 				for (coreId = 0x0; coreId < p->getProcessorCores(); coreId++)
 				{
 
-					usage = ((perfCounter->getCounter(cpuIndex)) - prevPerfCounters[cpuIndex]) * 100;
+					usage = PerformanceCounter::counterDelta(prevPerfCounters[cpuIndex], perfCounter->getCounter(cpuIndex)) * 100;
 					usage /= tscCounter->getBits(cpuIndex, 0, 64) - prevTSCCounters[cpuIndex];
 
 					printf(" c%u:%u%%", coreId, (unsigned int) usage);
@@ -296,10 +447,12 @@ void Processor::K10PerformanceCounters::perfMonitorFPUUsage(class Processor *p)
 				}
 				printf("\n");
 			}
+			if (profiler != NULL)
+				printTopOffenders(p, profiler);
 			if (fflush(stdout) == EOF) {
 				break;
 			}
-			Sleep(1000);
+			profilerSleep(profiler, 1000);
 		}
 
 		perfCounter->disable();
@@ -311,7 +464,8 @@ void Processor::K10PerformanceCounters::perfMonitorFPUUsage(class Processor *p)
 		printf("K10PerformanceCounters.cpp::perfMonitorCPUUsage - %s\n", str);
 	}
 
-	free(perfCounter);
+	delete profiler;
+	delete perfCounter;
 	free(tscCounter);
 	free(prevPerfCounters);
 	free(prevTSCCounters);
@@ -320,9 +474,10 @@ void Processor::K10PerformanceCounters::perfMonitorFPUUsage(class Processor *p)
 
 }
 
-void Processor::K10PerformanceCounters::perfMonitorDCMA(class Processor *p)
+void Processor::K10PerformanceCounters::perfMonitorDCMA(class Processor *p, DWORD profilePeriod)
 {
 	PerformanceCounter *perfCounter;
+	SampleProfiler *profiler;
 
 	DWORD cpuIndex, nodeId, coreId;
 	PROCESSORMASK cpuMask;
@@ -333,6 +488,11 @@ void Processor::K10PerformanceCounters::perfMonitorDCMA(class Processor *p)
 	// This pointers will refer an array containing previous performance counter values
 	uint64_t *prevPerfCounters;
 
+	profiler = NULL;
+
+	if (profilePeriod != 0 && !requirePerfBackend("perfMonitorDCMA", "-pcprofile"))
+		return;
+
 	try {
 
 		p->setNode(p->ALL_NODES);
@@ -403,6 +563,9 @@ void Processor::K10PerformanceCounters::perfMonitorDCMA(class Processor *p)
 			}
 		}
 
+		//Samples the same event to show who causes it
+		profiler = startProfiler(p, 0x47, 0, profilePeriod);
+
 		Signal::activateUserSignalsHandler();
 
 		while (!Signal::getSignalStatus())
@@ -418,7 +581,7 @@ void Processor::K10PerformanceCounters::perfMonitorDCMA(class Processor *p)
 
 				for (coreId = 0x0; coreId < p->getProcessorCores(); coreId++)
 				{
-					misses = perfCounter->getCounter(cpuIndex) - prevPerfCounters[cpuIndex];
+					misses = PerformanceCounter::counterDelta(prevPerfCounters[cpuIndex], perfCounter->getCounter(cpuIndex));
 
 					printf(" c%u:%0.3fk", coreId, (float) (misses/1000.0f));
 
@@ -428,10 +591,12 @@ void Processor::K10PerformanceCounters::perfMonitorDCMA(class Processor *p)
 				}
 				printf("\n");
 			}
+			if (profiler != NULL)
+				printTopOffenders(p, profiler);
 			if (fflush(stdout) == EOF) {
 				break;
 			}
-			Sleep(1000);
+			profilerSleep(profiler, 1000);
 		}
 
 		perfCounter->disable();
@@ -444,14 +609,2587 @@ void Processor::K10PerformanceCounters::perfMonitorDCMA(class Processor *p)
 
 	}
 
-	free(perfCounter);
+	delete profiler;
+	delete perfCounter;
 	free(prevPerfCounters);
 
 	return;
 
 }
 
+/*
+ * Monitors per-core effective frequency using APERF and MPERF registers. Along with the
+ * effective frequency shows the busy percentage (time spent in C0), the frequency invariant
+ * load (P0 capacity actually delivered) and the current pstate from COFVID status register
+ */
+void Processor::K10PerformanceCounters::perfMonitorEffectiveFrequency(class Processor *p)
+{
+	PerformanceSampler *sampler;
+	MSRObject *cofvidStatus;
+
+	DWORD cpuIndex, nodeId, coreId;
+	PROCESSORMASK cpuMask;
+
+	sampler = NULL;
+	cofvidStatus = NULL;
+
+	try {
+
+		p->setNode(p->ALL_NODES);
+		p->setCore(p->ALL_CORES);
+
+		cpuMask = p->getMask();
+
+		sampler = new PerformanceSampler(cpuMask);
+		cofvidStatus = new MSRObject();
+
+		if (!sampler->setFrequencyCounters(true))
+			throw "processor does not support APERF/MPERF registers";
+
+		//First snapshot initializes previous values
+		if (!sampler->takeSnapshot())
+			throw "unable to retrieve APERF/MPERF registers";
+
+		Signal::activateUserSignalsHandler();
+
+		while (!Signal::getSignalStatus())
+		{
+			Sleep(1000);
+
+			if (!sampler->takeSnapshot())
+				throw "unable to retrieve APERF/MPERF registers";
+
+			if (!cofvidStatus->readMSR(COFVID_STATUS_REG, cpuMask))
+				throw "unable to retrieve COFVID status register";
+
+			cpuIndex = 0;
+
+			for (nodeId = 0; nodeId < p->getProcessorNodes(); nodeId++)
+			{
+				printf("Node %d -", nodeId);
+
+				for (coreId = 0x0; coreId < p->getProcessorCores(); coreId++)
+				{
+					//Current pstate is reported in bits 16-18 of COFVID status register
+					printf(" c%u:%uMHz busy:%u%% load:%u%% ps%u", coreId,
+							sampler->getEffectiveFrequency(cpuIndex),
+							sampler->getBusy(cpuIndex),
+							sampler->getInvariantLoad(cpuIndex),
+							(unsigned int) cofvidStatus->getBits(cpuIndex, 16, 3));
+
+					cpuIndex++;
+				}
+				printf("\n");
+			}
+			if (fflush(stdout) == EOF) {
+				break;
+			}
+		}
+
+	} catch (char const *str) {
+
+		printf("K10PerformanceCounters.cpp::perfMonitorEffectiveFrequency - %s\n", str);
+
+	}
+
+	delete sampler;
+	delete cofvidStatus;
+
+	return;
+
+}
+
+/*
+ * Opens the attribution targets of perfMonitorEvents: a comma separated list of pids, of cgroup
+ * paths (relative to the cgroup root or absolute) and of the keyword "cgroups", for all the top
+ * level cgroups. The first TASK_MAX_EVENTS events are counted on each target (see TaskCounters).
+ */
+static TaskCounters *startAttribution(class Processor *p, const struct PerformanceEvent *events, unsigned int eventCount, const char *attribution)
+{
+	TaskCounters *taskCounters;
+	PerformanceCounter *perfCounter;
+	char cgroups[TASK_MAX_PROCESSES][TASK_NAME_LENGTH];
+	char target[TASK_NAME_LENGTH];
+	const char *token;
+	char *end;
+	size_t length;
+	unsigned int eventIndex, cgroup, cgroupCount;
+	DWORD pid;
+
+	if (!TaskCounters::isSupported())
+		throw "per-process and per-cgroup attribution is not available on this system";
+
+	taskCounters = new TaskCounters();
+
+	//Counters only describe the events, they are never programmed
+	for (eventIndex = 0; eventIndex < eventCount && eventIndex < TASK_MAX_EVENTS; eventIndex++)
+	{
+		perfCounter = new PerformanceCounter(p->getMask(), 0, p->getMaxSlots());
+		perfCounter->setEventSelect(events[eventIndex].eventSelect);
+		perfCounter->setUnitMask(events[eventIndex].unitMask);
+
+		taskCounters->addEvent(perfCounter);
+
+		delete perfCounter;
+	}
+
+	if (eventCount > TASK_MAX_EVENTS)
+		printf("Only the first %u events are attributed\n", TASK_MAX_EVENTS);
+
+	token = attribution;
+
+	while (*token != '\0')
+	{
+		length = strcspn(token, ",");
+
+		if (length > 0 && length < sizeof(target))
+		{
+			strncpy(target, token, length);
+			target[length] = '\0';
+
+			if (strcmp(target, "cgroups") == 0)
+			{
+				cgroupCount = TaskCounters::getCgroups(cgroups, TASK_MAX_PROCESSES);
+
+				for (cgroup = 0; cgroup < cgroupCount; cgroup++)
+					if (!taskCounters->attachCgroup(cgroups[cgroup], p->getMask()))
+						printf("Unable to count cgroup %s\n", cgroups[cgroup]);
+			}
+			else
+			{
+				pid = strtoul(target, &end, 10);
+
+				if (*end == '\0' && pid != 0)
+				{
+					if (!taskCounters->attach(pid))
+						printf("Unable to count process %u\n", pid);
+				}
+				else if (!taskCounters->attachCgroup(target, p->getMask()))
+				{
+					printf("Unable to count cgroup %s\n", target);
+				}
+			}
+		}
+
+		token += length;
+		if (*token == ',')
+			token++;
+	}
+
+	//First snapshot initializes previous values
+	if (taskCounters->getProcessCount() == 0 || !taskCounters->takeSnapshot())
+	{
+		delete taskCounters;
+		throw "no attribution target can be counted, check the targets and perf_event_paranoid";
+	}
+
+	return taskCounters;
+}
+
+/*
+ * Monitors a comma separated list of events (see PerformanceEvents::parse for the syntax of each
+ * event). A slash separates groups of events: events of the same group are always counted
+ * together, while groups take turns on the counter slots every quantum milliseconds (see
+ * PerformanceMultiplexer). Groups bigger than the available slots are split. Every second prints,
+ * for each core, the count of each event and, from the second event on, its ratio to the first
+ * one (eg: cycles,instructions shows IPC). When groups are multiplexed, counts are scaled and the
+ * percentage of time each event has been counted is shown in brackets.
+ *
+ * If attribution is not NULL, the same events are also counted per process and per cgroup (see
+ * startAttribution) and printed after the cores, in the same format, every second.
+ */
+void Processor::K10PerformanceCounters::perfMonitorEvents(class Processor *p, const char *eventList, DWORD quantum, const char *attribution)
+{
+	PerformanceMultiplexer *multiplexer;
+	TaskCounters *taskCounters;
+	struct PerformanceEvent event;
+	struct PerformanceEvent attributed[TASK_MAX_EVENTS];
+	char name[32];
+	char labels[SAMPLER_MAX_EVENTS][64];
+	unsigned int eventGroup[SAMPLER_MAX_EVENTS];
+	unsigned int groupEvent[SAMPLER_MAX_EVENTS];
+	const char *token;
+	size_t length;
+
+	DWORD cpuIndex, nodeId, coreId, family;
+	PROCESSORMASK cpuMask;
+	unsigned int eventIndex, eventCount, group, target;
+	uint64_t first, count, window;
+	bool newGroup;
+
+	multiplexer = NULL;
+	taskCounters = NULL;
+	eventCount = 0;
+
+	if (attribution != NULL && !requirePerfBackend("perfMonitorEvents", "-pcattrib"))
+		return;
+
+	try {
+
+		family = PerformanceEvents::getFamilyFlag(p->getSpecFamilyExtended());
+
+		if (family == 0)
+			throw "no event catalog available for this processor family";
+
+		p->setNode(p->ALL_NODES);
+		p->setCore(p->ALL_CORES);
+
+		cpuMask = p->getMask();
+
+		multiplexer = new PerformanceMultiplexer(cpuMask, p->getMaxSlots(), family);
+		multiplexer->setQuantum(quantum);
+
+		//Parses the event list and builds the groups
+		token = eventList;
+		group = multiplexer->addGroup();
+		newGroup = false;
+
+		while (*token != '\0')
+		{
+			length = strcspn(token, ",/");
+
+			if (length == 0 || length >= sizeof(labels[0]))
+				throw "invalid event list";
+
+			if (eventCount >= SAMPLER_MAX_EVENTS)
+				throw "too many events";
+
+			strncpy(labels[eventCount], token, length);
+			labels[eventCount][length] = '\0';
+
+			if (!PerformanceEvents::parse(labels[eventCount], family, &event))
+			{
+				printf("Unknown event: %s\n", labels[eventCount]);
+				throw "invalid event list";
+			}
+
+			if (event.source == EVENT_SOURCE_NB && family == EVENT_FAMILY_15H)
+				throw "northbridge events can't be counted by core performance counters on this processor, use -pcnbmonitor";
+
+			if (eventCount < TASK_MAX_EVENTS)
+				attributed[eventCount] = event;
+
+			if (newGroup)
+			{
+				group = multiplexer->addGroup();
+				newGroup = false;
+			}
+
+			if (group == 0xffffffff)
+				throw "too many event groups";
+
+			groupEvent[eventCount] = multiplexer->addEvent(group, event.eventSelect, event.unitMask);
+
+			//Group is full, the event goes in a new group
+			if (groupEvent[eventCount] == 0xffffffff)
+			{
+				group = multiplexer->addGroup();
+
+				if (group == 0xffffffff)
+					throw "too many event groups";
+
+				groupEvent[eventCount] = multiplexer->addEvent(group, event.eventSelect, event.unitMask);
+
+				if (groupEvent[eventCount] == 0xffffffff)
+				{
+					printf("Event %s can't be counted on the performance counter slots of this processor\n", labels[eventCount]);
+					throw "invalid event list";
+				}
+			}
+
+			eventGroup[eventCount] = group;
+			eventCount++;
+
+			token += length;
+			if (*token == '/')
+				newGroup = true;
+			if (*token != '\0')
+				token++;
+		}
+
+		if (eventCount == 0)
+			throw "no events to monitor";
+
+		if (!multiplexer->start())
+			throw "unable to find free performance counter slots the events are allowed on";
+
+		for (eventIndex = 0; eventIndex < eventCount; eventIndex++)
+			printf("Event %s will use slot #%d in group %u\n", labels[eventIndex],
+					multiplexer->getSlot(eventGroup[eventIndex], groupEvent[eventIndex]), eventGroup[eventIndex]);
+
+		if (multiplexer->isMultiplexing())
+			printf("Multiplexing %u groups with a quantum of %ums\n", multiplexer->getGroupCount(), multiplexer->getQuantum());
+
+		if (attribution != NULL)
+			taskCounters = startAttribution(p, attributed, eventCount, attribution);
+
+		Signal::activateUserSignalsHandler();
+
+		window = TSCClock::getMilliseconds();
+
+		while (!Signal::getSignalStatus())
+		{
+			Sleep(multiplexer->isMultiplexing() ? multiplexer->getQuantum() : 1000);
+
+			if (!multiplexer->rotate())
+				throw "unable to retrieve performance counter data";
+
+			if (TSCClock::getMilliseconds() - window < 1000)
+				continue;
+
+			window = TSCClock::getMilliseconds();
+
+			cpuIndex = 0;
+
+			for (nodeId = 0; nodeId < p->getProcessorNodes(); nodeId++)
+			{
+				for (coreId = 0x0; coreId < p->getProcessorCores(); coreId++)
+				{
+					printf("Node %u c%u -", nodeId, coreId);
+
+					first = multiplexer->getScaledCount(eventGroup[0], groupEvent[0], cpuIndex);
+
+					for (eventIndex = 0; eventIndex < eventCount; eventIndex++)
+					{
+						count = multiplexer->getScaledCount(eventGroup[eventIndex], groupEvent[eventIndex], cpuIndex);
+
+						printf(" %s:%llu", labels[eventIndex], (unsigned long long) count);
+
+						if (multiplexer->isMultiplexing() && multiplexer->getEnabledTime() != 0)
+							printf(" [%u%%]", (unsigned int) ((multiplexer->getRunningTime(eventGroup[eventIndex]) * 100) /
+									multiplexer->getEnabledTime()));
+
+						if (eventIndex > 0 && first != 0)
+							printf(" (%0.3f)", (float) count / (float) first);
+					}
+					printf("\n");
+
+					cpuIndex++;
+				}
+			}
+
+			if (taskCounters != NULL)
+			{
+				if (!taskCounters->takeSnapshot())
+					throw "unable to retrieve per-process counters";
+
+				for (target = 0; target < taskCounters->getProcessCount(); target++)
+				{
+					if (taskCounters->getPid(target) == 0)
+					{
+						printf("cgroup %s -", taskCounters->getCgroup(target));
+					}
+					else
+					{
+						if (!SampleProfiler::getProcessName(taskCounters->getPid(target), name, sizeof(name)))
+							strcpy(name, "?");
+
+						printf("pid %u %s -", taskCounters->getPid(target), name);
+					}
+
+					first = taskCounters->getEventDelta(0, target);
+
+					for (eventIndex = 0; eventIndex < eventCount && eventIndex < TASK_MAX_EVENTS; eventIndex++)
+					{
+						count = taskCounters->getEventDelta(eventIndex, target);
+
+						printf(" %s:%llu", labels[eventIndex], (unsigned long long) count);
+
+						if (eventIndex > 0 && first != 0)
+							printf(" (%0.3f)", (float) count / (float) first);
+					}
+					printf("\n");
+				}
+			}
+
+			multiplexer->resetCounts();
+
+			if (fflush(stdout) == EOF) {
+				break;
+			}
+		}
+
+	} catch (char const *str) {
+
+		printf("K10PerformanceCounters.cpp::perfMonitorEvents - %s\n", str);
+
+	}
+
+	delete taskCounters;
+
+	//Destructor disables the counters
+	delete multiplexer;
+
+	return;
 
+}
+
+
+#define IPC_RATIO_SCALE 1000 //Fixed-point ratios are in thousandths
+
+/*
+ * Monitors per-core IPC and dispatch stall breakdown. Retired instructions, cycles not halted and
+ * as many dispatch stall events as the counter slots allow are counted in a single group, so that
+ * the ratios refer to the same cycles even when the perf backend multiplexes the counters. Ratios
+ * are computed in fixed point (thousandths) with integer math.
+ *
+ * On Family 15h dispatch stalls can be counted only on PERF_CTL[2:0], so they get those slots and
+ * instructions and cycles the others (see PerformanceEvents::planSlots()).
+ */
+void Processor::K10PerformanceCounters::perfMonitorIPC(class Processor *p)
+{
+	PerformanceSampler *sampler;
+	PerformanceCounter *perfCounters[SAMPLER_MAX_EVENTS];
+	const struct PerformanceEvent *events[SAMPLER_MAX_EVENTS];
+	DWORD slotMasks[SAMPLER_MAX_EVENTS];
+
+	//Stall events by priority, the first ones that fit the counter slots are used
+	const char *stallNames[] = { "stall-dispatch", "stall-rob-full", "stall-rs-full", "stall-ls-full",
+			"stall-fpu-full", "stall-branch-abort", "stall-serialization", NULL };
+
+	DWORD nodeId, coreId, cpuIndex, family;
+	PROCESSORMASK cpuMask;
+	unsigned int eventIndex, eventCount, programmed, stall;
+	uint64_t instructions, cycles, ratio;
+
+	sampler = NULL;
+	programmed = 0;
+
+	try {
+
+		family = PerformanceEvents::getFamilyFlag(p->getSpecFamilyExtended());
+
+		p->setNode(p->ALL_NODES);
+		p->setCore(p->ALL_CORES);
+
+		cpuMask = p->getMask();
+
+		events[0] = PerformanceEvents::find("instructions", family);
+		events[1] = PerformanceEvents::find("cycles", family);
+		eventCount = 2;
+
+		if (events[0] == NULL || events[1] == NULL)
+			throw "instructions and cycles events are not available on this processor";
+
+		if (!PerformanceEvents::planSlots(events, eventCount, family, p->getMaxSlots(), slotMasks))
+			throw "instructions and cycles do not fit the performance counter slots";
+
+		//A stall event is added only if all the events still fit their allowed slots
+		for (stall = 0; stallNames[stall] != NULL && eventCount < (unsigned int) p->getMaxSlots(); stall++)
+		{
+			events[eventCount] = PerformanceEvents::find(stallNames[stall], family);
+
+			if (events[eventCount] != NULL &&
+					PerformanceEvents::planSlots(events, eventCount + 1, family, p->getMaxSlots(), slotMasks))
+				eventCount++;
+		}
+
+		//A rejected stall event leaves its plan in slotMasks, plans the final set again
+		PerformanceEvents::planSlots(events, eventCount, family, p->getMaxSlots(), slotMasks);
+
+		sampler = new PerformanceSampler(cpuMask);
+
+		//Instructions counter leads the group, members are programmed after it
+		for (eventIndex = 0; eventIndex < eventCount; eventIndex++)
+		{
+			perfCounters[eventIndex] = new PerformanceCounter(cpuMask, 0, p->getMaxSlots());
+			programmed++;
+
+			if (eventIndex > 0)
+				perfCounters[eventIndex]->setGroupLeader(perfCounters[0]);
+
+			setupCounter(perfCounters[eventIndex], events[eventIndex]->eventSelect, events[eventIndex]->unitMask,
+					slotMasks[eventIndex]);
+
+			sampler->addEventCounter(perfCounters[eventIndex]);
+		}
+
+		//First snapshot initializes previous values
+		if (!sampler->takeSnapshot())
+			throw "unable to retrieve performance counter data";
+
+		Signal::activateUserSignalsHandler();
+
+		while (!Signal::getSignalStatus())
+		{
+			Sleep(1000);
+
+			if (!sampler->takeSnapshot())
+				throw "unable to retrieve performance counter data";
+
+			cpuIndex = 0;
+
+			for (nodeId = 0; nodeId < p->getProcessorNodes(); nodeId++)
+			{
+				for (coreId = 0x0; coreId < p->getProcessorCores(); coreId++)
+				{
+					instructions = sampler->getEventDelta(0, cpuIndex);
+					cycles = sampler->getEventDelta(1, cpuIndex);
+
+					ratio = (cycles != 0) ? (instructions * IPC_RATIO_SCALE) / cycles : 0;
+
+					printf("Node %u c%u - ipc:%llu.%03llu", nodeId, coreId,
+							(unsigned long long) (ratio / IPC_RATIO_SCALE), (unsigned long long) (ratio % IPC_RATIO_SCALE));
+
+					//Stalls as percentage of cycles, with one decimal
+					for (eventIndex = 2; eventIndex < eventCount; eventIndex++)
+					{
+						ratio = (cycles != 0) ? (sampler->getEventDelta(eventIndex, cpuIndex) * IPC_RATIO_SCALE) / cycles : 0;
+
+						printf(" %s:%llu.%llu%%", events[eventIndex]->name + strlen("stall-"),
+								(unsigned long long) (ratio / 10), (unsigned long long) (ratio % 10));
+					}
+
+					printf("\n");
+
+					cpuIndex++;
+				}
+			}
+			if (fflush(stdout) == EOF) {
+				break;
+			}
+		}
+
+	} catch (char const *str) {
+
+		printf("K10PerformanceCounters.cpp::perfMonitorIPC - %s\n", str);
+
+	}
+
+	//Members are disabled and deleted before the leader
+	while (programmed > 0)
+	{
+		programmed--;
+		if (perfCounters[programmed]->getEnabled()) perfCounters[programmed]->disable();
+		delete perfCounters[programmed];
+	}
+
+	delete sampler;
+
+	return;
+
+}
+
+#define CACHE_CORE_EVENTS 5 //Core events of the cache monitor, the last two only if slots allow
+
+//Prints misses per kilo instruction with three decimals, in fixed point
+static void printMPKI(const char *label, uint64_t misses, uint64_t instructions)
+{
+	uint64_t mpki;
+
+	mpki = (instructions != 0) ? (misses * 1000 * IPC_RATIO_SCALE) / instructions : 0;
+
+	printf(" %s:%llu.%03llu", label, (unsigned long long) (mpki / IPC_RATIO_SCALE), (unsigned long long) (mpki % IPC_RATIO_SCALE));
+}
+
+//Prints a miss ratio as percentage with one decimal, in fixed point
+static void printMissRatio(const char *label, uint64_t misses, uint64_t requests)
+{
+	uint64_t ratio;
+
+	ratio = (requests != 0) ? (misses * IPC_RATIO_SCALE) / requests : 0;
+
+	printf(" %s:%llu.%llu%%", label, (unsigned long long) (ratio / 10), (unsigned long long) (ratio % 10));
+}
+
+/*
+ * Returns the unit mask of an L3 event (0x4E0, 0x4E1) counting only the requests of coreId.
+ * Family 10h before revision D selects cores with one bit each in unit mask bits 7:4, later
+ * revisions and Family 15h with the core number.
+ */
+static unsigned char getL3CoreSelect(class Processor *p, unsigned char unitMask, DWORD coreId)
+{
+	if (p->getSpecFamilyExtended() == 0x10 && p->getSpecModelExtended() < 8)
+		return (unitMask & 0x0f) | ((1 << coreId) << 4);
+
+	return (unitMask & 0x0f) | (coreId << 4);
+}
+
+/*
+ * Monitors L1 data cache, L2 and L3 misses per kilo instruction, per core and per node.
+ * L1D and L2 events are core events and are counted on all the cores at once. L3 requests and
+ * misses are northbridge events shared by the node, but their unit mask selects the requesting
+ * core: northbridge slots are not enough for all the cores, so the cores take turns on them
+ * within each second and L3 misses of each core are related to the instructions it retired while
+ * it was being counted. On Family 15h L3 events go on the northbridge counters; on Family 10h they
+ * go on the slot of the first core of each node left free by the core events, and only L3 misses
+ * are counted. L3 counters are created once, each turn only changes their core select.
+ *
+ * On Family 15h L2 events can be counted only on PERF_CTL[2:0], core events are placed with
+ * PerformanceEvents::planSlots().
+ */
+void Processor::K10PerformanceCounters::perfMonitorCacheMPKI(class Processor *p)
+{
+	PerformanceSampler *coreSampler, *nbSampler;
+	PerformanceCounter *coreCounters[CACHE_CORE_EVENTS];
+	PerformanceCounter *nbCounters[NB_PERF_SLOTS_15];
+	const struct PerformanceEvent *coreEvents[CACHE_CORE_EVENTS];
+	const struct PerformanceEvent *l3Events[2];
+	DWORD slotMasks[CACHE_CORE_EVENTS];
+
+	const char *coreNames[CACHE_CORE_EVENTS] = { "instructions", "dc-misses", "l2-misses", "dc-accesses", "l2-requests" };
+
+	DWORD nodeId, coreId, cpuIndex, family, firstCore;
+	PROCESSORMASK cpuMask;
+	unsigned int eventIndex, coreEventCount, l3EventCount, nbSlots, coresPerPass, passes;
+	unsigned int coreProgrammed, nbProgrammed, counter;
+
+	uint64_t *totals[CACHE_CORE_EVENTS]; //Per-cpu core event counts in the window
+	uint64_t *l3Counts[2]; //Per-cpu L3 misses and requests while the core was counted
+	uint64_t *l3Instructions; //Per-cpu instructions while the core was counted
+	uint64_t nodeTotals[CACHE_CORE_EVENTS], nodeL3Counts[2], nodeL3Instructions;
+
+	DWORD cpuCount;
+
+	coreSampler = NULL;
+	nbSampler = NULL;
+	coreProgrammed = 0;
+	nbProgrammed = 0;
+
+	cpuCount = p->getProcessorNodes() * p->getProcessorCores();
+
+	for (eventIndex = 0; eventIndex < CACHE_CORE_EVENTS; eventIndex++)
+		totals[eventIndex] = (uint64_t *) calloc(cpuCount, sizeof(uint64_t));
+
+	l3Counts[0] = (uint64_t *) calloc(cpuCount, sizeof(uint64_t));
+	l3Counts[1] = (uint64_t *) calloc(cpuCount, sizeof(uint64_t));
+	l3Instructions = (uint64_t *) calloc(cpuCount, sizeof(uint64_t));
+
+	try {
+
+		family = PerformanceEvents::getFamilyFlag(p->getSpecFamilyExtended());
+
+		p->setNode(p->ALL_NODES);
+		p->setCore(p->ALL_CORES);
+
+		cpuMask = p->getMask();
+
+		l3Events[0] = PerformanceEvents::find("l3-misses", family);
+		l3Events[1] = PerformanceEvents::find("l3-requests", family);
+
+		if (l3Events[0] == NULL)
+			throw "L3 cache events are not available on this processor";
+
+		//Splits the slots between core and L3 events
+		if (NorthbridgeCounter::isSupported())
+		{
+			coreEventCount = (p->getMaxSlots() < CACHE_CORE_EVENTS) ? p->getMaxSlots() : CACHE_CORE_EVENTS;
+			nbSlots = NB_PERF_SLOTS_15;
+			l3EventCount = 2;
+		}
+		else
+		{
+			coreEventCount = 3;
+			nbSlots = p->getMaxSlots() - coreEventCount;
+			l3EventCount = 1;
+		}
+
+		coresPerPass = nbSlots / l3EventCount;
+		passes = (p->getProcessorCores() + coresPerPass - 1) / coresPerPass;
+
+		for (eventIndex = 0; eventIndex < coreEventCount; eventIndex++)
+		{
+			coreEvents[eventIndex] = PerformanceEvents::find(coreNames[eventIndex], family);
+
+			if (coreEvents[eventIndex] == NULL)
+				throw "cache events are not available on this processor";
+		}
+
+		//Miss ratios are dropped if the events do not fit their allowed slots
+		if (!PerformanceEvents::planSlots(coreEvents, coreEventCount, family, p->getMaxSlots(), slotMasks))
+		{
+			coreEventCount = 3;
+
+			if (!PerformanceEvents::planSlots(coreEvents, coreEventCount, family, p->getMaxSlots(), slotMasks))
+				throw "cache events do not fit the performance counter slots";
+		}
+
+		coreSampler = new PerformanceSampler(cpuMask);
+
+		for (eventIndex = 0; eventIndex < coreEventCount; eventIndex++)
+		{
+			coreCounters[eventIndex] = new PerformanceCounter(cpuMask, 0, p->getMaxSlots());
+			coreProgrammed++;
+
+			setupCounter(coreCounters[eventIndex], coreEvents[eventIndex]->eventSelect, coreEvents[eventIndex]->unitMask,
+					slotMasks[eventIndex]);
+
+			coreSampler->addEventCounter(coreCounters[eventIndex]);
+		}
+
+		nbSampler = new PerformanceSampler(NorthbridgeCounter::getNodeMask(p));
+
+		//L3 counters of the first turn, next turns change the core select only
+		for (coreId = 0; coreId < p->getProcessorCores() && coreId < coresPerPass; coreId++)
+		{
+			for (eventIndex = 0; eventIndex < l3EventCount; eventIndex++)
+			{
+				nbCounters[nbProgrammed] = NorthbridgeCounter::newNodeCounter(p);
+				nbProgrammed++;
+
+				setupCounter(nbCounters[nbProgrammed - 1], l3Events[eventIndex]->eventSelect,
+						getL3CoreSelect(p, l3Events[eventIndex]->unitMask, coreId));
+
+				nbSampler->addEventCounter(nbCounters[nbProgrammed - 1]);
+			}
+		}
+
+		if (passes > 1)
+			printf("L3 events of %u cores at a time, each core is counted 1/%u of the time\n", coresPerPass, passes);
+
+		Signal::activateUserSignalsHandler();
+
+		while (!Signal::getSignalStatus())
+		{
+			for (eventIndex = 0; eventIndex < coreEventCount; eventIndex++)
+				memset(totals[eventIndex], 0, cpuCount * sizeof(uint64_t));
+
+			for (firstCore = 0; firstCore < p->getProcessorCores(); firstCore += coresPerPass)
+			{
+				//Selects the cores of this turn, counters beyond the last core are not read
+				for (counter = 0; counter < nbProgrammed && passes > 1; counter++)
+				{
+					coreId = firstCore + counter / l3EventCount;
+
+					if (coreId >= p->getProcessorCores())
+						break;
+
+					nbCounters[counter]->disable();
+					nbCounters[counter]->setUnitMask(getL3CoreSelect(p, l3Events[counter % l3EventCount]->unitMask, coreId));
+
+					if (!nbCounters[counter]->program() || !nbCounters[counter]->enable())
+						throw "unable to program performance counter parameters";
+				}
+
+				//First snapshots initialize previous values
+				if (!coreSampler->takeSnapshot() || !nbSampler->takeSnapshot())
+					throw "unable to retrieve performance counter data";
+
+				Sleep(1000 / passes);
+
+				if (!coreSampler->takeSnapshot() || !nbSampler->takeSnapshot())
+					throw "unable to retrieve performance counter data";
+
+				for (cpuIndex = 0; cpuIndex < cpuCount; cpuIndex++)
+					for (eventIndex = 0; eventIndex < coreEventCount; eventIndex++)
+						totals[eventIndex][cpuIndex] += coreSampler->getEventDelta(eventIndex, cpuIndex);
+
+				//Northbridge counter indexes are node numbers
+				for (nodeId = 0; nodeId < p->getProcessorNodes(); nodeId++)
+				{
+					for (counter = 0; counter < nbProgrammed; counter++)
+					{
+						coreId = firstCore + counter / l3EventCount;
+
+						if (coreId >= p->getProcessorCores())
+							break;
+
+						cpuIndex = nodeId * p->getProcessorCores() + coreId;
+
+						l3Counts[counter % l3EventCount][cpuIndex] = nbSampler->getEventDelta(counter, nodeId);
+						l3Instructions[cpuIndex] = coreSampler->getEventDelta(0, cpuIndex);
+					}
+				}
+
+			}
+
+			cpuIndex = 0;
+
+			for (nodeId = 0; nodeId < p->getProcessorNodes(); nodeId++)
+			{
+				memset(nodeTotals, 0, sizeof(nodeTotals));
+				memset(nodeL3Counts, 0, sizeof(nodeL3Counts));
+				nodeL3Instructions = 0;
+
+				for (coreId = 0x0; coreId < p->getProcessorCores(); coreId++)
+				{
+					printf("Node %u c%u - MPKI", nodeId, coreId);
+
+					printMPKI("L1D", totals[1][cpuIndex], totals[0][cpuIndex]);
+					printMPKI("L2", totals[2][cpuIndex], totals[0][cpuIndex]);
+					printMPKI("L3", l3Counts[0][cpuIndex], l3Instructions[cpuIndex]);
+
+					if (coreEventCount == CACHE_CORE_EVENTS)
+					{
+						printf(" | miss");
+						printMissRatio("L1D", totals[1][cpuIndex], totals[3][cpuIndex]);
+						printMissRatio("L2", totals[2][cpuIndex], totals[4][cpuIndex]);
+					}
+
+					if (l3EventCount == 2)
+						printMissRatio("L3", l3Counts[0][cpuIndex], l3Counts[1][cpuIndex]);
+
+					printf("\n");
+
+					for (eventIndex = 0; eventIndex < coreEventCount; eventIndex++)
+						nodeTotals[eventIndex] += totals[eventIndex][cpuIndex];
+
+					nodeL3Counts[0] += l3Counts[0][cpuIndex];
+					nodeL3Counts[1] += l3Counts[1][cpuIndex];
+					nodeL3Instructions += l3Instructions[cpuIndex];
+
+					cpuIndex++;
+				}
+
+				printf("Node %u - MPKI", nodeId);
+
+				printMPKI("L1D", nodeTotals[1], nodeTotals[0]);
+				printMPKI("L2", nodeTotals[2], nodeTotals[0]);
+				printMPKI("L3", nodeL3Counts[0], nodeL3Instructions);
+
+				if (l3EventCount == 2)
+				{
+					printf(" | miss");
+					printMissRatio("L3", nodeL3Counts[0], nodeL3Counts[1]);
+				}
+
+				printf("\n");
+			}
+			if (fflush(stdout) == EOF) {
+				break;
+			}
+		}
+
+	} catch (char const *str) {
+
+		printf("K10PerformanceCounters.cpp::perfMonitorCacheMPKI - %s\n", str);
+
+	}
+
+	for (counter = 0; counter < nbProgrammed; counter++)
+	{
+		if (nbCounters[counter]->getEnabled()) nbCounters[counter]->disable();
+		delete nbCounters[counter];
+	}
+
+	for (counter = 0; counter < coreProgrammed; counter++)
+	{
+		if (coreCounters[counter]->getEnabled()) coreCounters[counter]->disable();
+		delete coreCounters[counter];
+	}
+
+	delete nbSampler;
+	delete coreSampler;
+
+	for (eventIndex = 0; eventIndex < CACHE_CORE_EVENTS; eventIndex++)
+		free(totals[eventIndex]);
+
+	free(l3Counts[0]);
+	free(l3Counts[1]);
+	free(l3Instructions);
+
+	return;
+
+}
+
+#define DTLB_TRACKED_PROCESSES 8 //Largest processes counted by the DTLB monitor
+#define DTLB_ADVISE_WPKI 1000 //Page walks per kilo instruction, in thousandths, above which huge pages are advised
+#define DTLB_ADVISE_RESIDENT (256 * 1024) //KB of resident memory above which huge pages are advised
+
+/*
+ * Reads the transparent huge pages mode (always, madvise or never) from sysfs. Returns false if
+ * the system has no transparent huge pages.
+ */
+static bool getTransparentHugePagesMode(char *mode, size_t length)
+{
+	char line[128];
+	char *start, *end;
+	FILE *file;
+
+	file = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+	if (file == NULL)
+		return false;
+
+	if (fgets(line, sizeof(line), file) == NULL)
+	{
+		fclose(file);
+		return false;
+	}
+
+	fclose(file);
+
+	//Selected mode is in brackets, eg: always [madvise] never
+	start = strchr(line, '[');
+	end = strchr(line, ']');
+
+	if (start == NULL || end == NULL || end <= start || (size_t) (end - start) > length)
+		return false;
+
+	strncpy(mode, start + 1, end - start - 1);
+	mode[end - start - 1] = '\0';
+
+	return true;
+}
+
+/*
+ * Monitors data TLB misses. Per core: L1 DTLB misses that hit the L2 DTLB (event 0x45) and L2 DTLB
+ * misses (event 0x46), that is page walks, per kilo instruction. Per process: page walks of the
+ * largest processes, counted on all their threads with per-task perf events (see TaskCounters).
+ * Processes with a high page walk rate and much resident memory are flagged as candidates for
+ * huge pages, with a hint depending on the transparent huge pages mode.
+ */
+void Processor::K10PerformanceCounters::perfMonitorDTLB(class Processor *p)
+{
+	PerformanceSampler *sampler;
+	TaskCounters *taskCounters;
+	PerformanceCounter *perfCounters[3];
+	const struct PerformanceEvent *events[3];
+
+	const char *eventNames[3] = { "instructions", "dtlb-l2-hits", "dtlb-l2-misses" };
+	DWORD slotMasks[3];
+	DWORD pids[DTLB_TRACKED_PROCESSES];
+	char name[32], thpMode[16];
+	bool thpAvailable;
+
+	DWORD nodeId, coreId, cpuIndex, family;
+	PROCESSORMASK cpuMask;
+	unsigned int eventIndex, programmed, process, processCount;
+	uint64_t instructions, walks, wpki, resident;
+
+	sampler = NULL;
+	taskCounters = NULL;
+	programmed = 0;
+
+	if (!requirePerfBackend("perfMonitorDTLB", "-perf-dtlb"))
+		return;
+
+	try {
+
+		family = PerformanceEvents::getFamilyFlag(p->getSpecFamilyExtended());
+
+		p->setNode(p->ALL_NODES);
+		p->setCore(p->ALL_CORES);
+
+		cpuMask = p->getMask();
+
+		for (eventIndex = 0; eventIndex < 3; eventIndex++)
+		{
+			events[eventIndex] = PerformanceEvents::find(eventNames[eventIndex], family);
+
+			if (events[eventIndex] == NULL)
+				throw "DTLB events are not available on this processor";
+		}
+
+		//DTLB events are constrained to PERF_CTL[2:0] on Family 15h
+		if (!PerformanceEvents::planSlots(events, 3, family, p->getMaxSlots(), slotMasks))
+			throw "DTLB events do not fit the performance counter slots";
+
+		sampler = new PerformanceSampler(cpuMask);
+
+		for (eventIndex = 0; eventIndex < 3; eventIndex++)
+		{
+			perfCounters[eventIndex] = new PerformanceCounter(cpuMask, 0, p->getMaxSlots());
+			programmed++;
+
+			setupCounter(perfCounters[eventIndex], events[eventIndex]->eventSelect, events[eventIndex]->unitMask,
+					slotMasks[eventIndex]);
+
+			sampler->addEventCounter(perfCounters[eventIndex]);
+		}
+
+		//Per-process counters of instructions and page walks, the same events of the core counters
+		if (TaskCounters::isSupported())
+		{
+			taskCounters = new TaskCounters();
+			taskCounters->addEvent(perfCounters[0]);
+			taskCounters->addEvent(perfCounters[2]);
+
+			processCount = TaskCounters::getLargestProcesses(pids, DTLB_TRACKED_PROCESSES);
+
+			for (process = 0; process < processCount; process++)
+				taskCounters->attach(pids[process]);
+
+			if (taskCounters->getProcessCount() == 0)
+				printf("Unable to count per-process events, check perf_event_paranoid\n");
+
+			if (!taskCounters->takeSnapshot())
+				throw "unable to retrieve per-process counters";
+		}
+
+		thpAvailable = getTransparentHugePagesMode(thpMode, sizeof(thpMode));
+
+		//First snapshot initializes previous values
+		if (!sampler->takeSnapshot())
+			throw "unable to retrieve performance counter data";
+
+		Signal::activateUserSignalsHandler();
+
+		while (!Signal::getSignalStatus())
+		{
+			Sleep(1000);
+
+			if (!sampler->takeSnapshot())
+				throw "unable to retrieve performance counter data";
+
+			cpuIndex = 0;
+
+			for (nodeId = 0; nodeId < p->getProcessorNodes(); nodeId++)
+			{
+				printf("Node %u PKI -", nodeId);
+
+				for (coreId = 0x0; coreId < p->getProcessorCores(); coreId++)
+				{
+					instructions = sampler->getEventDelta(0, cpuIndex);
+
+					printf(" c%u", coreId);
+					printMPKI("l1miss", sampler->getEventDelta(1, cpuIndex) + sampler->getEventDelta(2, cpuIndex), instructions);
+					printMPKI("walk", sampler->getEventDelta(2, cpuIndex), instructions);
+
+					cpuIndex++;
+				}
+				printf("\n");
+			}
+
+			if (taskCounters != NULL && taskCounters->getProcessCount() > 0)
+			{
+				if (!taskCounters->takeSnapshot())
+					throw "unable to retrieve per-process counters";
+
+				for (process = 0; process < taskCounters->getProcessCount(); process++)
+				{
+					instructions = taskCounters->getEventDelta(0, process);
+					walks = taskCounters->getEventDelta(1, process);
+					resident = TaskCounters::getResidentMemory(taskCounters->getPid(process));
+
+					wpki = (instructions != 0) ? (walks * 1000 * IPC_RATIO_SCALE) / instructions : 0;
+
+					if (!SampleProfiler::getProcessName(taskCounters->getPid(process), name, sizeof(name)))
+						strcpy(name, "?");
+
+					printf("\t%s(%u) rss:%lluMB walks:%llu/s", name, taskCounters->getPid(process),
+							(unsigned long long) (resident / 1024), (unsigned long long) walks);
+					printMPKI("wpki", walks, instructions);
+
+					if (wpki >= DTLB_ADVISE_WPKI && resident >= DTLB_ADVISE_RESIDENT)
+					{
+						if (!thpAvailable || strcmp(thpMode, "never") == 0)
+							printf(" <- huge pages advised: enable transparent huge pages or use hugetlbfs");
+						else if (strcmp(thpMode, "madvise") == 0)
+							printf(" <- huge pages advised: madvise(MADV_HUGEPAGE) the heap or set THP to always");
+						else
+							printf(" <- huge pages advised: THP is on, check AnonHugePages or use hugetlbfs");
+					}
+
+					printf("\n");
+				}
+			}
+
+			if (fflush(stdout) == EOF) {
+				break;
+			}
+		}
+
+	} catch (char const *str) {
+
+		printf("K10PerformanceCounters.cpp::perfMonitorDTLB - %s\n", str);
+
+	}
+
+	delete taskCounters;
+
+	for (eventIndex = 0; eventIndex < programmed; eventIndex++)
+	{
+		if (perfCounters[eventIndex]->getEnabled()) perfCounters[eventIndex]->disable();
+		delete perfCounters[eventIndex];
+	}
+
+	delete sampler;
+
+	return;
+
+}
+
+#define COHERENCE_CORE_EVENTS 4 //Core events of the coherence monitor, the last one only if slots allow
+#define COHERENCE_HOT_SHOWN 8 //Contended cache lines printed
+
+/*
+ * Monitors coherence traffic. Per core: locked ops and refills of lines held Modified or Owned by
+ * another cache (dirty cache to cache transfers) per kilo instruction, and the average cycles spent
+ * by a locked op in its non-speculative phase. Per node: probes that hit dirty lines in the node
+ * caches, and their share of all the probe responses where slots allow.
+ *
+ * Where Instruction-Based Sampling is available, the cache lines of the sampled ops that hit in
+ * another core cache or that are missing locked ops are collected on all the cores (see IBSSampler)
+ * and the most contended ones since the start are printed. A line accessed by more cores on
+ * different words is likely false sharing.
+ */
+void Processor::K10PerformanceCounters::perfMonitorCoherence(class Processor *p)
+{
+	PerformanceSampler *coreSampler, *nbSampler;
+	PerformanceCounter *coreCounters[COHERENCE_CORE_EVENTS];
+	PerformanceCounter *nbCounters[2];
+	const struct PerformanceEvent *coreEvents[COHERENCE_CORE_EVENTS];
+	const struct PerformanceEvent *nbEvents[2];
+	DWORD slotMasks[COHERENCE_CORE_EVENTS];
+	IBSSampler *ibsSampler;
+	struct IBSCpuStats cpuStats;
+	struct IBSHotLine *hotLines, hottest;
+	DWORD *hotCpus;
+
+	const char *coreNames[COHERENCE_CORE_EVENTS] = { "instructions", "locked-ops", "refills-dirty", "locked-cycles" };
+	const char *nbNames[2] = { "probe-hit-dirty", "probe-responses" };
+
+	DWORD nodeId, coreId, cpuIndex, family, cpuCount;
+	PROCESSORMASK cpuMask;
+	unsigned int eventIndex, coreEventCount, nbEventCount, coreProgrammed, nbProgrammed;
+	unsigned int line, hotCount, shown, best, words;
+	DWORD cores;
+	uint64_t instructions, lockedOps, contended;
+
+	coreSampler = NULL;
+	nbSampler = NULL;
+	ibsSampler = NULL;
+	coreProgrammed = 0;
+	nbProgrammed = 0;
+
+	cpuCount = p->getProcessorNodes() * p->getProcessorCores();
+
+	hotLines = (struct IBSHotLine *) calloc(cpuCount * IBS_HOT_LINES, sizeof(struct IBSHotLine));
+	hotCpus = (DWORD *) calloc(cpuCount * IBS_HOT_LINES, sizeof(DWORD));
+
+	try {
+
+		family = PerformanceEvents::getFamilyFlag(p->getSpecFamilyExtended());
+
+		p->setNode(p->ALL_NODES);
+		p->setCore(p->ALL_CORES);
+
+		cpuMask = p->getMask();
+
+		//Splits the slots between core and northbridge events
+		if (NorthbridgeCounter::isSupported())
+		{
+			coreEventCount = (p->getMaxSlots() < COHERENCE_CORE_EVENTS) ? p->getMaxSlots() : COHERENCE_CORE_EVENTS;
+			nbEventCount = 2;
+		}
+		else
+		{
+			coreEventCount = 3;
+			nbEventCount = 1;
+		}
+
+		for (eventIndex = 0; eventIndex < coreEventCount; eventIndex++)
+		{
+			coreEvents[eventIndex] = PerformanceEvents::find(coreNames[eventIndex], family);
+
+			if (coreEvents[eventIndex] == NULL)
+				throw "coherence events are not available on this processor";
+		}
+
+		//Dirty refills (0x6C) can be counted only on PERF_CTL[2:0] on Family 15h
+		if (!PerformanceEvents::planSlots(coreEvents, coreEventCount, family, p->getMaxSlots(), slotMasks))
+			throw "coherence events do not fit the performance counter slots";
+
+		coreSampler = new PerformanceSampler(cpuMask);
+
+		for (eventIndex = 0; eventIndex < coreEventCount; eventIndex++)
+		{
+			coreCounters[eventIndex] = new PerformanceCounter(cpuMask, 0, p->getMaxSlots());
+			coreProgrammed++;
+
+			setupCounter(coreCounters[eventIndex], coreEvents[eventIndex]->eventSelect, coreEvents[eventIndex]->unitMask,
+					slotMasks[eventIndex]);
+
+			coreSampler->addEventCounter(coreCounters[eventIndex]);
+		}
+
+		nbSampler = new PerformanceSampler(NorthbridgeCounter::getNodeMask(p));
+
+		for (eventIndex = 0; eventIndex < nbEventCount; eventIndex++)
+		{
+			nbEvents[eventIndex] = PerformanceEvents::find(nbNames[eventIndex], family);
+
+			if (nbEvents[eventIndex] == NULL)
+				throw "probe events are not available on this processor";
+
+			nbCounters[eventIndex] = NorthbridgeCounter::newNodeCounter(p);
+			nbProgrammed++;
+
+			setupCounter(nbCounters[eventIndex], nbEvents[eventIndex]->eventSelect, nbEvents[eventIndex]->unitMask);
+
+			nbSampler->addEventCounter(nbCounters[eventIndex]);
+		}
+
+		if (IBSSampler::isSupported())
+		{
+			ibsSampler = new IBSSampler(cpuMask);
+
+			if (!ibsSampler->start(IBS_DEFAULT_PERIOD))
+				throw "unable to arm Instruction-Based Sampling";
+		}
+		else
+		{
+			printf("Instruction-Based Sampling is not available, contended lines won't be shown\n");
+		}
+
+		//First snapshots initialize previous values
+		if (!coreSampler->takeSnapshot() || !nbSampler->takeSnapshot())
+			throw "unable to retrieve performance counter data";
+
+		Signal::activateUserSignalsHandler();
+
+		while (!Signal::getSignalStatus())
+		{
+			Sleep(1000);
+
+			if (!coreSampler->takeSnapshot() || !nbSampler->takeSnapshot())
+				throw "unable to retrieve performance counter data";
+
+			cpuIndex = 0;
+
+			for (nodeId = 0; nodeId < p->getProcessorNodes(); nodeId++)
+			{
+				printf("Node %u PKI -", nodeId);
+
+				for (coreId = 0x0; coreId < p->getProcessorCores(); coreId++)
+				{
+					instructions = coreSampler->getEventDelta(0, cpuIndex);
+					lockedOps = coreSampler->getEventDelta(1, cpuIndex);
+
+					printf(" c%u", coreId);
+					printMPKI("lock", lockedOps, instructions);
+					printMPKI("dirty", coreSampler->getEventDelta(2, cpuIndex), instructions);
+
+					if (coreEventCount > 3 && lockedOps != 0)
+						printf(" lockcyc:%llu", (unsigned long long) (coreSampler->getEventDelta(3, cpuIndex) / lockedOps));
+
+					cpuIndex++;
+				}
+
+				printf("\n");
+
+				printf("Node %u probes - hitdirty:%llu/s", nodeId, (unsigned long long) nbSampler->getEventDelta(0, nodeId));
+
+				if (nbEventCount > 1)
+					printMissRatio("dirty", nbSampler->getEventDelta(0, nodeId), nbSampler->getEventDelta(1, nodeId));
+
+				printf("\n");
+			}
+
+			if (ibsSampler != NULL)
+			{
+				//Merges the hot lines of all the cores, counting the cores that accessed each line
+				hotCount = 0;
+				contended = 0;
+
+				for (cpuIndex = 0; cpuIndex < ibsSampler->getCount(); cpuIndex++)
+				{
+					if (!ibsSampler->getStats(cpuIndex, &cpuStats))
+						throw "Instruction-Based Sampling has been disabled";
+
+					contended += cpuStats.contended;
+
+					for (line = 0; line < IBS_HOT_LINES; line++)
+					{
+						if (cpuStats.hotLines[line].count == 0)
+							continue;
+
+						for (best = 0; best < hotCount; best++)
+							if (hotLines[best].line == cpuStats.hotLines[line].line &&
+									hotLines[best].physical == cpuStats.hotLines[line].physical)
+								break;
+
+						if (best == hotCount)
+						{
+							hotLines[hotCount] = cpuStats.hotLines[line];
+							hotCpus[hotCount] = 1;
+							hotCount++;
+						}
+						else
+						{
+							hotLines[best].count += cpuStats.hotLines[line].count;
+							hotLines[best].words |= cpuStats.hotLines[line].words;
+							hotCpus[best]++;
+						}
+					}
+				}
+
+				printf("Contended samples:%llu\n", (unsigned long long) contended);
+
+				//Selection of the most contended lines
+				for (shown = 0; shown < COHERENCE_HOT_SHOWN && shown < hotCount; shown++)
+				{
+					best = shown;
+
+					for (line = shown + 1; line < hotCount; line++)
+						if (hotLines[line].count > hotLines[best].count)
+							best = line;
+
+					hottest = hotLines[best];
+					hotLines[best] = hotLines[shown];
+					hotLines[shown] = hottest;
+
+					cores = hotCpus[best];
+					hotCpus[best] = hotCpus[shown];
+					hotCpus[shown] = cores;
+
+					words = 0;
+					for (line = 0; line < 8; line++)
+						if (hottest.words & (1 << line))
+							words++;
+
+					printf("\t%s:0x%llx rip:0x%llx samples:%llu cores:%u words:%u%s\n",
+							hottest.physical ? "phys" : "lin",
+							(unsigned long long) hottest.line,
+							(unsigned long long) hottest.rip,
+							(unsigned long long) hottest.count,
+							cores, words,
+							(cores > 1 && words > 1) ? " <- false sharing?" : "");
+				}
+			}
+
+			printf("\n");
+
+			if (fflush(stdout) == EOF) {
+				break;
+			}
+		}
+
+	} catch (char const *str) {
+
+		printf("K10PerformanceCounters.cpp::perfMonitorCoherence - %s\n", str);
+
+	}
+
+	//Destructor disarms IBS
+	delete ibsSampler;
+
+	for (eventIndex = 0; eventIndex < coreProgrammed; eventIndex++)
+	{
+		if (coreCounters[eventIndex]->getEnabled()) coreCounters[eventIndex]->disable();
+		delete coreCounters[eventIndex];
+	}
+
+	for (eventIndex = 0; eventIndex < nbProgrammed; eventIndex++)
+	{
+		if (nbCounters[eventIndex]->getEnabled()) nbCounters[eventIndex]->disable();
+		delete nbCounters[eventIndex];
+	}
+
+	delete coreSampler;
+	delete nbSampler;
+
+	free(hotLines);
+	free(hotCpus);
+
+	return;
+
+}
+
+#define DRAM_PAGES_MIN_ACCESSES 100000 //Accesses per second below which no advice is given
+#define DRAM_PAGES_IMBALANCE 750 //Share of the node accesses, in thousandths, above which a DCT is overloaded
+
+/*
+ * Prints the advice for a DCT from its page hit, miss and conflict counts. With an open page
+ * policy a hit costs Tcl, a miss (bank closed) Trcd+Tcl and a conflict (another row open in the
+ * bank) Trp+Trcd+Tcl: more conflicts than hits mean rows are rarely reused before another row of
+ * the same bank is needed
+ */
+static void printDramPageAdvice(const struct dramPageSettings *settings, uint64_t hits, uint64_t misses, uint64_t conflicts)
+{
+	if (conflicts > hits)
+	{
+		if (!settings->bankSwizzle)
+			printf("\t-> more page conflicts than hits: bank swizzle is off, enabling it spreads rows over banks\n");
+		else
+			printf("\t-> more page conflicts than hits: a closed page policy would turn conflicts into misses\n");
+	}
+
+	if (misses > hits && misses > conflicts)
+		printf("\t-> page misses dominate: pages are closed before reuse, access pattern has little row locality\n");
+}
+
+/*
+ * Monitors DRAM page locality per node and DCT, counting DRAM accesses (event 0xE0) that hit the
+ * open page, that found the bank closed (page miss) and that found another page open (page conflict).
+ * The three events of a DCT are counted together, DCTs are counted one at a time for half a second.
+ * Settings holds the static configuration of each DCT, node by node, as decoded by the family
+ * (see dramPageSettings): it is printed with the ratios and drives the advice on bank swizzle,
+ * page policy and channel interleaving.
+ */
+void Processor::K10PerformanceCounters::perfMonitorDramPages(class Processor *p, const struct dramPageSettings *settings)
+{
+	PerformanceSampler *sampler;
+	PerformanceCounter *perfCounters[3];
+	const struct PerformanceEvent *event;
+
+	DWORD nodeId, dct, family, nodes;
+	unsigned int eventIndex, programmed;
+	const struct dramPageSettings *dctSettings;
+	uint64_t *counts; //Hits, misses and conflicts of each node and DCT in the last second
+	uint64_t hits, misses, conflicts, accesses, nodeAccesses, latency;
+
+	sampler = NULL;
+	programmed = 0;
+
+	nodes = p->getProcessorNodes();
+	counts = (uint64_t *) calloc(nodes * 2 * 3, sizeof(uint64_t));
+
+	try {
+
+		family = PerformanceEvents::getFamilyFlag(p->getSpecFamilyExtended());
+
+		event = PerformanceEvents::find("dram-accesses", family);
+
+		if (event == NULL)
+			throw "DRAM events are not available on this processor";
+
+		Signal::activateUserSignalsHandler();
+
+		while (!Signal::getSignalStatus())
+		{
+			for (dct = 0; dct < 2; dct++)
+			{
+				sampler = new PerformanceSampler(NorthbridgeCounter::getNodeMask(p));
+
+				//Unit mask bits 2:0 are page hit, miss and conflict of DCT0, bits 5:3 the same for DCT1
+				for (eventIndex = 0; eventIndex < 3; eventIndex++)
+				{
+					perfCounters[eventIndex] = NorthbridgeCounter::newNodeCounter(p);
+					programmed++;
+
+					setupCounter(perfCounters[eventIndex], event->eventSelect, 1 << (dct * 3 + eventIndex));
+
+					sampler->addEventCounter(perfCounters[eventIndex]);
+				}
+
+				//First snapshot initializes previous values
+				if (!sampler->takeSnapshot())
+					throw "unable to retrieve performance counter data";
+
+				Sleep(500);
+
+				if (!sampler->takeSnapshot())
+					throw "unable to retrieve performance counter data";
+
+				//Each DCT is counted half of the time
+				for (nodeId = 0; nodeId < nodes; nodeId++)
+					for (eventIndex = 0; eventIndex < 3; eventIndex++)
+						counts[(nodeId * 2 + dct) * 3 + eventIndex] = sampler->getEventDelta(eventIndex, nodeId) * 2;
+
+				for (eventIndex = 0; eventIndex < programmed; eventIndex++)
+				{
+					perfCounters[eventIndex]->disable();
+					delete perfCounters[eventIndex];
+				}
+
+				programmed = 0;
+
+				delete sampler;
+				sampler = NULL;
+			}
+
+			for (nodeId = 0; nodeId < nodes; nodeId++)
+			{
+				nodeAccesses = 0;
+				for (eventIndex = 0; eventIndex < 6; eventIndex++)
+					nodeAccesses += counts[nodeId * 6 + eventIndex];
+
+				for (dct = 0; dct < 2; dct++)
+				{
+					dctSettings = &settings[nodeId * 2 + dct];
+
+					if (!dctSettings->valid)
+						continue;
+
+					hits = counts[(nodeId * 2 + dct) * 3];
+					misses = counts[(nodeId * 2 + dct) * 3 + 1];
+					conflicts = counts[(nodeId * 2 + dct) * 3 + 2];
+					accesses = hits + misses + conflicts;
+
+					printf("Node %u DCT%u - accesses:%llu/s", nodeId, dct, (unsigned long long) accesses);
+					printMissRatio("hit", hits, accesses);
+					printMissRatio("miss", misses, accesses);
+					printMissRatio("conflict", conflicts, accesses);
+
+					//Average row access cost in memory clocks, in tenths
+					if (accesses != 0)
+					{
+						latency = (hits * dctSettings->Tcl + misses * (dctSettings->Trcd + dctSettings->Tcl) +
+								conflicts * (dctSettings->Trp + dctSettings->Trcd + dctSettings->Tcl)) * 10 / accesses;
+						printf(" avg:%llu.%lluclk", (unsigned long long) (latency / 10), (unsigned long long) (latency % 10));
+					}
+
+					printf(" (%u-%u-%u-%u %uMT/s swizzle:%s)\n", dctSettings->Tcl, dctSettings->Trcd, dctSettings->Trp,
+							dctSettings->Tras, dctSettings->dataRate, dctSettings->bankSwizzle ? "on" : "off");
+
+					if (accesses < DRAM_PAGES_MIN_ACCESSES)
+						continue;
+
+					printDramPageAdvice(dctSettings, hits, misses, conflicts);
+
+					//Ganged DCTs work as a single 128 bit channel and are always balanced
+					if (settings[nodeId * 2 + (dct ^ 1)].valid && !dctSettings->ganged &&
+							accesses * IPC_RATIO_SCALE > nodeAccesses * DRAM_PAGES_IMBALANCE)
+					{
+						if (!dctSettings->channelInterleave)
+							printf("\t-> DCT%u serves most of the node traffic: channel interleaving is off, enabling it balances the DCTs\n", dct);
+						else
+							printf("\t-> DCT%u serves most of the node traffic: check DIMM population of the other DCT\n", dct);
+					}
+				}
+			}
+
+			printf("\n");
+
+			if (fflush(stdout) == EOF) {
+				break;
+			}
+		}
+
+	} catch (char const *str) {
+
+		printf("K10PerformanceCounters.cpp::perfMonitorDramPages - %s\n", str);
+
+	}
+
+	for (eventIndex = 0; eventIndex < programmed; eventIndex++)
+	{
+		if (perfCounters[eventIndex]->getEnabled()) perfCounters[eventIndex]->disable();
+		delete perfCounters[eventIndex];
+	}
+
+	delete sampler;
+	free(counts);
+
+	return;
+
+}
+
+#define FPU_MODULE_HEAVY_OPC 300 //FPU ops per cycle, in thousandths, above which a thread is FP-heavy
+#define FPU_MODULE_PIPES 4 //FPU pipes shared by the cores of a compute unit
+
+/*
+ * Monitors the FPU shared by the cores of a compute unit (Family 15h). Per compute unit: FPU pipe
+ * utilization, as ops assigned to the pipes (event 0x00) over the pipe slots of the busiest core,
+ * and dispatch stalls for FP scheduler full (event 0xD7) over the cycles of both cores. A thread
+ * is FP-heavy when it assigns more than FPU_MODULE_HEAVY_OPC ops per cycle: compute units with two
+ * FP-heavy threads are flagged, and the cores of compute units with no FP-heavy thread are
+ * suggested as a destination for one of them.
+ */
+void Processor::K10PerformanceCounters::perfMonitorFPUModules(class Processor *p, DWORD coresPerUnit)
+{
+	PerformanceSampler *sampler;
+	PerformanceCounter *perfCounters[3];
+	const struct PerformanceEvent *events[3];
+	DWORD slotMasks[3];
+
+	const char *eventNames[3] = { "cycles", "fpu-ops", "stall-fpu-full" };
+
+	DWORD nodeId, unitId, coreId, cpuIndex, family, units, cpuCount;
+	PROCESSORMASK cpuMask;
+	unsigned int eventIndex, programmed, heavyCount, contendedUnits, spare;
+	uint64_t cycles, maxCycles, ops, stalls, opc, utilization;
+	bool *heavy; //Per-cpu FP-heavy flag in the last second
+	bool *contended; //Per compute unit flag, two or more FP-heavy threads
+
+	sampler = NULL;
+	programmed = 0;
+
+	if (coresPerUnit == 0)
+		coresPerUnit = 1;
+
+	units = p->getProcessorCores() / coresPerUnit;
+	cpuCount = p->getProcessorNodes() * p->getProcessorCores();
+
+	heavy = (bool *) calloc(cpuCount, sizeof(bool));
+	contended = (bool *) calloc(p->getProcessorNodes() * units, sizeof(bool));
+
+	try {
+
+		family = PerformanceEvents::getFamilyFlag(p->getSpecFamilyExtended());
+
+		p->setNode(p->ALL_NODES);
+		p->setCore(p->ALL_CORES);
+
+		cpuMask = p->getMask();
+
+		for (eventIndex = 0; eventIndex < 3; eventIndex++)
+		{
+			events[eventIndex] = PerformanceEvents::find(eventNames[eventIndex], family);
+
+			if (events[eventIndex] == NULL)
+				throw "FPU events are not available on this processor";
+		}
+
+		//FP ops and dispatch stalls are constrained to different slots on Family 15h
+		if (!PerformanceEvents::planSlots(events, 3, family, p->getMaxSlots(), slotMasks))
+			throw "FPU events do not fit the performance counter slots";
+
+		sampler = new PerformanceSampler(cpuMask);
+
+		for (eventIndex = 0; eventIndex < 3; eventIndex++)
+		{
+			perfCounters[eventIndex] = new PerformanceCounter(cpuMask, 0, p->getMaxSlots());
+			programmed++;
+
+			setupCounter(perfCounters[eventIndex], events[eventIndex]->eventSelect, events[eventIndex]->unitMask,
+					slotMasks[eventIndex]);
+
+			sampler->addEventCounter(perfCounters[eventIndex]);
+		}
+
+		printf("%u cores per compute unit, FP-heavy above %u.%03u ops per cycle\n", coresPerUnit,
+				FPU_MODULE_HEAVY_OPC / IPC_RATIO_SCALE, FPU_MODULE_HEAVY_OPC % IPC_RATIO_SCALE);
+
+		//First snapshot initializes previous values
+		if (!sampler->takeSnapshot())
+			throw "unable to retrieve performance counter data";
+
+		Signal::activateUserSignalsHandler();
+
+		while (!Signal::getSignalStatus())
+		{
+			Sleep(1000);
+
+			if (!sampler->takeSnapshot())
+				throw "unable to retrieve performance counter data";
+
+			contendedUnits = 0;
+
+			for (nodeId = 0; nodeId < p->getProcessorNodes(); nodeId++)
+			{
+				for (unitId = 0; unitId < units; unitId++)
+				{
+					cpuIndex = nodeId * p->getProcessorCores() + unitId * coresPerUnit;
+
+					cycles = 0;
+					maxCycles = 0;
+					ops = 0;
+					stalls = 0;
+					heavyCount = 0;
+
+					for (coreId = 0; coreId < coresPerUnit; coreId++)
+					{
+						if (sampler->getEventDelta(0, cpuIndex + coreId) > maxCycles)
+							maxCycles = sampler->getEventDelta(0, cpuIndex + coreId);
+
+						cycles += sampler->getEventDelta(0, cpuIndex + coreId);
+						ops += sampler->getEventDelta(1, cpuIndex + coreId);
+						stalls += sampler->getEventDelta(2, cpuIndex + coreId);
+					}
+
+					utilization = (maxCycles != 0) ? (ops * IPC_RATIO_SCALE) / (maxCycles * FPU_MODULE_PIPES) : 0;
+
+					printf("Node %u CU%u - pipes:%llu.%llu%%", nodeId, unitId,
+							(unsigned long long) (utilization / 10), (unsigned long long) (utilization % 10));
+					printMissRatio("stall", stalls, cycles);
+
+					for (coreId = 0; coreId < coresPerUnit; coreId++)
+					{
+						cycles = sampler->getEventDelta(0, cpuIndex + coreId);
+						opc = (cycles != 0) ? (sampler->getEventDelta(1, cpuIndex + coreId) * IPC_RATIO_SCALE) / cycles : 0;
+
+						heavy[cpuIndex + coreId] = opc > FPU_MODULE_HEAVY_OPC;
+						if (heavy[cpuIndex + coreId])
+							heavyCount++;
+
+						printf(" c%u:%llu.%03lluopc", unitId * coresPerUnit + coreId,
+								(unsigned long long) (opc / IPC_RATIO_SCALE), (unsigned long long) (opc % IPC_RATIO_SCALE));
+					}
+
+					contended[nodeId * units + unitId] = heavyCount > 1;
+
+					if (heavyCount > 1)
+					{
+						printf(" <- FPU shared by %u FP-heavy threads", heavyCount);
+						contendedUnits++;
+					}
+
+					printf("\n");
+				}
+			}
+
+			//Suggests the first core of each idle FPU as destination of the second thread of a contended one
+			if (contendedUnits > 0)
+			{
+				spare = 0;
+
+				for (nodeId = 0; nodeId < p->getProcessorNodes(); nodeId++)
+				{
+					for (unitId = 0; unitId < units; unitId++)
+					{
+						if (!contended[nodeId * units + unitId])
+							continue;
+
+						cpuIndex = nodeId * p->getProcessorCores() + unitId * coresPerUnit;
+
+						//Finds the next compute unit without FP-heavy threads
+						for (; spare < p->getProcessorNodes() * units; spare++)
+						{
+							for (coreId = 0; coreId < coresPerUnit; coreId++)
+								if (heavy[(spare / units) * p->getProcessorCores() + (spare % units) * coresPerUnit + coreId])
+									break;
+
+							if (coreId == coresPerUnit)
+								break;
+						}
+
+						if (spare == p->getProcessorNodes() * units)
+						{
+							printf("\t-> no compute unit with an idle FPU left, FP-heavy threads exceed compute units\n");
+							break;
+						}
+
+						printf("\t-> move the FP-heavy thread of cpu %u to cpu %u (node %u CU%u)\n", cpuIndex + 1,
+								(spare / units) * p->getProcessorCores() + (spare % units) * coresPerUnit,
+								spare / units, spare % units);
+
+						spare++;
+					}
+				}
+			}
+
+			printf("\n");
+
+			if (fflush(stdout) == EOF) {
+				break;
+			}
+		}
+
+	} catch (char const *str) {
+
+		printf("K10PerformanceCounters.cpp::perfMonitorFPUModules - %s\n", str);
+
+	}
+
+	for (eventIndex = 0; eventIndex < programmed; eventIndex++)
+	{
+		if (perfCounters[eventIndex]->getEnabled()) perfCounters[eventIndex]->disable();
+		delete perfCounters[eventIndex];
+	}
+
+	delete sampler;
+
+	free(heavy);
+	free(contended);
+
+	return;
+
+}
+
+/*
+ * Monitors DRAM bandwidth per node. Memory controller requests (event 0x1F0) give read and write
+ * bandwidth, DRAM accesses (event 0xE0) give the bandwidth of each DRAM controller. Each request
+ * or access moves a 64 bytes cache line. Events are sampled once per node, see
+ * NorthbridgeCounter::newNodeCounter
+ */
+void Processor::K10PerformanceCounters::perfMonitorMemoryBandwidth(class Processor *p)
+{
+	PerformanceSampler *sampler;
+	PerformanceCounter *perfCounters[4];
+	const struct PerformanceEvent *event;
+
+	const char *eventNames[4] = { "mc-reads", "mc-writes", "dram-dct0", "dram-dct1" };
+	DWORD nodeId, family;
+	unsigned int eventIndex, programmed;
+	uint64_t elapsed, bandwidth[4];
+
+	sampler = NULL;
+	programmed = 0;
+
+	try {
+
+		family = PerformanceEvents::getFamilyFlag(p->getSpecFamilyExtended());
+
+		sampler = new PerformanceSampler(NorthbridgeCounter::getNodeMask(p));
+
+		for (eventIndex = 0; eventIndex < 4; eventIndex++)
+		{
+			event = PerformanceEvents::find(eventNames[eventIndex], family);
+
+			if (event == NULL)
+				throw "memory controller events are not available on this processor";
+
+			perfCounters[eventIndex] = NorthbridgeCounter::newNodeCounter(p);
+			programmed++;
+
+			setupCounter(perfCounters[eventIndex], event->eventSelect, event->unitMask);
+
+			sampler->addEventCounter(perfCounters[eventIndex]);
+		}
+
+		//First snapshot initializes previous values
+		if (!sampler->takeSnapshot())
+			throw "unable to retrieve performance counter data";
+
+		Signal::activateUserSignalsHandler();
+
+		while (!Signal::getSignalStatus())
+		{
+			Sleep(1000);
+
+			if (!sampler->takeSnapshot())
+				throw "unable to retrieve performance counter data";
+
+			elapsed = sampler->getElapsed();
+
+			if (elapsed == 0)
+				continue;
+
+			for (nodeId = 0; nodeId < p->getProcessorNodes(); nodeId++)
+			{
+				//64 bytes per event, MB/s = bytes * 1000 / nanoseconds
+				for (eventIndex = 0; eventIndex < 4; eventIndex++)
+					bandwidth[eventIndex] = (sampler->getEventDelta(eventIndex, nodeId) * 64 * 1000) / elapsed;
+
+				printf("Node %u - read:%lluMB/s write:%lluMB/s total:%lluMB/s dct0:%lluMB/s dct1:%lluMB/s\n", nodeId,
+						(unsigned long long) bandwidth[0],
+						(unsigned long long) bandwidth[1],
+						(unsigned long long) (bandwidth[0] + bandwidth[1]),
+						(unsigned long long) bandwidth[2],
+						(unsigned long long) bandwidth[3]);
+			}
+			if (fflush(stdout) == EOF) {
+				break;
+			}
+		}
+
+	} catch (char const *str) {
+
+		printf("K10PerformanceCounters.cpp::perfMonitorMemoryBandwidth - %s\n", str);
+
+	}
+
+	for (eventIndex = 0; eventIndex < programmed; eventIndex++)
+	{
+		if (perfCounters[eventIndex]->getEnabled()) perfCounters[eventIndex]->disable();
+		delete perfCounters[eventIndex];
+	}
+
+	delete sampler;
+
+	return;
+
+}
+
+/*
+ * Monitors HyperTransport link utilization per node. Each node counts the DWORDs transmitted on
+ * each of its links (events 0xF6-0xF9, NOPs excluded), which are compared with the link capacity
+ * (see Processor::getHTLinkCapacity()). Links not connected have zero capacity and are skipped.
+ * The receive direction of a link is the transmit direction of the node at the other end.
+ */
+void Processor::K10PerformanceCounters::perfMonitorHTLink(class Processor *p)
+{
+	PerformanceSampler *sampler;
+	DWORD *linkCapacity;
+	PerformanceCounter *perfCounters[HT_LINKS_PER_NODE];
+	const struct PerformanceEvent *event;
+
+	const char *eventNames[HT_LINKS_PER_NODE] = { "ht-link0", "ht-link1", "ht-link2", "ht-link3" };
+	DWORD nodeId, family, capacity;
+	unsigned int link, programmed;
+	uint64_t elapsed, bandwidth;
+
+	sampler = NULL;
+	programmed = 0;
+
+	linkCapacity = (DWORD *) calloc(p->getProcessorNodes() * HT_LINKS_PER_NODE, sizeof(DWORD));
+
+	p->getHTLinkCapacity(linkCapacity);
+
+	try {
+
+		family = PerformanceEvents::getFamilyFlag(p->getSpecFamilyExtended());
+
+		sampler = new PerformanceSampler(NorthbridgeCounter::getNodeMask(p));
+
+		for (link = 0; link < HT_LINKS_PER_NODE; link++)
+		{
+			event = PerformanceEvents::find(eventNames[link], family);
+
+			if (event == NULL)
+				throw "HyperTransport link events are not available on this processor";
+
+			perfCounters[link] = NorthbridgeCounter::newNodeCounter(p);
+			programmed++;
+
+			setupCounter(perfCounters[link], event->eventSelect, event->unitMask);
+
+			sampler->addEventCounter(perfCounters[link]);
+		}
+
+		for (nodeId = 0; nodeId < p->getProcessorNodes(); nodeId++)
+			for (link = 0; link < HT_LINKS_PER_NODE; link++)
+				if (linkCapacity[nodeId * HT_LINKS_PER_NODE + link] != 0)
+					printf("Node %u Link %u - capacity %uMB/s per direction\n", nodeId, link,
+							linkCapacity[nodeId * HT_LINKS_PER_NODE + link]);
+
+		//First snapshot initializes previous values
+		if (!sampler->takeSnapshot())
+			throw "unable to retrieve performance counter data";
+
+		Signal::activateUserSignalsHandler();
+
+		while (!Signal::getSignalStatus())
+		{
+			Sleep(1000);
+
+			if (!sampler->takeSnapshot())
+				throw "unable to retrieve performance counter data";
+
+			elapsed = sampler->getElapsed();
+
+			if (elapsed == 0)
+				continue;
+
+			for (nodeId = 0; nodeId < p->getProcessorNodes(); nodeId++)
+			{
+				printf("Node %u -", nodeId);
+
+				for (link = 0; link < HT_LINKS_PER_NODE; link++)
+				{
+					capacity = linkCapacity[nodeId * HT_LINKS_PER_NODE + link];
+
+					if (capacity == 0)
+						continue;
+
+					//4 bytes per event, MB/s = bytes * 1000 / nanoseconds
+					bandwidth = (sampler->getEventDelta(link, nodeId) * 4 * 1000) / elapsed;
+
+					printf(" l%u tx:%lluMB/s (%0.1f%%)", link, (unsigned long long) bandwidth,
+							(float) bandwidth * 100.0f / (float) capacity);
+				}
+				printf("\n");
+			}
+			if (fflush(stdout) == EOF) {
+				break;
+			}
+		}
+
+	} catch (char const *str) {
+
+		printf("K10PerformanceCounters.cpp::perfMonitorHTLink - %s\n", str);
+
+	}
+
+	for (link = 0; link < programmed; link++)
+	{
+		if (perfCounters[link]->getEnabled()) perfCounters[link]->disable();
+		delete perfCounters[link];
+	}
+
+	delete sampler;
+
+	free(linkCapacity);
+
+	return;
+
+}
+
+/*
+ * Monitors the memory traffic between nodes. Each node counts its CPU to DRAM requests to each
+ * target node (event 0x1E0, one unit mask bit per target node), so a row of the matrix is the
+ * traffic a node generates toward local and remote memory. Northbridge counters have 4 slots,
+ * so target nodes are counted 4 at a time, in turn, within each second. hops is the node to
+ * node hop matrix, see Processor::computeNUMAHops
+ */
+void Processor::K10PerformanceCounters::perfMonitorNUMATraffic(class Processor *p, const DWORD *hops)
+{
+	PerformanceSampler *sampler;
+	PerformanceCounter *perfCounters[NB_PERF_SLOTS_15];
+	const struct PerformanceEvent *event;
+
+	DWORD nodes, srcNode, dstNode, firstNode, family;
+	unsigned int counter, programmed, passes;
+	uint64_t elapsed, *traffic, local, remote;
+
+	sampler = NULL;
+	programmed = 0;
+
+	nodes = p->getProcessorNodes();
+	if (nodes > HT_ROUTE_MAX_NODES)
+		nodes = HT_ROUTE_MAX_NODES;
+
+	passes = (nodes + NB_PERF_SLOTS_15 - 1) / NB_PERF_SLOTS_15;
+
+	traffic = (uint64_t *) calloc(nodes * nodes, sizeof(uint64_t));
+
+	try {
+
+		family = PerformanceEvents::getFamilyFlag(p->getSpecFamilyExtended());
+
+		event = PerformanceEvents::find("dram-requests", family);
+
+		if (event == NULL)
+			throw "DRAM requests to target node event is not available on this processor";
+
+		p->printNUMADistance(nodes, hops);
+		printf("\n");
+
+		sampler = new PerformanceSampler(NorthbridgeCounter::getNodeMask(p));
+
+		//Counters of the first turn, next turns change the target node only
+		for (dstNode = 0; dstNode < nodes && dstNode < NB_PERF_SLOTS_15; dstNode++)
+		{
+			perfCounters[programmed] = NorthbridgeCounter::newNodeCounter(p);
+			programmed++;
+
+			setupCounter(perfCounters[programmed - 1], event->eventSelect, 1 << dstNode);
+
+			sampler->addEventCounter(perfCounters[programmed - 1]);
+		}
+
+		Signal::activateUserSignalsHandler();
+
+		while (!Signal::getSignalStatus())
+		{
+			for (firstNode = 0; firstNode < nodes; firstNode += NB_PERF_SLOTS_15)
+			{
+				//Selects the target nodes of this turn, counters beyond the last node are not read
+				for (counter = 0; counter < programmed && passes > 1; counter++)
+				{
+					if (firstNode + counter >= nodes)
+						break;
+
+					perfCounters[counter]->disable();
+					perfCounters[counter]->setUnitMask(1 << (firstNode + counter));
+
+					if (!perfCounters[counter]->program() || !perfCounters[counter]->enable())
+						throw "unable to program performance counter parameters";
+				}
+
+				//First snapshot initializes previous values
+				if (!sampler->takeSnapshot())
+					throw "unable to retrieve performance counter data";
+
+				Sleep(1000 / passes);
+
+				if (!sampler->takeSnapshot())
+					throw "unable to retrieve performance counter data";
+
+				elapsed = sampler->getElapsed();
+
+				//64 bytes per request, MB/s = bytes * 1000 / nanoseconds
+				for (counter = 0; counter < programmed && firstNode + counter < nodes; counter++)
+					for (srcNode = 0; srcNode < nodes; srcNode++)
+						traffic[srcNode * nodes + firstNode + counter] = (elapsed == 0) ? 0 :
+								(sampler->getEventDelta(counter, srcNode) * 64 * 1000) / elapsed;
+			}
+
+			for (srcNode = 0; srcNode < nodes; srcNode++)
+			{
+				printf("Node %u -", srcNode);
+
+				local = 0;
+				remote = 0;
+
+				for (dstNode = 0; dstNode < nodes; dstNode++)
+				{
+					printf(" n%u:%lluMB/s", dstNode, (unsigned long long) traffic[srcNode * nodes + dstNode]);
+
+					if (dstNode == srcNode)
+						local += traffic[srcNode * nodes + dstNode];
+					else
+						remote += traffic[srcNode * nodes + dstNode];
+				}
+
+				printf(" | local:%lluMB/s remote:%lluMB/s", (unsigned long long) local, (unsigned long long) remote);
+
+				if (local + remote != 0)
+					printf(" (%0.1f%% remote)", (float) remote * 100.0f / (float) (local + remote));
+
+				printf("\n");
+			}
+			if (fflush(stdout) == EOF) {
+				break;
+			}
+		}
+
+	} catch (char const *str) {
+
+		printf("K10PerformanceCounters.cpp::perfMonitorNUMATraffic - %s\n", str);
+
+	}
+
+	for (counter = 0; counter < programmed; counter++)
+	{
+		if (perfCounters[counter]->getEnabled()) perfCounters[counter]->disable();
+		delete perfCounters[counter];
+	}
+
+	delete sampler;
+
+	free(traffic);
+
+	return;
+
+}
+
+/*
+ * Profiles memory access latency with Instruction-Based Sampling. An op is tagged every period
+ * ops on each core (see IBSSampler); tagged loads and stores that missed the data cache give
+ * the miss latency, where the data came from and whether it came from another node. Prints,
+ * every second and since the beginning, per-core statistics and per-node latency histograms.
+ */
+void Processor::K10PerformanceCounters::perfMonitorIBS(class Processor *p, DWORD period)
+{
+	IBSSampler *sampler;
+	struct IBSCpuStats cpuStats, nodeStats;
+
+	DWORD nodeId, coreId, cpuIndex, source;
+	unsigned int bucket;
+
+	sampler = NULL;
+
+	try {
+
+		if (!IBSSampler::isSupported())
+			throw "Instruction-Based Sampling is not available on this processor";
+
+		sampler = new IBSSampler(p->getMask());
+
+		if (!sampler->start(period))
+			throw "unable to arm Instruction-Based Sampling";
+
+		printf("Tagging an op every %u ops, polling every %uus\n", period, IBS_POLL_INTERVAL);
+
+		Signal::activateUserSignalsHandler();
+
+		while (!Signal::getSignalStatus())
+		{
+			Sleep(1000);
+
+			cpuIndex = 0;
+
+			for (nodeId = 0; nodeId < p->getProcessorNodes(); nodeId++)
+			{
+				memset(&nodeStats, 0, sizeof(struct IBSCpuStats));
+
+				for (coreId = 0x0; coreId < p->getProcessorCores(); coreId++)
+				{
+					if (!sampler->getStats(cpuIndex, &cpuStats))
+						throw "Instruction-Based Sampling has been disabled";
+
+					printf("Node %u c%u - samples:%llu loads:%llu stores:%llu dcmiss:%llu", nodeId, coreId,
+							(unsigned long long) cpuStats.samples,
+							(unsigned long long) cpuStats.loads,
+							(unsigned long long) cpuStats.stores,
+							(unsigned long long) cpuStats.dcMisses);
+
+					if (cpuStats.dcMisses != 0)
+						printf(" avglat:%llu", (unsigned long long) (cpuStats.latencySum / cpuStats.dcMisses));
+
+					if (cpuStats.local + cpuStats.remote != 0)
+						printf(" remote:%llu%%", (unsigned long long) ((cpuStats.remote * 100) / (cpuStats.local + cpuStats.remote)));
+
+					for (source = 1; source < IBS_DATA_SOURCES; source++)
+						if (cpuStats.sources[source] != 0)
+							printf(" %s:%llu", IBSSampler::getSourceName(source), (unsigned long long) cpuStats.sources[source]);
+
+					printf("\n");
+
+					if (cpuStats.lastMiss.linearValid || cpuStats.lastMiss.physicalValid)
+						printf("\tlast miss rip:0x%llx lin:0x%llx phys:0x%llx lat:%u %s\n",
+								(unsigned long long) cpuStats.lastMiss.rip,
+								(unsigned long long) cpuStats.lastMiss.linearAddress,
+								(unsigned long long) cpuStats.lastMiss.physicalAddress,
+								cpuStats.lastMiss.missLatency,
+								cpuStats.lastMiss.remote ? "remote" : "local");
+
+					nodeStats.dcMisses += cpuStats.dcMisses;
+					for (bucket = 0; bucket < IBS_LATENCY_BUCKETS; bucket++)
+						nodeStats.latency[bucket] += cpuStats.latency[bucket];
+
+					cpuIndex++;
+				}
+
+				//Histogram of DC miss latencies, in cycles
+				printf("Node %u latency -", nodeId);
+
+				for (bucket = 0; bucket < IBS_LATENCY_BUCKETS - 1; bucket++)
+					printf(" <%u:%llu", 2 << bucket, (unsigned long long) nodeStats.latency[bucket]);
+
+				printf(" >=%u:%llu\n", 1 << (IBS_LATENCY_BUCKETS - 1),
+						(unsigned long long) nodeStats.latency[IBS_LATENCY_BUCKETS - 1]);
+			}
+
+			printf("\n");
+
+			if (fflush(stdout) == EOF) {
+				break;
+			}
+		}
+
+	} catch (char const *str) {
+
+		printf("K10PerformanceCounters.cpp::perfMonitorIBS - %s\n", str);
+
+	}
+
+	//Destructor disarms IBS
+	delete sampler;
+
+	return;
+
+}
+
+/*
+ * Samples an event (see PerformanceEvents::parse for the syntax) every period events on all the
+ * cores and prints every second, for each core, the processes and the instruction pointers that
+ * caused most of the events (see SampleProfiler)
+ */
+void Processor::K10PerformanceCounters::perfMonitorSamples(class Processor *p, const char *eventSpec, DWORD period)
+{
+	SampleProfiler *profiler;
+	struct PerformanceEvent event;
+
+	profiler = NULL;
+
+	try {
+
+		if (!PerformanceEvents::parse(eventSpec, PerformanceEvents::getFamilyFlag(p->getSpecFamilyExtended()), &event))
+			throw "unknown event";
+
+		if (event.source == EVENT_SOURCE_NB)
+			throw "northbridge events can't be sampled";
+
+		if (period == 0)
+			throw "invalid sample period";
+
+		profiler = startProfiler(p, event.eventSelect, event.unitMask, period);
+
+		Signal::activateUserSignalsHandler();
+
+		while (!Signal::getSignalStatus())
+		{
+			profilerSleep(profiler, 1000);
+
+			printf("%s:\n", eventSpec);
+			printTopOffenders(p, profiler);
+
+			if (fflush(stdout) == EOF) {
+				break;
+			}
+		}
+
+	} catch (char const *str) {
+
+		printf("K10PerformanceCounters.cpp::perfMonitorSamples - %s\n", str);
+
+	}
+
+	delete profiler;
+
+	return;
+
+}
+
+/*
+ * Monitors a comma separated list of northbridge events once per node. Events are counted by the
+ * northbridge performance counters where available, else by the core performance counters of the
+ * first core of each node (see NorthbridgeCounter::newNodeCounter)
+ */
+void Processor::K10PerformanceCounters::perfMonitorNorthbridge(class Processor *p, const char *eventList)
+{
+	PerformanceSampler *sampler;
+	PerformanceCounter *perfCounters[SAMPLER_MAX_EVENTS];
+	struct PerformanceEvent events[SAMPLER_MAX_EVENTS];
+	char labels[SAMPLER_MAX_EVENTS][64];
+	const char *token;
+	size_t length;
+
+	DWORD nodeId, family, slots;
+	unsigned int eventIndex, eventCount, programmed, perfCounterSlot;
+
+	sampler = NULL;
+	eventCount = 0;
+	programmed = 0;
+
+	try {
+
+		family = PerformanceEvents::getFamilyFlag(p->getSpecFamilyExtended());
+
+		if (family == 0)
+			throw "no event catalog available for this processor family";
+
+		slots = NorthbridgeCounter::isSupported() ? NB_PERF_SLOTS_15 : p->getMaxSlots();
+
+		token = eventList;
+
+		while (*token != '\0')
+		{
+			length = strcspn(token, ",");
+
+			if (length == 0 || length >= sizeof(labels[0]))
+				throw "invalid event list";
+
+			if (eventCount >= slots)
+				throw "more events than available performance counter slots";
+
+			strncpy(labels[eventCount], token, length);
+			labels[eventCount][length] = '\0';
+
+			if (!PerformanceEvents::parse(labels[eventCount], family, &events[eventCount]))
+			{
+				printf("Unknown event: %s\n", labels[eventCount]);
+				throw "invalid event list";
+			}
+
+			//Raw events are accepted as they are, catalog ones must be northbridge events
+			if (events[eventCount].name != NULL && events[eventCount].source != EVENT_SOURCE_NB)
+			{
+				printf("Not a northbridge event: %s\n", labels[eventCount]);
+				throw "invalid event list";
+			}
+
+			eventCount++;
+
+			token += length;
+			if (*token == ',')
+				token++;
+		}
+
+		if (eventCount == 0)
+			throw "no events to monitor";
+
+		sampler = new PerformanceSampler(NorthbridgeCounter::getNodeMask(p));
+
+		for (eventIndex = 0; eventIndex < eventCount; eventIndex++)
+		{
+			perfCounters[eventIndex] = NorthbridgeCounter::newNodeCounter(p);
+			programmed++;
+
+			perfCounterSlot = setupCounter(perfCounters[eventIndex], events[eventIndex].eventSelect, events[eventIndex].unitMask);
+
+			printf("Event %s (0x%x:0x%x) will use slot #%d\n", labels[eventIndex],
+					events[eventIndex].eventSelect, events[eventIndex].unitMask, perfCounterSlot);
+
+			sampler->addEventCounter(perfCounters[eventIndex]);
+		}
+
+		//First snapshot initializes previous values
+		if (!sampler->takeSnapshot())
+			throw "unable to retrieve performance counter data";
+
+		Signal::activateUserSignalsHandler();
+
+		while (!Signal::getSignalStatus())
+		{
+			Sleep(1000);
+
+			if (!sampler->takeSnapshot())
+				throw "unable to retrieve performance counter data";
+
+			for (nodeId = 0; nodeId < p->getProcessorNodes(); nodeId++)
+			{
+				printf("Node %u -", nodeId);
+
+				for (eventIndex = 0; eventIndex < eventCount; eventIndex++)
+					printf(" %s:%llu", labels[eventIndex],
+							(unsigned long long) sampler->getEventDelta(eventIndex, nodeId));
+
+				printf("\n");
+			}
+			if (fflush(stdout) == EOF) {
+				break;
+			}
+		}
+
+	} catch (char const *str) {
+
+		printf("K10PerformanceCounters.cpp::perfMonitorNorthbridge - %s\n", str);
+
+	}
+
+	for (eventIndex = 0; eventIndex < programmed; eventIndex++)
+	{
+		if (perfCounters[eventIndex]->getEnabled()) perfCounters[eventIndex]->disable();
+		delete perfCounters[eventIndex];
+	}
+
+	delete sampler;
+
+	return;
+
+}
+
+/*
+ * Measures the cost of reading the CPU clocks not halted counter of all the cpus through the
+ * available access paths: MSR reads, perf read() and rdpmc from per-cpu pinned threads. MSR and
+ * read() costs are measured on snapshots of the whole mask, since each cpu requires a system call
+ * and an inter-processor interrupt. rdpmc cost is measured by the sampler threads on their own cpu.
+ */
+void Processor::K10PerformanceCounters::perfCounterBenchmark(class Processor *p)
+{
+	PerformanceCounter *perfCounter;
+	RdpmcSampler *sampler;
+
+	DWORD cpuIndex, cpuCount;
+	PROCESSORMASK cpuMask;
+	unsigned int iteration, perfCounterSlot;
+	int backend;
+	uint64_t start, elapsed, cost;
+
+	const unsigned int iterations = 1000;
+
+	perfCounter = NULL;
+	sampler = NULL;
+	backend = PerformanceCounter::getBackend();
+
+	try {
+
+		p->setNode(p->ALL_NODES);
+		p->setCore(p->ALL_CORES);
+
+		cpuMask = p->getMask();
+
+		cpuCount = 0;
+		for (cpuIndex = 0; cpuIndex < MAX_CORES; cpuIndex++)
+			if (cpuMask & ((PROCESSORMASK)1 << cpuIndex))
+				cpuCount++;
+
+		printf("Reading event 0x76 on %u cpus, %u iterations\n", cpuCount, iterations);
+
+		//MSR path
+		PerformanceCounter::setBackend(PERFCOUNTER_BACKEND_MSR);
+
+		perfCounter = new PerformanceCounter(cpuMask, 0, p->getMaxSlots());
+		perfCounter->setEventSelect(0x76);
+
+		perfCounterSlot = perfCounter->findAvailableSlot();
+
+		if (perfCounterSlot == 0xfffffffe)
+			throw "unable to access performance counter slots";
+
+		if (perfCounterSlot == 0xffffffff)
+			throw "unable to find an available performance counter slot";
+
+		perfCounter->setSlot(perfCounterSlot);
+
+		if (!perfCounter->program())
+			throw "unable to program performance counter parameters";
+
+		if (!perfCounter->enable())
+			throw "unable to enable performance counters";
+
+		start = TSCClock::readTSC();
+		for (iteration = 0; iteration < iterations; iteration++)
+			if (!perfCounter->takeSnapshot())
+				throw "unable to retrieve performance counter data";
+		elapsed = TSCClock::cyclesToNanoseconds(TSCClock::readTSC() - start);
+
+		cost = elapsed / iterations;
+		printf("MSR:\t\t%llu ns per snapshot, %llu ns per cpu\n",
+				(unsigned long long) cost, (unsigned long long) (cost / cpuCount));
+
+		perfCounter->disable();
+		delete perfCounter;
+		perfCounter = NULL;
+
+		//perf read() path
+		if (!PerformanceCounter::setBackend(PERFCOUNTER_BACKEND_PERF))
+			throw "perf_event_open backend is not available, skipping perf read() and rdpmc";
+
+		perfCounter = new PerformanceCounter(cpuMask, 0, p->getMaxSlots());
+		perfCounter->setEventSelect(0x76);
+
+		if (!perfCounter->program())
+			throw "unable to open perf events";
+
+		if (!perfCounter->enable())
+			throw "unable to enable perf events";
+
+		start = TSCClock::readTSC();
+		for (iteration = 0; iteration < iterations; iteration++)
+			if (!perfCounter->takeSnapshot())
+				throw "unable to read perf events";
+		elapsed = TSCClock::cyclesToNanoseconds(TSCClock::readTSC() - start);
+
+		cost = elapsed / iterations;
+		printf("perf read():\t%llu ns per snapshot, %llu ns per cpu\n",
+				(unsigned long long) cost, (unsigned long long) (cost / cpuCount));
+
+		//rdpmc path, sampler threads take a sample every 100 microseconds for one second
+		if (!RdpmcSampler::isSupported())
+			throw "rdpmc is not supported on this platform";
+
+		if (!perfCounter->mapPerfPages())
+			throw "unable to map perf pages or rdpmc not allowed by the kernel";
+
+		sampler = new RdpmcSampler(cpuMask);
+		sampler->addEventCounter(perfCounter);
+
+		if (!sampler->start(100))
+			throw "unable to start rdpmc sampler threads";
+
+		sampler->takeSnapshot();
+		Sleep(1000);
+		sampler->takeSnapshot();
+		sampler->stop();
+
+		printf("rdpmc:\t");
+		for (cpuIndex = 0; cpuIndex < cpuCount; cpuIndex++)
+			printf("\tc%u:%llu ns", cpuIndex, (unsigned long long) sampler->getSampleCost(cpuIndex));
+		printf("\n");
+
+		printf("rdpmc samples:");
+		for (cpuIndex = 0; cpuIndex < cpuCount; cpuIndex++)
+			printf("\tc%u:%llu", cpuIndex, (unsigned long long) sampler->getSampleCount(cpuIndex));
+		printf("\n");
+
+	} catch (char const *str) {
+
+		printf("K10PerformanceCounters.cpp::perfCounterBenchmark - %s\n", str);
+
+	}
+
+	delete sampler;
+
+	if (perfCounter != NULL)
+	{
+		if (perfCounter->getEnabled()) perfCounter->disable();
+		delete perfCounter;
+	}
+
+	PerformanceCounter::setBackend(backend);
+
+	return;
+
+}
+
+/*
+ * Sets the event of perfCounter, finds an available slot for it among the ones in slotMask,
+ * programs and enables the counter.
+ * Returns the slot, throws a string in case of errors like the monitors do
+ */
+unsigned int Processor::K10PerformanceCounters::setupCounter(PerformanceCounter *perfCounter, unsigned short int eventSelect, unsigned char unitMask,
+		DWORD slotMask)
+{
+	unsigned int perfCounterSlot;
+
+	perfCounter->setEventSelect(eventSelect);
+	perfCounter->setUnitMask(unitMask);
+
+	perfCounterSlot = perfCounter->findAvailableSlot(slotMask);
+
+	//findAvailableSlot() returns -2 in case of error
+	if (perfCounterSlot == 0xfffffffe)
+		throw "unable to access performance counter slots";
+
+	//findAvailableSlot() returns -1 in case there aren't available slots
+	if (perfCounterSlot == 0xffffffff)
+	{
+		if (slotMask != PERFCOUNTER_ALL_SLOTS)
+		{
+			printf("Event 0x%x:0x%x can be counted only on slots mask 0x%x, none of them is free\n",
+					eventSelect, unitMask, (unsigned int) slotMask);
+			throw "no allowed performance counter slot is free for the event";
+		}
+
+		throw "unable to find an available performance counter slot";
+	}
+
+	perfCounter->setSlot(perfCounterSlot);
+
+	if (!perfCounter->program())
+		throw "unable to program performance counter parameters";
+
+	if (!perfCounter->enable())
+		throw "unable to enable performance counters";
+
+	return perfCounterSlot;
+}
 
 void Processor::K10PerformanceCounters::perfCounterGetInfo (class Processor *p) {
 
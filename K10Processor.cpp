@@ -17,6 +17,7 @@
 #include "PCIRegObject.h"
 #include "MSRObject.h"
 #include "PerformanceCounter.h"
+#include "TSCClock.h"
 
 #include "sysdep.h"
 
@@ -2894,15 +2895,222 @@ void K10Processor::perfMonitorCPUUsage () {
 
 }
 
-void K10Processor::perfMonitorFPUUsage () {
+void K10Processor::perfMonitorFPUUsage (DWORD profilePeriod) {
 
-	K10Processor::K10PerformanceCounters::perfMonitorFPUUsage(this);
+	K10Processor::K10PerformanceCounters::perfMonitorFPUUsage(this, profilePeriod);
 
 }
 
-void K10Processor::perfMonitorDCMA () {
+void K10Processor::perfMonitorDCMA (DWORD profilePeriod) {
 
-	K10Processor::K10PerformanceCounters::perfMonitorDCMA(this);
+	K10Processor::K10PerformanceCounters::perfMonitorDCMA(this, profilePeriod);
+
+}
+
+void K10Processor::perfMonitorEffectiveFrequency () {
+
+	K10Processor::K10PerformanceCounters::perfMonitorEffectiveFrequency(this);
+
+}
+
+void K10Processor::perfMonitorCoherence () {
+
+	K10Processor::K10PerformanceCounters::perfMonitorCoherence(this);
+
+}
+
+void K10Processor::perfMonitorDTLB () {
+
+	K10Processor::K10PerformanceCounters::perfMonitorDTLB(this);
+
+}
+
+void K10Processor::perfMonitorCacheMPKI () {
+
+	K10Processor::K10PerformanceCounters::perfMonitorCacheMPKI(this);
+
+}
+
+void K10Processor::perfMonitorIPC () {
+
+	K10Processor::K10PerformanceCounters::perfMonitorIPC(this);
+
+}
+
+void K10Processor::perfMonitorSamples (const char *eventSpec, DWORD period) {
+
+	K10Processor::K10PerformanceCounters::perfMonitorSamples(this, eventSpec, period);
+
+}
+
+void K10Processor::perfMonitorIBS (DWORD period) {
+
+	K10Processor::K10PerformanceCounters::perfMonitorIBS(this, period);
+
+}
+
+void K10Processor::perfMonitorMemoryBandwidth () {
+
+	K10Processor::K10PerformanceCounters::perfMonitorMemoryBandwidth(this);
+
+}
+
+void K10Processor::perfMonitorHTLink () {
+	K10Processor::K10PerformanceCounters::perfMonitorHTLink(this);
+}
+
+/*
+ * Reads the request routes of each node to each node from the HyperTransport routing table
+ * (register 0x40 + 0x4 * destination node). routes is a nodes by nodes matrix.
+ */
+bool K10Processor::getHTRequestRoutes(DWORD nodes, DWORD *routes) {
+
+	PCIRegObject *routingTableRegObject;
+	DWORD node, destNode;
+
+	for (node = 0; node < nodes; node++) {
+
+		setNode(node);
+
+		for (destNode = 0; destNode < nodes; destNode++) {
+
+			routingTableRegObject = new PCIRegObject();
+
+			if (!routingTableRegObject->readPCIReg(PCI_DEV_NORTHBRIDGE, PCI_FUNC_HT_CONFIG,
+					0x40 + (0x4 * destNode), getNodeMask())) {
+				printf("K10Processor::getHTRequestRoutes - unable to read Routing Table PCI Register\n");
+				delete routingTableRegObject;
+				return false;
+			}
+
+			//Request Route is set in bits 0-8
+			routes[node * nodes + destNode] = routingTableRegObject->getBits(0, 0, 9);
+
+			delete routingTableRegObject;
+		}
+	}
+
+	return true;
+}
+
+void K10Processor::showNUMADistance() {
+
+	DWORD nodes = getProcessorNodes();
+	DWORD *routes, *hops;
+
+	if (nodes > HT_ROUTE_MAX_NODES)
+		nodes = HT_ROUTE_MAX_NODES;
+
+	routes = (DWORD *) calloc(nodes * nodes, sizeof(DWORD));
+	hops = (DWORD *) calloc(nodes * nodes, sizeof(DWORD));
+
+	if (getHTRequestRoutes(nodes, routes)) {
+		computeNUMAHops(nodes, routes, hops);
+		printNUMADistance(nodes, hops);
+	}
+
+	free(routes);
+	free(hops);
+
+}
+
+void K10Processor::perfMonitorNUMATraffic () {
+
+	DWORD nodes = getProcessorNodes();
+	DWORD *routes, *hops;
+
+	if (nodes > HT_ROUTE_MAX_NODES)
+		nodes = HT_ROUTE_MAX_NODES;
+
+	routes = (DWORD *) calloc(nodes * nodes, sizeof(DWORD));
+	hops = (DWORD *) calloc(nodes * nodes, sizeof(DWORD));
+
+	if (getHTRequestRoutes(nodes, routes)) {
+		computeNUMAHops(nodes, routes, hops);
+		K10Processor::K10PerformanceCounters::perfMonitorNUMATraffic(this, hops);
+	}
+
+	free(routes);
+	free(hops);
+
+}
+
+/*
+ * Collects the static settings of each DCT (timings, bank swizzle from DRAM Configuration High
+ * F2x[1,0]94 bit 22, DctSelIntLvEn and DctGangEn from DRAM Controller Select Low F2x110) and
+ * monitors page hits, misses and conflicts against them
+ */
+void K10Processor::perfMonitorDramPages () {
+
+	DWORD nodes = getProcessorNodes();
+	DWORD node_index, dct_index;
+	DWORD Trtp, Trc, Twr, Trrd, Tcwl, T_mode, Tfaw;
+	struct dramPageSettings *settings, *dctSettings;
+	PCIRegObject *dctSelectLow, *dramConfigurationHigh;
+
+	settings = (struct dramPageSettings *) calloc(nodes * 2, sizeof(struct dramPageSettings));
+
+	dctSelectLow = new PCIRegObject();
+	dramConfigurationHigh = new PCIRegObject();
+
+	for (node_index = 0; node_index < nodes; node_index++) {
+
+		setNode(node_index);
+
+		if (!dctSelectLow->readPCIReg(PCI_DEV_NORTHBRIDGE, PCI_FUNC_DRAM_CONTROLLER, 0x110, getNodeMask())) {
+			printf("K10Processor::perfMonitorDramPages - unable to read PCI registers\n");
+			break;
+		}
+
+		for (dct_index = 0; dct_index < 2; dct_index++) {
+
+			dctSettings = &settings[node_index * 2 + dct_index];
+
+			if (!getDramValid(dct_index))
+				continue;
+
+			if (!dramConfigurationHigh->readPCIReg(PCI_DEV_NORTHBRIDGE, PCI_FUNC_DRAM_CONTROLLER,
+					0x100 * dct_index + 0x94, getNodeMask())) {
+				printf("K10Processor::perfMonitorDramPages - unable to read PCI registers\n");
+				continue;
+			}
+
+			getDramTimingLow(dct_index, &dctSettings->Tcl, &dctSettings->Trcd, &dctSettings->Trp, &Trtp,
+					&dctSettings->Tras, &Trc, &Twr, &Trrd, &Tcwl, &T_mode, &Tfaw);
+
+			dctSettings->valid = true;
+			//getDramFrequency() returns the memory clock, data is transferred on both edges
+			dctSettings->dataRate = getDramFrequency(dct_index) * 2;
+			dctSettings->bankSwizzle = dramConfigurationHigh->getBits(0, 22, 1);
+			dctSettings->channelInterleave = dctSelectLow->getBits(0, 2, 1);
+			dctSettings->ganged = dctSelectLow->getBits(0, 4, 1);
+		}
+	}
+
+	delete dctSelectLow;
+	delete dramConfigurationHigh;
+
+	K10Processor::K10PerformanceCounters::perfMonitorDramPages(this, settings);
+
+	free(settings);
+
+}
+
+void K10Processor::perfMonitorNorthbridge (const char *eventList) {
+
+	K10Processor::K10PerformanceCounters::perfMonitorNorthbridge(this, eventList);
+
+}
+
+void K10Processor::perfCounterBenchmark () {
+
+	K10Processor::K10PerformanceCounters::perfCounterBenchmark(this);
+
+}
+
+void K10Processor::perfMonitorEvents (const char *eventList, DWORD quantum, const char *attribution) {
+
+	K10Processor::K10PerformanceCounters::perfMonitorEvents(this, eventList, quantum, attribution);
 
 }
 
@@ -2925,7 +3133,7 @@ void K10Processor::checkMode () {
 
 	DWORD a, b, c, i, j, k, pstate, vid, fid, did;
 	DWORD eaxMsr, edxMsr;
-	DWORD timestamp;
+	uint64_t timestamp;
 
 	DWORD *states;
 	DWORD *savedstates;
@@ -2934,7 +3142,7 @@ void K10Processor::checkMode () {
 #define SAVEDSTATES(NODE, CORE, PSTATE) STATEACCESS(savedstates, NODE, CORE, PSTATE)
 
 	DWORD minTemp, maxTemp, temp, savedMinTemp, savedMaxTemp;
-	DWORD oTimeStamp, iTimeStamp;
+	uint64_t oTimeStamp, iTimeStamp;
 	float curVcore;
 
 	states = new DWORD[processorNodes * processorCores * getPowerStates()]();
@@ -2942,15 +3150,15 @@ void K10Processor::checkMode () {
 
 	minTemp=getTctlRegister();
 	maxTemp=minTemp;
-	iTimeStamp = GetTickCount();
+	iTimeStamp = TSCClock::getMilliseconds();
 	oTimeStamp = iTimeStamp;
 
 	while (1) {
 		ClearScreen(CLEARSCREEN_FLAG_SMART);
 
-		timestamp=GetTickCount ();
+		timestamp=TSCClock::getMilliseconds();
 
-		printf ("\nTs:%u - ",timestamp);
+		printf ("\nTs:%llu - ",(unsigned long long)timestamp);
 		for (i = 0; i < processorNodes; i++)
 		{
 			setNode(i);
@@ -9,6 +9,7 @@ private:
 			DWORD *DstNode);
 
 	void printRoute(DWORD);
+	bool getHTRequestRoutes(DWORD nodes, DWORD *routes);
 
 	int getDramFrequency (DWORD device);
 	bool getDDR3Mode (DWORD device);
@@ -39,6 +40,7 @@ public:
 	void showFamilySpecs ();
 	void showHTC();
 	void showHTLink();
+	void showNUMADistance();
 	void showDramTimings ();
 
 	float convertVIDtoVcore (DWORD);
@@ -162,8 +164,22 @@ public:
 	void perfCounterGetInfo ();
 	void perfCounterGetValue (unsigned int);
 	void perfMonitorCPUUsage ();
-	void perfMonitorFPUUsage ();
-	void perfMonitorDCMA ();
+	void perfMonitorFPUUsage (DWORD profilePeriod);
+	void perfMonitorDCMA (DWORD profilePeriod);
+	void perfMonitorEffectiveFrequency ();
+	void perfMonitorCoherence ();
+	void perfMonitorDTLB ();
+	void perfMonitorCacheMPKI ();
+	void perfMonitorIPC ();
+	void perfMonitorSamples (const char *eventSpec, DWORD period);
+	void perfMonitorIBS (DWORD period);
+	void perfMonitorMemoryBandwidth ();
+	void perfMonitorHTLink ();
+	void perfMonitorNUMATraffic ();
+	void perfMonitorDramPages ();
+	void perfMonitorNorthbridge (const char *eventList);
+	void perfCounterBenchmark ();
+	void perfMonitorEvents (const char *eventList, DWORD quantum, const char *attribution);
 
 	//Scaler helper methods
 	void getCurrentStatus (struct procStatus *pStatus, DWORD core);
@@ -17,6 +17,7 @@
 #include "PCIRegObject.h"
 #include "MSRObject.h"
 #include "PerformanceCounter.h"
+#include "TSCClock.h"
 
 //Llano class constructor
 Llano::Llano() {
@@ -1634,15 +1635,81 @@ void Llano::perfMonitorCPUUsage() {
 
 }
 
-void Llano::perfMonitorFPUUsage () {
+void Llano::perfMonitorFPUUsage (DWORD profilePeriod) {
 
-	Llano::K10PerformanceCounters::perfMonitorFPUUsage(this);
+	Llano::K10PerformanceCounters::perfMonitorFPUUsage(this, profilePeriod);
 
 }
 
-void Llano::perfMonitorDCMA () {
+void Llano::perfMonitorDCMA (DWORD profilePeriod) {
 
-	Llano::K10PerformanceCounters::perfMonitorDCMA(this);
+	Llano::K10PerformanceCounters::perfMonitorDCMA(this, profilePeriod);
+
+}
+
+void Llano::perfMonitorEffectiveFrequency () {
+
+	Llano::K10PerformanceCounters::perfMonitorEffectiveFrequency(this);
+
+}
+
+void Llano::perfMonitorCoherence () {
+
+	Llano::K10PerformanceCounters::perfMonitorCoherence(this);
+
+}
+
+void Llano::perfMonitorDTLB () {
+
+	Llano::K10PerformanceCounters::perfMonitorDTLB(this);
+
+}
+
+void Llano::perfMonitorCacheMPKI () {
+
+	Llano::K10PerformanceCounters::perfMonitorCacheMPKI(this);
+
+}
+
+void Llano::perfMonitorIPC () {
+
+	Llano::K10PerformanceCounters::perfMonitorIPC(this);
+
+}
+
+void Llano::perfMonitorSamples (const char *eventSpec, DWORD period) {
+
+	Llano::K10PerformanceCounters::perfMonitorSamples(this, eventSpec, period);
+
+}
+
+void Llano::perfMonitorIBS (DWORD period) {
+
+	Llano::K10PerformanceCounters::perfMonitorIBS(this, period);
+
+}
+
+void Llano::perfMonitorMemoryBandwidth () {
+
+	Llano::K10PerformanceCounters::perfMonitorMemoryBandwidth(this);
+
+}
+
+void Llano::perfMonitorNorthbridge (const char *eventList) {
+
+	Llano::K10PerformanceCounters::perfMonitorNorthbridge(this, eventList);
+
+}
+
+void Llano::perfCounterBenchmark () {
+
+	Llano::K10PerformanceCounters::perfCounterBenchmark(this);
+
+}
+
+void Llano::perfMonitorEvents (const char *eventList, DWORD quantum, const char *attribution) {
+
+	Llano::K10PerformanceCounters::perfMonitorEvents(this, eventList, quantum, attribution);
 
 }
 
@@ -1662,10 +1729,10 @@ void Llano::getCurrentStatus(struct procStatus *pStatus, DWORD core) {
 void Llano::checkMode() {
 	DWORD i, pstate, vid, fid, did;
 	DWORD eaxMsr, edxMsr;
-	DWORD timestamp;
+	uint64_t timestamp;
 	DWORD states[2][8];
 	DWORD minTemp, maxTemp, temp;
-	DWORD oTimeStamp;
+	uint64_t oTimeStamp;
 	float curVcore;
 	DWORD maxPState;
 	unsigned int cid;
@@ -1681,13 +1748,13 @@ void Llano::checkMode() {
 
 	minTemp = getTctlRegister();
 	maxTemp = minTemp;
-	oTimeStamp = GetTickCount();
+	oTimeStamp = TSCClock::getMilliseconds();
 
 	while (1) {
 
-		timestamp = GetTickCount();
+		timestamp = TSCClock::getMilliseconds();
 
-		printf(" \rTs:%d - ", timestamp);
+		printf(" \rTs:%llu - ", (unsigned long long)timestamp);
 		for (i = 0; i < processorCores; i++) {
 
 			/*RdmsrPx (0xc0010063,&eaxMsr,&edxMsr,i+1);
@@ -0,0 +1,70 @@
+/*
+ * NorthbridgeCounter.cpp
+ *
+ * Family 15h processors have four northbridge performance counters (MSRC001_0240 to MSRC001_0247)
+ * besides the core ones. They count northbridge events like DRAM accesses, memory controller requests,
+ * hypertransport link traffic and probe responses, and they are shared by all the cores of a node:
+ * programming or reading them from any core of the node accesses the same registers.
+ *
+ * NB_PERF_CTL has the same layout of the core PERF_CTL register, except for the user and OS mode bits
+ * that are reserved, so this class just points PerformanceCounter to the northbridge registers and must
+ * be used exactly like it, giving a cpuMask with one cpu per node (see getNodeMask()). Counter values
+ * are then indexed by node. Northbridge counters are not available through perf_event_open, so they
+ * are always programmed through MSRs.
+ *
+ * On Family 10h northbridge events are counted by the core performance counters instead: newNodeCounter()
+ * returns the right counter for the processor, so monitors can sample northbridge events once per node
+ * without caring about the family.
+ *
+ */
+
+#include "NorthbridgeCounter.h"
+
+NorthbridgeCounter::NorthbridgeCounter(PROCESSORMASK cpuMask, DWORD slot) : PerformanceCounter(cpuMask, slot, NB_PERF_SLOTS_15)
+{
+	this->pesrReg = BASE_NB_PESR_REG_15;
+	this->percReg = BASE_NB_PERC_REG_15;
+	this->offset = 2;
+
+	//User and OS mode bits are reserved in NB_PERF_CTL
+	this->countUserMode = false;
+	this->countOsMode = false;
+
+	this->directAccess = true;
+}
+
+/*
+ * Northbridge performance counters availability is reported by CPUID Function 8000_0001 reg ECX
+ * bit 24 (PerfCtrExtNB)
+ */
+bool NorthbridgeCounter::isSupported ()
+{
+	DWORD eax, ebx, ecx, edx;
+
+	if (Cpuid(0x80000001, &eax, &ebx, &ecx, &edx) != TRUE)
+		return false;
+
+	return (ecx >> 24) & 0x1;
+}
+
+/*
+ * Returns a mask with the first core of each node, to program and read northbridge events
+ * once per node
+ */
+PROCESSORMASK NorthbridgeCounter::getNodeMask (class Processor *p)
+{
+	return p->getMask(0, p->ALL_NODES);
+}
+
+/*
+ * Returns a new counter able to count northbridge events once per node: a NorthbridgeCounter on
+ * processors with northbridge performance counters, else a core performance counter on the first
+ * core of each node. Counter indexes are node numbers. Caller must delete the counter.
+ */
+PerformanceCounter *NorthbridgeCounter::newNodeCounter (class Processor *p)
+{
+	if (isSupported())
+		return new NorthbridgeCounter(getNodeMask(p), 0);
+
+	return new PerformanceCounter(getNodeMask(p), 0, p->getMaxSlots());
+}
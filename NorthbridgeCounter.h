@@ -0,0 +1,25 @@
+/*
+ * NorthbridgeCounter.h
+ *
+ * Family 15h northbridge performance counters
+ *
+ */
+
+#ifndef NORTHBRIDGECOUNTER_H_
+#define NORTHBRIDGECOUNTER_H_
+
+#include "Processor.h"
+#include "PerformanceCounter.h"
+
+class NorthbridgeCounter : public PerformanceCounter {
+
+public:
+	NorthbridgeCounter(PROCESSORMASK cpuMask, DWORD slot);
+
+	static bool isSupported ();
+	static PROCESSORMASK getNodeMask (class Processor *p);
+	static PerformanceCounter *newNodeCounter (class Processor *p);
+
+};
+
+#endif /* NORTHBRIDGECOUNTER_H_ */
@@ -20,14 +20,38 @@
  * If you wish to know the actual hardware condition, you can use the fetch () method that reads the hardware registers
  * and changes the protected parameters of this class. Then you can access the parameters via setters/getters.
  *
+ * On linux the counters can be obtained from the kernel through perf_event_open instead of programming the
+ * PERF_CTL registers directly (see setBackend()). This way the kernel arbitrates the counters, so there are no
+ * collisions with the NMI watchdog or with other perf users. The methods above keep the same meaning, slots
+ * become just a logical index since the kernel chooses the hardware counter. Counters can be grouped with
+ * setGroupLeader(): the leader reads the values of all the group members at once, so the leader snapshot must
+ * be taken before the members ones.
+ *
+ * Even cheaper reads are possible with the perf backend mapping the perf user pages with mapPerfPages(): then
+ * readPerfPage() reads the counter with the rdpmc instruction without any system call, but it must be called
+ * from a thread running on the cpu the counter belongs to (see RdpmcSampler).
+ *
  *  Created on: 25/mag/2011
  *      Author: paolo
  */
 
 #include "PerformanceCounter.h"
 
+#ifdef __linux
+#include <unistd.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+int PerformanceCounter::backend = PERFCOUNTER_BACKEND_MSR;
+
 PerformanceCounter::PerformanceCounter(PROCESSORMASK cpuMask, DWORD slot, DWORD maxslots)
 {
+	DWORD cpuIndex;
+
 	if (slot > maxslots)
 		this->slot = maxslots;
 	else
@@ -43,6 +67,7 @@ PerformanceCounter::PerformanceCounter(PROCESSORMASK cpuMask, DWORD slot, DWORD
 	this->enableAPICInterrupt = false;
 	this->invertCntMask = false;
 	this->unitMask = 0;
+	this->enabled = false;
 	
 	//Note that the number of slots determines the register to be used
 	//Based on BKDG for 15h (pg 547), the legacy slots do exist, however if they are used
@@ -64,6 +89,26 @@ PerformanceCounter::PerformanceCounter(PROCESSORMASK cpuMask, DWORD slot, DWORD
 	}
 
 	snapshotRegister = new MSRObject();
+
+	this->cpuCount = 0;
+	for (cpuIndex = 0; cpuIndex < MAX_CORES; cpuIndex++)
+		if (cpuMask & ((PROCESSORMASK)1 << cpuIndex))
+			this->cpuCount++;
+
+	this->perfEvents = false;
+	this->perfFds = (int *) malloc(cpuCount * sizeof(int));
+	this->perfValues = (uint64_t *) calloc(cpuCount, sizeof(uint64_t));
+	this->perfTimeEnabled = (uint64_t *) calloc(cpuCount, sizeof(uint64_t));
+	this->perfTimeRunning = (uint64_t *) calloc(cpuCount, sizeof(uint64_t));
+	this->perfPages = (void **) calloc(cpuCount, sizeof(void *));
+
+	for (cpuIndex = 0; cpuIndex < cpuCount; cpuIndex++)
+		this->perfFds[cpuIndex] = -1;
+
+	this->groupLeader = NULL;
+	this->groupMemberCount = 0;
+
+	this->directAccess = false;
 }
 
 /*
@@ -92,6 +137,9 @@ unsigned int PerformanceCounter::getPERCReg(unsigned char slot)
 
 bool PerformanceCounter::program()
 {
+	if (backend == PERFCOUNTER_BACKEND_PERF && !directAccess)
+		return programPerfEvents();
+
 	MSRObject *pCounterMSRObject = new MSRObject();
 	
 	//Loads the current status of the MS registers for all the cpus in the mask
@@ -110,7 +158,7 @@ bool PerformanceCounter::program()
 	pCounterMSRObject->setBits(23, 1, this->invertCntMask);
 	pCounterMSRObject->setBits(24, 8, this->counterMask);
 	pCounterMSRObject->setBits(0, 8, this->eventSelect & 0xff); //Lower 8 bits of eventSelect
-	pCounterMSRObject->setBits(32, 4, this->eventSelect & 0xf00); //Higher 4 bits of eventSelect
+	pCounterMSRObject->setBits(32, 4, (this->eventSelect & 0xf00) >> 8); //Higher 4 bits of eventSelect
 	pCounterMSRObject->setBits(22, 1, 0); //Disables the counter, it must be enabled with another method
 
 	//Writes the data in the MS registers;
@@ -156,7 +204,7 @@ bool PerformanceCounter::fetch(DWORD cpuIndex)
 	this->counterMask=pCounterMSRObject->getBits(cpuIndex, 24, 8);
 	this->enabled=pCounterMSRObject->getBits(cpuIndex, 22,1);
 	this->eventSelect=pCounterMSRObject->getBits(cpuIndex, 0, 8); //Lower 8 bits of eventSelect
-	this->eventSelect+=pCounterMSRObject->getBits(cpuIndex, 32, 4) << 4; //Higher 4 bits of eventSelect
+	this->eventSelect+=pCounterMSRObject->getBits(cpuIndex, 32, 4) << 8; //Higher 4 bits of eventSelect
 
 	return true;
 
@@ -165,7 +213,8 @@ bool PerformanceCounter::fetch(DWORD cpuIndex)
 /*
  * findAvailableSlot() will find a "row" of available slots. It means that it will cycle through the
  * performance counter slots and will search for a slot that is, for all processors in the mask,
- * not enabled at all or has exactly the same parameters that is going to be programmed.
+ * not enabled at all or has exactly the same parameters that is going to be programmed. Only the
+ * slots set in slotMask are considered, see PerformanceEvents::getSlotMask().
  *
  * Returns the performance counter slot if the class finds an available slot for all the processors.
  * Returns -1 (0xffffffff) if no available slot is found
@@ -173,15 +222,25 @@ bool PerformanceCounter::fetch(DWORD cpuIndex)
  *
  */
 
-unsigned int PerformanceCounter::findAvailableSlot ()
+unsigned int PerformanceCounter::findAvailableSlot (DWORD slotMask)
 {
-	MSRObject *pCounterMSRObject = new MSRObject();
+	MSRObject *pCounterMSRObject;
 	unsigned int slot;
 	unsigned int cpuIndex;
 	bool valid;
 
+	//The kernel arbitrates the hardware counters, any slot is fine
+	if (backend == PERFCOUNTER_BACKEND_PERF && !directAccess)
+		return this->slot;
+
+	pCounterMSRObject = new MSRObject();
+
 	for (slot = 0; slot < this->maxslots; slot++)
 	{
+		//The event cannot be counted on this slot
+		if (!((slotMask >> slot) & 0x1))
+			continue;
+
 		//Loads the current status of the MS registers for all the cpus in the mask.
 		if (!pCounterMSRObject->readMSR(getPESRReg(slot), this->cpuMask))
 		{
@@ -207,7 +266,7 @@ unsigned int PerformanceCounter::findAvailableSlot ()
 					(pCounterMSRObject->getBits(cpuIndex, 23, 1) != this->invertCntMask) ||
 					(pCounterMSRObject->getBits(cpuIndex, 24, 8) != this->counterMask) ||
 					(pCounterMSRObject->getBits(cpuIndex, 0, 8) != (this->eventSelect & 0xff)) ||
-					(pCounterMSRObject->getBits(cpuIndex, 32, 4) != (this->eventSelect & 0xf00)))
+					(pCounterMSRObject->getBits(cpuIndex, 32, 4) != ((this->eventSelect & 0xf00) >> 8)))
 				{
 						valid=false;
 						break;
@@ -227,8 +286,8 @@ unsigned int PerformanceCounter::findAvailableSlot ()
 
 /*
  * findFreeSlot() will find a "row" of available slots. It means that it will cycle through the
- * performance counter slots and will search for a slot that is, for all processors in the mask,
- * not enabled at all.
+ * performance counter slots, starting from firstSlot, and will search for a slot that is, for all
+ * processors in the mask, not enabled at all.
  *
  * Returns the performance counter slot if the class finds free slots for all the processors.
  * Returns -1 (0xffffffff) if no free slot is found
@@ -236,14 +295,20 @@ unsigned int PerformanceCounter::findAvailableSlot ()
  *
  */
 
-unsigned int PerformanceCounter::findFreeSlot ()
+unsigned int PerformanceCounter::findFreeSlot (unsigned int firstSlot)
 {
-	MSRObject *pCounterMSRObject = new MSRObject();
+	MSRObject *pCounterMSRObject;
 	unsigned int slot;
 	unsigned int cpuIndex;
 	bool valid;
 
-	for (slot = 0; slot < this->maxslots; slot++)
+	//The kernel arbitrates the hardware counters, slots are just logical indexes
+	if (backend == PERFCOUNTER_BACKEND_PERF && !directAccess)
+		return (firstSlot < this->maxslots) ? firstSlot : -1;
+
+	pCounterMSRObject = new MSRObject();
+
+	for (slot = firstSlot; slot < this->maxslots; slot++)
 	{
 		//Loads the current status of the MS registers for all the cpus in the mask.
 		if (!pCounterMSRObject->readMSR(getPESRReg(slot), this->cpuMask))
@@ -287,6 +352,9 @@ unsigned int PerformanceCounter::findFreeSlot ()
 bool PerformanceCounter::enable()
 {
 
+	if (perfEvents)
+		return enablePerfEvents(true);
+
 	MSRObject *pCounterMSRObject = new MSRObject();
 
 	//Loads the current status of the MS registers for all the cpus in the mask.
@@ -322,6 +390,9 @@ bool PerformanceCounter::enable()
 bool PerformanceCounter::disable()
 {
 
+	if (perfEvents)
+		return enablePerfEvents(false);
+
 	MSRObject *pCounterMSRObject = new MSRObject();
 	
 	//Loads the current status of the MS registers for all the cpus in the mask.
@@ -357,6 +428,9 @@ bool PerformanceCounter::disable()
  */
 bool PerformanceCounter::takeSnapshot()
 {
+	if (perfEvents)
+		return readPerfEvents();
+
 	if (!snapshotRegister->readMSR(getPERCReg(this->slot), this->cpuMask))
 		return false;
 
@@ -373,9 +447,383 @@ bool PerformanceCounter::takeSnapshot()
  */
 uint64_t PerformanceCounter::getCounter(DWORD cpuIndex)
 {
+	if (perfEvents)
+		return perfValues[cpuIndex];
+
 	return snapshotRegister->getBits(cpuIndex, 0, 64);
 }
 
+/*
+ * Reads the counter of cpuIndex alone, without a snapshot of the other cpus: through its MSR, or
+ * through the perf user page and rdpmc with the perf backend (see mapPerfPages). When called
+ * from the cpu the counter belongs to, the read needs no inter-processor interrupt.
+ *
+ * Returns false in case of error
+ */
+bool PerformanceCounter::readLocal (DWORD cpuIndex, uint64_t *value)
+{
+	MSRObject *msrObject;
+	DWORD cpu, index;
+
+	if (perfEvents)
+		return readPerfPage(cpuIndex, value);
+
+	//Absolute cpu number of cpuIndex
+	index = 0;
+	for (cpu = 0; cpu < MAX_CORES; cpu++)
+	{
+		if (!(this->cpuMask & ((PROCESSORMASK)1 << cpu)))
+			continue;
+
+		if (index == cpuIndex)
+			break;
+
+		index++;
+	}
+
+	if (cpu == MAX_CORES)
+		return false;
+
+	msrObject = new MSRObject();
+
+	if (!msrObject->readMSR(getPERCReg(this->slot), (PROCESSORMASK)1 << cpu))
+	{
+		delete msrObject;
+		return false;
+	}
+
+	*value = msrObject->getBits(0, 0, 64);
+
+	delete msrObject;
+
+	return true;
+}
+
+/*
+ * Returns the number of events counted between two readings of a counter. Counters are
+ * PERFORMANCE_COUNTER_WIDTH bits wide, so the difference is computed modulo the counter width
+ * to handle counters that wrapped between the two readings.
+ */
+uint64_t PerformanceCounter::counterDelta(uint64_t prev, uint64_t current)
+{
+	return (current - prev) & ((((uint64_t) 1) << PERFORMANCE_COUNTER_WIDTH) - 1);
+}
+
+/*
+ * Selects the backend used by counters programmed from now on. The perf backend is available
+ * on linux only, and only if the kernel allows to open raw events (see perf_event_paranoid).
+ *
+ * Returns true if the backend is available, false in the other case.
+ */
+bool PerformanceCounter::setBackend (int backend)
+{
+#ifdef __linux
+	struct perf_event_attr attr;
+	int fd;
+
+	if (backend == PERFCOUNTER_BACKEND_PERF)
+	{
+		//Probes the interface opening a disabled CPU clocks not halted event on cpu 0
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_RAW;
+		attr.config = 0x76;
+		attr.disabled = 1;
+
+		fd = syscall(__NR_perf_event_open, &attr, -1, 0, -1, 0);
+		if (fd == -1)
+			return false;
+
+		close(fd);
+	}
+#else
+	if (backend == PERFCOUNTER_BACKEND_PERF)
+		return false;
+#endif
+
+	if (backend != PERFCOUNTER_BACKEND_MSR && backend != PERFCOUNTER_BACKEND_PERF)
+		return false;
+
+	PerformanceCounter::backend = backend;
+
+	return true;
+}
+
+int PerformanceCounter::getBackend ()
+{
+	return backend;
+}
+
+/*
+ * Makes this counter a member of the leader group. Members are read atomically together with the
+ * leader, which must have the same cpuMask and must be programmed before the members.
+ * Only meaningful with the perf backend.
+ *
+ * Returns false if the leader group is full or the leader is itself a member
+ */
+bool PerformanceCounter::setGroupLeader (PerformanceCounter *leader)
+{
+	if (leader->groupLeader != NULL || leader->groupMemberCount >= PERFCOUNTER_MAX_GROUP_MEMBERS)
+		return false;
+
+	leader->groupMembers[leader->groupMemberCount++] = this;
+	this->groupLeader = leader;
+
+	return true;
+}
+
+//Nanoseconds the event has been enabled, perf backend only
+uint64_t PerformanceCounter::getTimeEnabled (DWORD cpuIndex) const
+{
+	return perfTimeEnabled[cpuIndex];
+}
+
+//Nanoseconds the event has been actually counted, perf backend only. It is lower than the
+//enabled time when the kernel multiplexes the hardware counters
+uint64_t PerformanceCounter::getTimeRunning (DWORD cpuIndex) const
+{
+	return perfTimeRunning[cpuIndex];
+}
+
+/*
+ * Returns the event encoded as an AMD raw event for perf_event_open, it has the same
+ * layout of the PERF_CTL register
+ */
+uint64_t PerformanceCounter::getRawConfig () const
+{
+	uint64_t config;
+
+	config = this->eventSelect & 0xff;
+	config |= ((uint64_t) this->unitMask) << 8;
+	config |= ((uint64_t) this->edgeDetect) << 18;
+	config |= ((uint64_t) this->invertCntMask) << 23;
+	config |= ((uint64_t) this->counterMask) << 24;
+	config |= ((uint64_t) ((this->eventSelect & 0xf00) >> 8)) << 32;
+
+	return config;
+}
+
+/*
+ * Opens a disabled perf event for each cpu in the mask. Leaders and single counters use the group
+ * read format, so the values of all the members come with a single read
+ */
+bool PerformanceCounter::programPerfEvents ()
+{
+#ifdef __linux
+	struct perf_event_attr attr;
+	DWORD cpu, cpuIndex;
+	int groupFd;
+
+	closePerfEvents();
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_RAW;
+	attr.config = getRawConfig();
+	attr.disabled = 1;
+	attr.exclude_user = !this->countUserMode;
+	attr.exclude_kernel = !this->countOsMode;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+	if (groupLeader == NULL)
+		attr.read_format |= PERF_FORMAT_GROUP;
+
+	cpuIndex = 0;
+	for (cpu = 0; cpu < MAX_CORES; cpu++)
+	{
+		if (!(this->cpuMask & ((PROCESSORMASK)1 << cpu)))
+			continue;
+
+		groupFd = (groupLeader != NULL) ? groupLeader->perfFds[cpuIndex] : -1;
+
+		perfFds[cpuIndex] = syscall(__NR_perf_event_open, &attr, -1, cpu, groupFd, 0);
+
+		if (perfFds[cpuIndex] == -1)
+		{
+			closePerfEvents();
+			return false;
+		}
+
+		cpuIndex++;
+	}
+
+	perfEvents = true;
+	this->enabled = false;
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool PerformanceCounter::enablePerfEvents (bool enable)
+{
+#ifdef __linux
+	DWORD cpuIndex;
+
+	for (cpuIndex = 0; cpuIndex < cpuCount; cpuIndex++)
+		if (ioctl(perfFds[cpuIndex], enable ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE, 0) == -1)
+			return false;
+
+	this->enabled = enable;
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*
+ * Reads the values of the counter and of its group members. Members are filled by their leader
+ * read, so for them there is nothing to do here
+ */
+bool PerformanceCounter::readPerfEvents ()
+{
+#ifdef __linux
+	//Group read format: number of events, time enabled, time running, values
+	uint64_t buffer[3 + 1 + PERFCOUNTER_MAX_GROUP_MEMBERS];
+	DWORD cpuIndex;
+	unsigned int member;
+	ssize_t size;
+
+	if (groupLeader != NULL)
+		return true;
+
+	for (cpuIndex = 0; cpuIndex < cpuCount; cpuIndex++)
+	{
+		size = read(perfFds[cpuIndex], buffer, sizeof(buffer));
+
+		if (size < (ssize_t) (4 * sizeof(uint64_t)) || buffer[0] > 1 + groupMemberCount)
+			return false;
+
+		perfTimeEnabled[cpuIndex] = buffer[1];
+		perfTimeRunning[cpuIndex] = buffer[2];
+		perfValues[cpuIndex] = buffer[3];
+
+		for (member = 0; member + 1 < buffer[0]; member++)
+		{
+			groupMembers[member]->perfTimeEnabled[cpuIndex] = buffer[1];
+			groupMembers[member]->perfTimeRunning[cpuIndex] = buffer[2];
+			groupMembers[member]->perfValues[cpuIndex] = buffer[4 + member];
+		}
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*
+ * Maps the perf user page of each cpu event. The page holds the index of the hardware counter the
+ * kernel assigned to the event, so the counter can be read from user space with rdpmc.
+ * Counter must have been programmed with the perf backend.
+ *
+ * Returns false if the pages can't be mapped or if the kernel does not allow rdpmc
+ */
+bool PerformanceCounter::mapPerfPages ()
+{
+#ifdef __linux
+	struct perf_event_mmap_page *page;
+	DWORD cpuIndex;
+
+	if (!perfEvents)
+		return false;
+
+	for (cpuIndex = 0; cpuIndex < cpuCount; cpuIndex++)
+	{
+		if (perfPages[cpuIndex] != NULL)
+			continue;
+
+		perfPages[cpuIndex] = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, perfFds[cpuIndex], 0);
+
+		if (perfPages[cpuIndex] == MAP_FAILED)
+		{
+			perfPages[cpuIndex] = NULL;
+			return false;
+		}
+
+		page = (struct perf_event_mmap_page *) perfPages[cpuIndex];
+
+		if (!page->cap_user_rdpmc)
+			return false;
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*
+ * Reads the counter of cpuIndex through its perf user page and rdpmc. The page is updated by the
+ * kernel under a sequence lock: if lock changes while reading, the read is retried. Index is zero
+ * when the event is not on the hardware counters right now, in that case offset already holds
+ * the whole count. Hardware value is sign extended from the counter width, as the kernel does.
+ *
+ * Must run on the cpu the counter belongs to. Returns false if the page is not mapped.
+ */
+bool PerformanceCounter::readPerfPage (DWORD cpuIndex, uint64_t *value) const
+{
+#if defined(__linux) && (defined(__i386__) || defined(__x86_64__))
+	volatile struct perf_event_mmap_page *page;
+	DWORD sequence, index, low, high;
+	int64_t count;
+	unsigned int width;
+
+	page = (volatile struct perf_event_mmap_page *) perfPages[cpuIndex];
+
+	if (page == NULL)
+		return false;
+
+	do {
+		sequence = page->lock;
+		__sync_synchronize();
+
+		index = page->index;
+		count = page->offset;
+
+		if (index != 0)
+		{
+			__asm__ __volatile__ ("rdpmc" : "=a" (low), "=d" (high) : "c" (index - 1));
+
+			width = page->pmc_width;
+			count += ((int64_t) ((((uint64_t) high) << 32) | low) << (64 - width)) >> (64 - width);
+		}
+
+		__sync_synchronize();
+	} while (page->lock != sequence);
+
+	*value = (uint64_t) count;
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+void PerformanceCounter::closePerfEvents ()
+{
+#ifdef __linux
+	DWORD cpuIndex;
+
+	for (cpuIndex = 0; cpuIndex < cpuCount; cpuIndex++)
+	{
+		if (perfPages[cpuIndex] != NULL)
+			munmap(perfPages[cpuIndex], sysconf(_SC_PAGESIZE));
+
+		perfPages[cpuIndex] = NULL;
+
+		if (perfFds[cpuIndex] != -1)
+			close(perfFds[cpuIndex]);
+
+		perfFds[cpuIndex] = -1;
+	}
+#endif
+
+	perfEvents = false;
+}
+
 /*
  * Getters and setters, not much interesting
  *
@@ -385,6 +833,10 @@ bool PerformanceCounter::getEnabled() const {
 	return enabled;
 }
 
+bool PerformanceCounter::getPerfEvents() const {
+	return perfEvents;
+}
+
 bool PerformanceCounter::getCountUserMode() const {
 	return countUserMode;
 }
@@ -481,4 +933,12 @@ PerformanceCounter::~PerformanceCounter() {
 
 	free(snapshotRegister);
 
+	closePerfEvents();
+
+	free(perfFds);
+	free(perfValues);
+	free(perfTimeEnabled);
+	free(perfTimeRunning);
+	free(perfPages);
+
 }
@@ -11,6 +11,17 @@
 #include "Processor.h"
 #include "MSRObject.h"
 
+//Performance counters are 48 bits wide, upper bits read as zero
+#define PERFORMANCE_COUNTER_WIDTH 48
+
+//Counter backends: MSR programs the PERF_CTL registers directly, PERF asks the
+//linux kernel for the counters through perf_event_open
+#define PERFCOUNTER_BACKEND_MSR 0
+#define PERFCOUNTER_BACKEND_PERF 1
+
+//Maximum number of members of a perf event group, leader excluded
+#define PERFCOUNTER_MAX_GROUP_MEMBERS 7
+
 class PerformanceCounter {
 protected:
 
@@ -42,6 +53,27 @@ protected:
 
 	MSRObject *snapshotRegister;
 
+	static int backend;
+	bool directAccess; //Counter is always programmed through MSRs, whatever the backend is
+
+	//perf_event_open backend, per-cpu data
+	DWORD cpuCount;
+	bool perfEvents; //Counter has been programmed through perf_event_open
+	int *perfFds;
+	uint64_t *perfValues;
+	uint64_t *perfTimeEnabled;
+	uint64_t *perfTimeRunning;
+	void **perfPages; //Per-cpu mmap'd perf user pages, used for rdpmc reads
+
+	PerformanceCounter *groupLeader;
+	PerformanceCounter *groupMembers[PERFCOUNTER_MAX_GROUP_MEMBERS];
+	unsigned int groupMemberCount;
+
+	bool programPerfEvents ();
+	bool enablePerfEvents (bool enable);
+	bool readPerfEvents ();
+	void closePerfEvents ();
+
 public:
 	PerformanceCounter(PROCESSORMASK cpuMask, DWORD slot, DWORD maxslots);
 
@@ -51,12 +83,27 @@ public:
 	bool disable ();
 	bool takeSnapshot ();
 	uint64_t getCounter (DWORD cpuIndex);
-	unsigned int findAvailableSlot ();
-	unsigned int findFreeSlot ();
+	bool readLocal (DWORD cpuIndex, uint64_t *value);
+	unsigned int findAvailableSlot (DWORD slotMask = PERFCOUNTER_ALL_SLOTS);
+	unsigned int findFreeSlot (unsigned int firstSlot = 0);
+
+	static uint64_t counterDelta (uint64_t prev, uint64_t current);
+	uint64_t getRawConfig () const;
+
+	static bool setBackend (int backend);
+	static int getBackend ();
+
+	bool setGroupLeader (PerformanceCounter *leader);
+	uint64_t getTimeEnabled (DWORD cpuIndex) const;
+	uint64_t getTimeRunning (DWORD cpuIndex) const;
+
+	bool mapPerfPages ();
+	bool readPerfPage (DWORD cpuIndex, uint64_t *value) const;
 
 	virtual ~PerformanceCounter();
 
 	bool getEnabled () const;
+	bool getPerfEvents () const;
 	bool getCountUserMode() const;
 	unsigned char getCounterMask() const;
 	PROCESSORMASK getCpuMask() const;
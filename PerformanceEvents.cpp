@@ -0,0 +1,318 @@
+/*
+ * PerformanceEvents.cpp
+ *
+ * Catalog of the performance counter events that are most useful to monitor the processor. Each event
+ * maps a symbolic name to the eventSelect/unitMask pair that must be programmed in the performance
+ * counter and carries the set of families the event is valid for.
+ *
+ * The same name can appear more than once when a family uses a different encoding for the same
+ * quantity (eg: Family 15h data cache misses use unit mask 0x01), lookups always return the first
+ * entry that matches the current family.
+ *
+ * Northbridge events are counted once per node: by the core performance counters of one core per node
+ * on Family 10h, by the northbridge performance counters on Family 15h (see NorthbridgeCounter).
+ *
+ * Family 15h core counters are not symmetric: some events can be counted only on a subset of the
+ * PERF_CTL slots, see the constraints table and planSlots().
+ *
+ * References are the BKDG manuals for each family, chapter "Core Performance Counters" and
+ * "Northbridge Performance Counters".
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "PerformanceEvents.h"
+#include "PerformanceCounter.h"
+
+#define FAM_K10 (EVENT_FAMILY_10H | EVENT_FAMILY_11H | EVENT_FAMILY_12H | EVENT_FAMILY_14H)
+
+const struct PerformanceEvent PerformanceEvents::catalog[] = {
+
+	//Floating point
+	{ "fpu-ops", 0x00, 0x3f, FAM_K10, EVENT_SOURCE_CORE, "Dispatched FPU operations" },
+	{ "fpu-ops", 0x00, 0x0f, EVENT_FAMILY_15H, EVENT_SOURCE_CORE, "FPU pipe assignment" },
+	{ "fpu-empty", 0x01, 0x00, EVENT_FAMILY_ALL, EVENT_SOURCE_CORE, "Cycles in which the FPU is empty" },
+	{ "sse-ops", 0x03, 0x7f, FAM_K10, EVENT_SOURCE_CORE, "Retired SSE operations" },
+	{ "sse-ops", 0x03, 0xff, EVENT_FAMILY_15H, EVENT_SOURCE_CORE, "Retired SSE/AVX operations" },
+
+	//Load/store and data cache
+	{ "locked-ops", 0x24, 0x01, EVENT_FAMILY_ALL, EVENT_SOURCE_CORE, "Locked instructions executed" },
+	{ "locked-cycles", 0x24, 0x04, EVENT_FAMILY_10H | EVENT_FAMILY_15H, EVENT_SOURCE_CORE, "Cycles in the non-speculative phase of locked ops" },
+	{ "dc-accesses", 0x40, 0x00, EVENT_FAMILY_ALL, EVENT_SOURCE_CORE, "Data cache accesses" },
+	{ "dc-misses", 0x41, 0x00, FAM_K10, EVENT_SOURCE_CORE, "Data cache misses" },
+	{ "dc-misses", 0x41, 0x01, EVENT_FAMILY_15H, EVENT_SOURCE_CORE, "Data cache misses" },
+	{ "dc-refills-l2", 0x42, 0x1f, FAM_K10, EVENT_SOURCE_CORE, "Data cache refills from L2" },
+	{ "dc-refills-nb", 0x43, 0x1f, FAM_K10, EVENT_SOURCE_CORE, "Data cache refills from northbridge" },
+	{ "dtlb-l2-hits", 0x45, 0x07, EVENT_FAMILY_ALL, EVENT_SOURCE_CORE, "L1 DTLB misses that hit L2 DTLB" },
+	{ "dtlb-l2-misses", 0x46, 0x07, EVENT_FAMILY_ALL, EVENT_SOURCE_CORE, "L1 DTLB and L2 DTLB misses" },
+	{ "dc-misaligned", 0x47, 0x00, EVENT_FAMILY_ALL, EVENT_SOURCE_CORE, "Data cache misaligned accesses" },
+	{ "refills-dirty", 0x6c, 0x0a, EVENT_FAMILY_10H | EVENT_FAMILY_15H, EVENT_SOURCE_CORE, "Refills from system in Modified or Owned state" },
+
+	//Core clock
+	{ "cycles", 0x76, 0x00, EVENT_FAMILY_ALL, EVENT_SOURCE_CORE, "CPU clocks not halted" },
+
+	//L2 cache
+	{ "l2-requests", 0x7d, 0x07, EVENT_FAMILY_ALL, EVENT_SOURCE_CORE, "L2 fill requests (IC, DC and TLB)" },
+	{ "l2-misses", 0x7e, 0x07, EVENT_FAMILY_ALL, EVENT_SOURCE_CORE, "L2 fill misses (IC, DC and TLB)" },
+
+	//Instruction cache
+	{ "ic-fetches", 0x80, 0x00, EVENT_FAMILY_ALL, EVENT_SOURCE_CORE, "Instruction cache fetches" },
+	{ "ic-misses", 0x81, 0x00, EVENT_FAMILY_ALL, EVENT_SOURCE_CORE, "Instruction cache misses" },
+
+	//Execution
+	{ "instructions", 0xc0, 0x00, EVENT_FAMILY_ALL, EVENT_SOURCE_CORE, "Retired instructions" },
+	{ "uops", 0xc1, 0x00, EVENT_FAMILY_ALL, EVENT_SOURCE_CORE, "Retired uops" },
+	{ "branches", 0xc2, 0x00, EVENT_FAMILY_ALL, EVENT_SOURCE_CORE, "Retired branch instructions" },
+	{ "branch-misses", 0xc3, 0x00, EVENT_FAMILY_ALL, EVENT_SOURCE_CORE, "Retired mispredicted branch instructions" },
+
+	//Dispatch stalls
+	{ "stall-decoder", 0xd0, 0x00, FAM_K10, EVENT_SOURCE_CORE, "Decoder empty" },
+	{ "stall-dispatch", 0xd1, 0x00, EVENT_FAMILY_ALL, EVENT_SOURCE_CORE, "Dispatch stalls" },
+	{ "stall-branch-abort", 0xd2, 0x00, FAM_K10, EVENT_SOURCE_CORE, "Dispatch stall for branch abort to retire" },
+	{ "stall-serialization", 0xd3, 0x00, EVENT_FAMILY_ALL, EVENT_SOURCE_CORE, "Dispatch stall for serialization" },
+	{ "stall-rob-full", 0xd5, 0x00, EVENT_FAMILY_ALL, EVENT_SOURCE_CORE, "Dispatch stall for reorder buffer full" },
+	{ "stall-rs-full", 0xd6, 0x00, EVENT_FAMILY_ALL, EVENT_SOURCE_CORE, "Dispatch stall for scheduler full" },
+	{ "stall-fpu-full", 0xd7, 0x00, EVENT_FAMILY_ALL, EVENT_SOURCE_CORE, "Dispatch stall for FPU full" },
+	{ "stall-ls-full", 0xd8, 0x00, EVENT_FAMILY_ALL, EVENT_SOURCE_CORE, "Dispatch stall for load/store full" },
+
+	//Northbridge: memory controller
+	{ "dram-accesses", 0xe0, 0x3f, EVENT_FAMILY_10H | EVENT_FAMILY_15H, EVENT_SOURCE_NB, "DRAM accesses, both DCTs" },
+	{ "dram-dct0", 0xe0, 0x07, EVENT_FAMILY_10H | EVENT_FAMILY_15H, EVENT_SOURCE_NB, "DRAM accesses, DCT0" },
+	{ "dram-dct1", 0xe0, 0x38, EVENT_FAMILY_10H | EVENT_FAMILY_15H, EVENT_SOURCE_NB, "DRAM accesses, DCT1" },
+	{ "dram-requests", 0x1e0, 0xff, EVENT_FAMILY_10H | EVENT_FAMILY_15H, EVENT_SOURCE_NB, "CPU to DRAM requests, all target nodes" },
+	{ "mem-local", 0xe9, 0xa8, EVENT_FAMILY_10H | EVENT_FAMILY_15H, EVENT_SOURCE_NB, "Local CPU requests to local memory" },
+	{ "mem-remote", 0xe9, 0x98, EVENT_FAMILY_10H | EVENT_FAMILY_15H, EVENT_SOURCE_NB, "Local CPU requests to remote memory" },
+	{ "probe-responses", 0xec, 0x0f, EVENT_FAMILY_10H | EVENT_FAMILY_15H, EVENT_SOURCE_NB, "Probe responses" },
+	{ "probe-hit-dirty", 0xec, 0x0c, EVENT_FAMILY_10H | EVENT_FAMILY_15H, EVENT_SOURCE_NB, "Probe hits on dirty lines" },
+	{ "mc-reads", 0x1f0, 0x02, EVENT_FAMILY_10H | EVENT_FAMILY_15H, EVENT_SOURCE_NB, "Memory controller read requests" },
+	{ "mc-writes", 0x1f0, 0x01, EVENT_FAMILY_10H | EVENT_FAMILY_15H, EVENT_SOURCE_NB, "Memory controller write requests" },
+
+	//Northbridge: hypertransport links
+	{ "ht-link0", 0xf6, 0x37, EVENT_FAMILY_10H | EVENT_FAMILY_15H, EVENT_SOURCE_NB, "HT link 0 transmit bandwidth (no NOPs)" },
+	{ "ht-link1", 0xf7, 0x37, EVENT_FAMILY_10H | EVENT_FAMILY_15H, EVENT_SOURCE_NB, "HT link 1 transmit bandwidth (no NOPs)" },
+	{ "ht-link2", 0xf8, 0x37, EVENT_FAMILY_10H | EVENT_FAMILY_15H, EVENT_SOURCE_NB, "HT link 2 transmit bandwidth (no NOPs)" },
+	{ "ht-link3", 0xf9, 0x37, EVENT_FAMILY_10H, EVENT_SOURCE_NB, "HT link 3 transmit bandwidth (no NOPs)" },
+	{ "ht-link3", 0x1f9, 0x37, EVENT_FAMILY_15H, EVENT_SOURCE_NB, "HT link 3 transmit bandwidth (no NOPs)" },
+
+	//Northbridge: L3 cache, all cores
+	{ "l3-requests", 0x4e0, 0xf7, EVENT_FAMILY_10H | EVENT_FAMILY_15H, EVENT_SOURCE_NB, "L3 read requests" },
+	{ "l3-misses", 0x4e1, 0xf7, EVENT_FAMILY_10H | EVENT_FAMILY_15H, EVENT_SOURCE_NB, "L3 misses" },
+
+	{ NULL, 0, 0, 0, 0, NULL }
+};
+
+//The first range containing the event applies, events in no range can use any slot
+const struct PerformanceEventConstraint PerformanceEvents::constraints[] = {
+
+	{ 0x003, 0x003, EVENT_FAMILY_15H, 0x08 }, //Retired SSE/AVX operations, PERF_CTL[3]
+	{ 0x000, 0x01f, EVENT_FAMILY_15H, 0x38 }, //Floating point, PERF_CTL[5:3]
+	{ 0x023, 0x023, EVENT_FAMILY_15H, 0x07 }, //Load/store and data cache, PERF_CTL[2:0]
+	{ 0x043, 0x043, EVENT_FAMILY_15H, 0x07 },
+	{ 0x045, 0x046, EVENT_FAMILY_15H, 0x07 },
+	{ 0x054, 0x055, EVENT_FAMILY_15H, 0x07 },
+	{ 0x076, 0x076, EVENT_FAMILY_15H, PERFCOUNTER_ALL_SLOTS }, //CPU clocks not halted
+	{ 0x060, 0x09f, EVENT_FAMILY_15H, 0x07 }, //Compute unit, L2 cache and instruction cache, PERF_CTL[2:0]
+	{ 0x0d0, 0x0df, EVENT_FAMILY_15H, 0x07 }, //Decoder and dispatch stalls, PERF_CTL[2:0]
+
+	{ 0, 0, 0, 0 }
+};
+
+/*
+ * Converts the extended family reported by the processor (eg: 0x10 for Family 10h) to the
+ * family flag used in the catalog. Returns 0 for unknown families.
+ */
+DWORD PerformanceEvents::getFamilyFlag (int familyExtended)
+{
+	switch (familyExtended)
+	{
+		case 0x10: return EVENT_FAMILY_10H;
+		case 0x11: return EVENT_FAMILY_11H;
+		case 0x12: return EVENT_FAMILY_12H;
+		case 0x14: return EVENT_FAMILY_14H;
+		case 0x15: return EVENT_FAMILY_15H;
+	}
+
+	return 0;
+}
+
+/*
+ * Returns the catalog entry for name on family, or NULL if the event is unknown for that family
+ */
+const struct PerformanceEvent *PerformanceEvents::find (const char *name, DWORD family)
+{
+	unsigned int i;
+
+	for (i = 0; catalog[i].name != NULL; i++)
+		if ((catalog[i].families & family) && strcmp(catalog[i].name, name) == 0)
+			return &catalog[i];
+
+	return NULL;
+}
+
+/*
+ * Parses an event specification in the form name[:unitmask] or eventselect[:unitmask], where
+ * numeric values may be decimal or hexadecimal (0x prefix). A unit mask, if present, overrides the
+ * catalog one. Raw events are always considered core events.
+ *
+ * Returns true and fills event if the specification is valid, else returns false
+ */
+bool PerformanceEvents::parse (const char *spec, DWORD family, struct PerformanceEvent *event)
+{
+	char name[64];
+	const char *separator;
+	const struct PerformanceEvent *entry;
+	char *end;
+	unsigned long value;
+	size_t length;
+
+	separator = strchr(spec, ':');
+	length = (separator != NULL) ? (size_t) (separator - spec) : strlen(spec);
+
+	if (length == 0 || length >= sizeof(name))
+		return false;
+
+	strncpy(name, spec, length);
+	name[length] = '\0';
+
+	entry = find(name, family);
+
+	if (entry != NULL)
+	{
+		*event = *entry;
+	}
+	else
+	{
+		value = strtoul(name, &end, 0);
+
+		//Event select is 12 bits wide
+		if (*end != '\0' || value > 0xfff)
+			return false;
+
+		event->name = NULL;
+		event->eventSelect = (unsigned short int) value;
+		event->unitMask = 0;
+		event->families = family;
+		event->source = EVENT_SOURCE_CORE;
+		event->description = NULL;
+	}
+
+	if (separator != NULL)
+	{
+		value = strtoul(separator + 1, &end, 0);
+
+		if (separator[1] == '\0' || *end != '\0' || value > 0xff)
+			return false;
+
+		event->unitMask = (unsigned char) value;
+	}
+
+	return true;
+}
+
+/*
+ * Returns the mask of the core counter slots eventSelect can be counted on, on family
+ */
+DWORD PerformanceEvents::getSlotMask (unsigned short int eventSelect, DWORD family)
+{
+	unsigned int i;
+
+	for (i = 0; constraints[i].families != 0; i++)
+		if ((constraints[i].families & family) && eventSelect >= constraints[i].firstEvent &&
+				eventSelect <= constraints[i].lastEvent)
+			return constraints[i].slotMask;
+
+	return PERFCOUNTER_ALL_SLOTS;
+}
+
+//Number of slots in mask
+static unsigned int countSlots (DWORD mask)
+{
+	unsigned int count;
+
+	for (count = 0; mask != 0; mask &= mask - 1)
+		count++;
+
+	return count;
+}
+
+/*
+ * Plans the slots of count core events counted together on maxSlots slots. Constrained events
+ * reserve the lowest slot they allow, the ones allowed on fewer slots first (eg: sse-ops, only
+ * PERF_CTL[3], before the other floating point events) and lose the slots reserved by tighter
+ * ones; the other events get the slots left over, so they can be programmed in any order without
+ * taking a slot a constrained event needs.
+ *
+ * Returns true and fills slotMasks, to be given to findAvailableSlot(), if all the events fit,
+ * else returns false
+ */
+bool PerformanceEvents::planSlots (const struct PerformanceEvent *const *events, unsigned int count, DWORD family,
+		unsigned int maxSlots, DWORD *slotMasks)
+{
+	DWORD allSlots, reserved, tighter, available;
+	unsigned int i, width, unconstrained;
+
+	allSlots = (maxSlots >= 32) ? PERFCOUNTER_ALL_SLOTS : ((DWORD) 1 << maxSlots) - 1;
+	reserved = 0;
+	unconstrained = 0;
+
+	for (i = 0; i < count; i++)
+	{
+		slotMasks[i] = getSlotMask(events[i]->eventSelect, family) & allSlots;
+
+		if (slotMasks[i] == allSlots)
+			unconstrained++;
+	}
+
+	for (width = 0; width < countSlots(allSlots); width++)
+	{
+		tighter = reserved;
+
+		for (i = 0; i < count; i++)
+		{
+			if (slotMasks[i] == allSlots || countSlots(slotMasks[i]) != width)
+				continue;
+
+			available = slotMasks[i] & ~reserved;
+
+			if (available == 0)
+				return false;
+
+			reserved |= available & (~available + 1);
+			slotMasks[i] &= ~tighter;
+		}
+	}
+
+	if (unconstrained > countSlots(allSlots & ~reserved))
+		return false;
+
+	for (i = 0; i < count; i++)
+		if (slotMasks[i] == allSlots)
+			slotMasks[i] = allSlots & ~reserved;
+
+	return true;
+}
+
+/*
+ * Prints the events available on family
+ */
+void PerformanceEvents::printCatalog (DWORD family)
+{
+	unsigned int i;
+
+	printf("Event\t\t\tEvtSel\tuMsk\tSrc\tDescription\n");
+
+	for (i = 0; catalog[i].name != NULL; i++)
+	{
+		if (!(catalog[i].families & family))
+			continue;
+
+		printf("%-24s0x%03x\t0x%02x\t%s\t%s\n",
+				catalog[i].name,
+				catalog[i].eventSelect,
+				catalog[i].unitMask,
+				(catalog[i].source == EVENT_SOURCE_NB) ? "nb" : "core",
+				catalog[i].description);
+	}
+}
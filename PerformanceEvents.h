@@ -0,0 +1,62 @@
+/*
+ * PerformanceEvents.h
+ *
+ * Per-family catalog of performance counter events
+ *
+ */
+
+#ifndef PERFORMANCEEVENTS_H_
+#define PERFORMANCEEVENTS_H_
+
+#include "Processor.h"
+
+//Families an event is available on
+#define EVENT_FAMILY_10H 0x01
+#define EVENT_FAMILY_11H 0x02
+#define EVENT_FAMILY_12H 0x04
+#define EVENT_FAMILY_14H 0x08
+#define EVENT_FAMILY_15H 0x10
+#define EVENT_FAMILY_ALL 0x1f
+
+//Core events are counted by each core, northbridge events are shared by all the cores of a node
+#define EVENT_SOURCE_CORE 0
+#define EVENT_SOURCE_NB 1
+
+struct PerformanceEvent {
+	const char *name;
+	unsigned short int eventSelect;
+	unsigned char unitMask;
+	DWORD families;
+	int source;
+	const char *description;
+};
+
+//Core counter slots a range of events can be counted on, one bit per PERF_CTL
+struct PerformanceEventConstraint {
+	unsigned short int firstEvent;
+	unsigned short int lastEvent;
+	DWORD families;
+	DWORD slotMask;
+};
+
+class PerformanceEvents {
+
+	static const struct PerformanceEvent catalog[];
+	static const struct PerformanceEventConstraint constraints[];
+
+public:
+
+	static DWORD getFamilyFlag (int familyExtended);
+
+	static const struct PerformanceEvent *find (const char *name, DWORD family);
+	static bool parse (const char *spec, DWORD family, struct PerformanceEvent *event);
+
+	static DWORD getSlotMask (unsigned short int eventSelect, DWORD family);
+	static bool planSlots (const struct PerformanceEvent *const *events, unsigned int count, DWORD family,
+			unsigned int maxSlots, DWORD *slotMasks);
+
+	static void printCatalog (DWORD family);
+
+};
+
+#endif /* PERFORMANCEEVENTS_H_ */
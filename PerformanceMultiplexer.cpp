@@ -0,0 +1,450 @@
+/*
+ * PerformanceMultiplexer.cpp
+ *
+ * PerformanceMultiplexer allows to count more events than the available performance counter slots.
+ * Events are organized in groups: all the events of a group are counted at the same time, so ratios
+ * between events of the same group are exact. Groups take turns on the slots, each one for a time
+ * quantum, and counts are then scaled to the whole window:
+ *
+ * 		scaled count = raw count * enabled time / running time
+ *
+ * where enabled time is the length of the window and running time is the time the group actually
+ * spent on the counters. When there is only one group, it is never rotated and running time equals
+ * the enabled time, so counts are not scaled at all.
+ *
+ * Some Family 15h events can be counted only on a subset of the slots (see PerformanceEvents::planSlots()):
+ * addEvent() refuses an event that does not fit its group, start() gives each event a free slot it
+ * is allowed on.
+ *
+ * Instructions on how to use:
+ *
+ * 1 - Instantiate the object giving a cpuMask, the number of slots and the family flag of the processor
+ * 2 - Add groups with addGroup() and events to groups with addEvent()
+ * 3 - Call start() to assign free slots to the events and schedule in the first group
+ * 4 - Call rotate() once per quantum: it accumulates the counts of the current group and
+ * 		schedules in the next one
+ * 5 - At the end of a window, read counts with getScaledCount() and start a new window with
+ * 		resetCounts()
+ * 6 - Call stop() to disable the counters
+ *
+ */
+
+#include <string.h>
+
+#include "PerformanceMultiplexer.h"
+#include "TSCClock.h"
+
+PerformanceMultiplexer::PerformanceMultiplexer (PROCESSORMASK cpuMask, unsigned int maxslots, DWORD family)
+{
+	DWORD cpu;
+
+	this->cpuMask = cpuMask;
+	this->cpuCount = 0;
+
+	for (cpu = 0; cpu < MAX_CORES; cpu++)
+		if (cpuMask & ((PROCESSORMASK)1 << cpu))
+			this->cpuCount++;
+
+	if (maxslots > MULTIPLEXER_MAX_EVENTS)
+		maxslots = MULTIPLEXER_MAX_EVENTS;
+
+	this->maxslots = maxslots;
+	this->family = family;
+
+	this->groupCount = 0;
+	this->currentGroup = 0;
+
+	this->quantum = MULTIPLEXER_DEFAULT_QUANTUM;
+	this->running = false;
+
+	this->windowStart = 0;
+	this->scheduledAt = 0;
+	this->lastRotation = 0;
+}
+
+/*
+ * Adds an empty group. Returns the group index, or -1 (0xffffffff) if there are too many groups
+ */
+unsigned int PerformanceMultiplexer::addGroup ()
+{
+	if (groupCount >= MULTIPLEXER_MAX_GROUPS || running)
+		return -1;
+
+	groups[groupCount].eventCount = 0;
+	groups[groupCount].runningTime = 0;
+
+	return groupCount++;
+}
+
+/*
+ * Plans the slots of the first eventCount events of a group, see PerformanceEvents::planSlots().
+ * Returns false if the events can't be counted together
+ */
+bool PerformanceMultiplexer::planGroup (unsigned int group, unsigned int eventCount, DWORD *slotMasks) const
+{
+	const struct PerformanceEvent *events[MULTIPLEXER_MAX_EVENTS];
+	unsigned int event;
+
+	for (event = 0; event < eventCount; event++)
+		events[event] = &groups[group].events[event];
+
+	return PerformanceEvents::planSlots(events, eventCount, family, maxslots, slotMasks);
+}
+
+/*
+ * Adds an event to a group. Events are counted both in user and in OS mode.
+ * Returns the event index in the group, or -1 (0xffffffff) if the group is full or the slots
+ * the event is allowed on are taken by the other events of the group
+ */
+unsigned int PerformanceMultiplexer::addEvent (unsigned int group, unsigned short int eventSelect, unsigned char unitMask)
+{
+	struct MultiplexGroup *g;
+	PerformanceCounter *perfCounter;
+	DWORD slotMasks[MULTIPLEXER_MAX_EVENTS];
+
+	if (group >= groupCount || running)
+		return -1;
+
+	g = &groups[group];
+
+	if (g->eventCount >= maxslots)
+		return -1;
+
+	memset(&g->events[g->eventCount], 0, sizeof(struct PerformanceEvent));
+	g->events[g->eventCount].eventSelect = eventSelect;
+	g->events[g->eventCount].unitMask = unitMask;
+
+	if (!planGroup(group, g->eventCount + 1, slotMasks))
+		return -1;
+
+	perfCounter = new PerformanceCounter(cpuMask, 0, maxslots);
+
+	perfCounter->setEventSelect(eventSelect);
+	perfCounter->setCountOsMode(true);
+	perfCounter->setCountUserMode(true);
+	perfCounter->setCounterMask(0);
+	perfCounter->setEdgeDetect(false);
+	perfCounter->setEnableAPICInterrupt(false);
+	perfCounter->setInvertCntMask(false);
+	perfCounter->setUnitMask(unitMask);
+
+	//With the perf backend the first event leads the group, so the kernel schedules the
+	//events of the group together and they are read atomically
+	if (g->eventCount > 0 && PerformanceCounter::getBackend() == PERFCOUNTER_BACKEND_PERF)
+		perfCounter->setGroupLeader(g->counters[0]);
+
+	g->counters[g->eventCount] = perfCounter;
+	g->startValues[g->eventCount] = (uint64_t *) calloc(cpuCount, sizeof(uint64_t));
+	g->counts[g->eventCount] = (uint64_t *) calloc(cpuCount, sizeof(uint64_t));
+
+	return g->eventCount++;
+}
+
+//Quantum is expressed in milliseconds
+void PerformanceMultiplexer::setQuantum (DWORD quantum)
+{
+	if (quantum == 0)
+		quantum = 1;
+
+	this->quantum = quantum;
+}
+
+DWORD PerformanceMultiplexer::getQuantum () const
+{
+	return quantum;
+}
+
+/*
+ * Programs, enables and takes the starting values of all the counters of a group. With the perf
+ * backend the events of a group are opened the first time it is scheduled in and then stay open:
+ * rotations just switch them on and off with PERF_EVENT_IOC_ENABLE/DISABLE
+ */
+bool PerformanceMultiplexer::scheduleIn (unsigned int group)
+{
+	struct MultiplexGroup *g;
+	unsigned int event;
+	DWORD cpuIndex;
+
+	g = &groups[group];
+	currentGroup = group;
+
+	for (event = 0; event < g->eventCount; event++)
+	{
+		if (!g->counters[event]->getPerfEvents() && !g->counters[event]->program())
+			return false;
+
+		if (!g->counters[event]->enable())
+			return false;
+	}
+
+	for (event = 0; event < g->eventCount; event++)
+	{
+		if (!g->counters[event]->takeSnapshot())
+			return false;
+
+		for (cpuIndex = 0; cpuIndex < cpuCount; cpuIndex++)
+			g->startValues[event][cpuIndex] = g->counters[event]->getCounter(cpuIndex);
+	}
+
+	scheduledAt = TSCClock::getNanoseconds();
+
+	return true;
+}
+
+/*
+ * Reads the counters of the group and accumulates events counted since the group has been
+ * scheduled in. Counters are left enabled.
+ */
+bool PerformanceMultiplexer::scheduleOut (unsigned int group, uint64_t now)
+{
+	struct MultiplexGroup *g;
+	unsigned int event;
+	DWORD cpuIndex;
+	uint64_t value;
+
+	g = &groups[group];
+
+	for (event = 0; event < g->eventCount; event++)
+	{
+		if (!g->counters[event]->takeSnapshot())
+			return false;
+
+		for (cpuIndex = 0; cpuIndex < cpuCount; cpuIndex++)
+		{
+			value = g->counters[event]->getCounter(cpuIndex);
+			g->counts[event][cpuIndex] += PerformanceCounter::counterDelta(g->startValues[event][cpuIndex], value);
+			g->startValues[event][cpuIndex] = value;
+		}
+	}
+
+	g->runningTime += now - scheduledAt;
+	scheduledAt = now;
+
+	return true;
+}
+
+/*
+ * Gives each event the lowest free slot it is allowed on, groups take turns so they share the
+ * same free slots, and schedules in the first group.
+ *
+ * Returns true if successful, false if an event finds none of its allowed slots free or in case
+ * of errors
+ */
+bool PerformanceMultiplexer::start ()
+{
+	PerformanceCounter *probe;
+	DWORD freeSlots, used, available, slotMasks[MULTIPLEXER_MAX_EVENTS];
+	unsigned int group, event, slot;
+
+	if (running || groupCount == 0)
+		return false;
+
+	//findFreeSlot() returns -1 or -2 on failure, both beyond maxslots
+	probe = new PerformanceCounter(cpuMask, 0, maxslots);
+
+	freeSlots = 0;
+	slot = 0;
+	while ((slot = probe->findFreeSlot(slot)) < maxslots)
+		freeSlots |= (DWORD) 1 << slot++;
+
+	delete probe;
+
+	for (group = 0; group < groupCount; group++)
+	{
+		if (!planGroup(group, groups[group].eventCount, slotMasks))
+			return false;
+
+		used = 0;
+
+		for (event = 0; event < groups[group].eventCount; event++)
+		{
+			available = slotMasks[event] & freeSlots & ~used;
+
+			if (available == 0)
+				return false;
+
+			for (slot = 0; !((available >> slot) & 0x1); slot++)
+				;
+
+			used |= (DWORD) 1 << slot;
+			groups[group].slots[event] = slot;
+			groups[group].counters[event]->setSlot(slot);
+		}
+	}
+
+	resetCounts();
+
+	if (!scheduleIn(0))
+	{
+		for (event = 0; event < groups[0].eventCount; event++)
+			if (groups[0].counters[event]->getEnabled())
+				groups[0].counters[event]->disable();
+
+		return false;
+	}
+
+	windowStart = scheduledAt;
+	lastRotation = scheduledAt;
+	running = true;
+
+	return true;
+}
+
+/*
+ * Accumulates the counts of the current group and, if there is more than one group, replaces
+ * it with the next one on the counters
+ */
+bool PerformanceMultiplexer::rotate ()
+{
+	unsigned int event;
+	uint64_t now;
+
+	if (!running)
+		return false;
+
+	now = TSCClock::getNanoseconds();
+
+	if (!scheduleOut(currentGroup, now))
+		return false;
+
+	lastRotation = now;
+
+	if (groupCount == 1)
+		return true;
+
+	for (event = 0; event < groups[currentGroup].eventCount; event++)
+		groups[currentGroup].counters[event]->disable();
+
+	return scheduleIn((currentGroup + 1) % groupCount);
+}
+
+/*
+ * Disables the counters of the current group
+ */
+bool PerformanceMultiplexer::stop ()
+{
+	unsigned int event;
+	bool result;
+
+	if (!running)
+		return false;
+
+	result = true;
+
+	for (event = 0; event < groups[currentGroup].eventCount; event++)
+		if (!groups[currentGroup].counters[event]->disable())
+			result = false;
+
+	running = false;
+
+	return result;
+}
+
+/*
+ * Starts a new window, the group on the counters keeps running
+ */
+void PerformanceMultiplexer::resetCounts ()
+{
+	unsigned int group, event;
+
+	for (group = 0; group < groupCount; group++)
+	{
+		for (event = 0; event < groups[group].eventCount; event++)
+			memset(groups[group].counts[event], 0, cpuCount * sizeof(uint64_t));
+
+		groups[group].runningTime = 0;
+	}
+
+	windowStart = lastRotation;
+}
+
+/*
+ * Getters
+ */
+
+bool PerformanceMultiplexer::isMultiplexing () const
+{
+	return groupCount > 1;
+}
+
+DWORD PerformanceMultiplexer::getCount () const
+{
+	return cpuCount;
+}
+
+unsigned int PerformanceMultiplexer::getGroupCount () const
+{
+	return groupCount;
+}
+
+unsigned int PerformanceMultiplexer::getEventCount (unsigned int group) const
+{
+	return groups[group].eventCount;
+}
+
+//Slot used by an event of a group, valid after start()
+unsigned int PerformanceMultiplexer::getSlot (unsigned int group, unsigned int event) const
+{
+	return groups[group].slots[event];
+}
+
+//Length of the current window up to the last rotation, in nanoseconds
+uint64_t PerformanceMultiplexer::getEnabledTime () const
+{
+	return lastRotation - windowStart;
+}
+
+//Time the group spent on the counters in the current window, in nanoseconds
+uint64_t PerformanceMultiplexer::getRunningTime (unsigned int group) const
+{
+	return groups[group].runningTime;
+}
+
+uint64_t PerformanceMultiplexer::getRawCount (unsigned int group, unsigned int event, DWORD cpuIndex) const
+{
+	return groups[group].counts[event][cpuIndex];
+}
+
+/*
+ * Estimates the events counted in the whole window. The division is split to avoid
+ * overflows with long windows and big counts
+ */
+uint64_t PerformanceMultiplexer::getScaledCount (unsigned int group, unsigned int event, DWORD cpuIndex) const
+{
+	uint64_t count, enabled, runningTime;
+
+	count = groups[group].counts[event][cpuIndex];
+	runningTime = groups[group].runningTime;
+	enabled = getEnabledTime();
+
+	if (runningTime == 0)
+		return 0;
+
+	if (groupCount == 1 || runningTime >= enabled)
+		return count;
+
+	return (count / runningTime) * enabled + ((count % runningTime) * enabled) / runningTime;
+}
+
+/*
+ * Destructor. Stops the counters, if still running, and frees resources.
+ *
+ */
+
+PerformanceMultiplexer::~PerformanceMultiplexer ()
+{
+	unsigned int group, event;
+
+	if (running)
+		stop();
+
+	for (group = 0; group < groupCount; group++)
+	{
+		for (event = 0; event < groups[group].eventCount; event++)
+		{
+			delete groups[group].counters[event];
+			free(groups[group].startValues[event]);
+			free(groups[group].counts[event]);
+		}
+	}
+}
@@ -0,0 +1,81 @@
+/*
+ * PerformanceMultiplexer.h
+ *
+ * Time-sliced scheduler of performance counter groups
+ *
+ */
+
+#ifndef PERFORMANCEMULTIPLEXER_H_
+#define PERFORMANCEMULTIPLEXER_H_
+
+#include "Processor.h"
+#include "PerformanceCounter.h"
+#include "PerformanceEvents.h"
+
+#define MULTIPLEXER_MAX_GROUPS 16
+#define MULTIPLEXER_MAX_EVENTS 8 //Events per group, must not be lower than maxslots
+
+#define MULTIPLEXER_DEFAULT_QUANTUM 100 //Milliseconds
+
+struct MultiplexGroup {
+	unsigned int eventCount;
+	struct PerformanceEvent events[MULTIPLEXER_MAX_EVENTS];
+	unsigned int slots[MULTIPLEXER_MAX_EVENTS]; //Slots assigned by start()
+	PerformanceCounter *counters[MULTIPLEXER_MAX_EVENTS];
+	uint64_t *startValues[MULTIPLEXER_MAX_EVENTS]; //Per-cpu counter values when the group has been scheduled in
+	uint64_t *counts[MULTIPLEXER_MAX_EVENTS]; //Per-cpu events counted in the current window
+	uint64_t runningTime; //Nanoseconds the group has been on the counters in the current window
+};
+
+class PerformanceMultiplexer {
+protected:
+
+	PROCESSORMASK cpuMask;
+	DWORD cpuCount;
+	unsigned int maxslots;
+	DWORD family; //Family flag, selects the slot constraints of the events
+
+	struct MultiplexGroup groups[MULTIPLEXER_MAX_GROUPS];
+	unsigned int groupCount;
+	unsigned int currentGroup;
+
+	DWORD quantum;
+	bool running;
+
+	uint64_t windowStart; //Timestamp of the beginning of the current window
+	uint64_t scheduledAt; //Timestamp of the moment the current group has been scheduled in
+	uint64_t lastRotation; //Timestamp of the last call to rotate()
+
+	bool scheduleIn (unsigned int group);
+	bool scheduleOut (unsigned int group, uint64_t now);
+	bool planGroup (unsigned int group, unsigned int eventCount, DWORD *slotMasks) const;
+
+public:
+	PerformanceMultiplexer (PROCESSORMASK cpuMask, unsigned int maxslots, DWORD family);
+
+	unsigned int addGroup ();
+	unsigned int addEvent (unsigned int group, unsigned short int eventSelect, unsigned char unitMask);
+
+	void setQuantum (DWORD quantum);
+	DWORD getQuantum () const;
+
+	bool start ();
+	bool rotate ();
+	bool stop ();
+	void resetCounts ();
+
+	bool isMultiplexing () const;
+	DWORD getCount () const;
+	unsigned int getGroupCount () const;
+	unsigned int getEventCount (unsigned int group) const;
+	unsigned int getSlot (unsigned int group, unsigned int event) const;
+
+	uint64_t getEnabledTime () const;
+	uint64_t getRunningTime (unsigned int group) const;
+	uint64_t getRawCount (unsigned int group, unsigned int event, DWORD cpuIndex) const;
+	uint64_t getScaledCount (unsigned int group, unsigned int event, DWORD cpuIndex) const;
+
+	virtual ~PerformanceMultiplexer ();
+};
+
+#endif /* PERFORMANCEMULTIPLEXER_H_ */
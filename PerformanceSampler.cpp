@@ -0,0 +1,322 @@
+/*
+ * PerformanceSampler.cpp
+ *
+ * PerformanceSampler is the sample engine used by monitors and by the scaler. Each call to
+ * takeSnapshot() reads, in a single pass, all the registers the sampler has been configured for,
+ * stamps the sample with a TSCClock timestamp and computes per-cpu deltas against the previous
+ * snapshot. Metrics are then derived from those deltas only, so every value refers to the very
+ * same sampling window.
+ *
+ * Instructions on how to use:
+ *
+ * 1 - Instantiate the object giving a cpuMask. cpuIndex parameters of the getters are indexes
+ * 		in the cpuMask as explained in the getBits method in the MSRObject class
+ * 2 - Enable optional registers, like APERF/MPERF with setFrequencyCounters(), and add already
+ * 		programmed and enabled performance counters with addEventCounter(). The sampler does not own
+ * 		performance counters: the caller still has to disable and free them
+ * 3 - Call takeSnapshot() once to initialize the previous values, then once per tick
+ * 4 - Read deltas and metrics with getters. They are valid once isValid() returns true
+ *
+ * Frequency metrics come from MPERF (ticks at P0 frequency while in C0) and APERF (ticks
+ * at the actual frequency while in C0). Since on Family 10h and later processors the TSC
+ * ticks at P0 frequency too:
+ *
+ * - effective frequency is TSC frequency * deltaAPERF / deltaMPERF
+ * - busy percentage (time spent in C0) is deltaMPERF / deltaTSC
+ * - frequency invariant load (P0 capacity actually delivered) is deltaAPERF / deltaTSC, and
+ * 		may exceed 100% when the core is in a boosted state
+ *
+ */
+
+#include "PerformanceSampler.h"
+#include "TSCClock.h"
+
+PerformanceSampler::PerformanceSampler (PROCESSORMASK cpuMask)
+{
+	DWORD cpu;
+
+	this->cpuMask = cpuMask;
+	this->cpuCount = 0;
+
+	for (cpu = 0; cpu < MAX_CORES; cpu++)
+		if (cpuMask & ((PROCESSORMASK)1 << cpu))
+			this->cpuCount++;
+
+	this->frequencyCounters = false;
+
+	this->tscRegister = new MSRObject();
+	this->aperfRegister = new MSRObject();
+	this->mperfRegister = new MSRObject();
+
+	this->prevTSC = (uint64_t *) calloc(cpuCount, sizeof(uint64_t));
+	this->prevAPERF = (uint64_t *) calloc(cpuCount, sizeof(uint64_t));
+	this->prevMPERF = (uint64_t *) calloc(cpuCount, sizeof(uint64_t));
+
+	this->deltaTSC = (uint64_t *) calloc(cpuCount, sizeof(uint64_t));
+	this->deltaAPERF = (uint64_t *) calloc(cpuCount, sizeof(uint64_t));
+	this->deltaMPERF = (uint64_t *) calloc(cpuCount, sizeof(uint64_t));
+
+	this->eventCount = 0;
+
+	this->timestamp = 0;
+	this->elapsed = 0;
+	this->snapshots = 0;
+}
+
+/*
+ * APERF and MPERF registers availability is reported by CPUID Function 0000_0006 reg ECX bit 0
+ */
+bool PerformanceSampler::isFrequencyCountersSupported ()
+{
+	DWORD eax, ebx, ecx, edx;
+
+	if (Cpuid(0x6, &eax, &ebx, &ecx, &edx) != TRUE)
+		return false;
+
+	return (ecx & 0x1);
+}
+
+/*
+ * Enables or disables APERF/MPERF sampling. Returns false if the processor has no such registers.
+ * Snapshots restart from scratch, so the next snapshot is not valid.
+ */
+bool PerformanceSampler::setFrequencyCounters (bool enable)
+{
+	if (enable && !isFrequencyCountersSupported())
+		return false;
+
+	this->frequencyCounters = enable;
+	this->snapshots = 0;
+
+	return true;
+}
+
+bool PerformanceSampler::getFrequencyCounters () const
+{
+	return frequencyCounters;
+}
+
+/*
+ * Adds a performance counter to the set of registers read on each snapshot. The counter must
+ * have the same cpuMask of the sampler.
+ * Snapshots restart from scratch, so the next snapshot is not valid.
+ *
+ * Returns the event index to be used with getEventDelta(), or -1 (0xffffffff) if the sampler
+ * cannot hold more counters
+ */
+unsigned int PerformanceSampler::addEventCounter (PerformanceCounter *perfCounter)
+{
+	if (eventCount >= SAMPLER_MAX_EVENTS)
+		return -1;
+
+	eventCounters[eventCount] = perfCounter;
+	prevEvents[eventCount] = (uint64_t *) calloc(cpuCount, sizeof(uint64_t));
+	deltaEvents[eventCount] = (uint64_t *) calloc(cpuCount, sizeof(uint64_t));
+
+	this->snapshots = 0;
+
+	return eventCount++;
+}
+
+unsigned int PerformanceSampler::getEventCount () const
+{
+	return eventCount;
+}
+
+/*
+ * Computes the delta between two readings of a free running register. If the current value is
+ * lower than the previous one, the register has been reset by someone else (some cpufreq drivers
+ * clear APERF and MPERF on each read), so the current value is the best delta we can get.
+ */
+uint64_t PerformanceSampler::registerDelta (uint64_t prev, uint64_t current)
+{
+	if (current < prev)
+		return current;
+
+	return current - prev;
+}
+
+/*
+ * Reads all the configured registers for all the cpus in the mask, stamps the sample and
+ * computes deltas against the previous snapshot.
+ *
+ * Returns true if the snapshot has been taken correctly, else returns false
+ */
+bool PerformanceSampler::takeSnapshot ()
+{
+	DWORD cpuIndex;
+	unsigned int eventIndex;
+	uint64_t now;
+	uint64_t value;
+
+	now = TSCClock::getNanoseconds();
+
+	for (eventIndex = 0; eventIndex < eventCount; eventIndex++)
+		if (!eventCounters[eventIndex]->takeSnapshot())
+			return false;
+
+	if (!tscRegister->readMSR(TIME_STAMP_COUNTER_REG, cpuMask))
+		return false;
+
+	if (frequencyCounters)
+	{
+		if (!mperfRegister->readMSR(MPERF_REG, cpuMask))
+			return false;
+
+		if (!aperfRegister->readMSR(APERF_REG, cpuMask))
+			return false;
+	}
+
+	for (cpuIndex = 0; cpuIndex < cpuCount; cpuIndex++)
+	{
+		value = tscRegister->getBits(cpuIndex, 0, 64);
+		deltaTSC[cpuIndex] = registerDelta(prevTSC[cpuIndex], value);
+		prevTSC[cpuIndex] = value;
+
+		if (frequencyCounters)
+		{
+			value = mperfRegister->getBits(cpuIndex, 0, 64);
+			deltaMPERF[cpuIndex] = registerDelta(prevMPERF[cpuIndex], value);
+			prevMPERF[cpuIndex] = value;
+
+			value = aperfRegister->getBits(cpuIndex, 0, 64);
+			deltaAPERF[cpuIndex] = registerDelta(prevAPERF[cpuIndex], value);
+			prevAPERF[cpuIndex] = value;
+		}
+
+		for (eventIndex = 0; eventIndex < eventCount; eventIndex++)
+		{
+			value = eventCounters[eventIndex]->getCounter(cpuIndex);
+			deltaEvents[eventIndex][cpuIndex] = PerformanceCounter::counterDelta(prevEvents[eventIndex][cpuIndex], value);
+			prevEvents[eventIndex][cpuIndex] = value;
+		}
+	}
+
+	elapsed = (snapshots > 0) ? now - timestamp : 0;
+	timestamp = now;
+	snapshots++;
+
+	return true;
+}
+
+/*
+ * Getters
+ */
+
+DWORD PerformanceSampler::getCount () const
+{
+	return cpuCount;
+}
+
+PROCESSORMASK PerformanceSampler::getCpuMask () const
+{
+	return cpuMask;
+}
+
+uint64_t PerformanceSampler::getTimestamp () const
+{
+	return timestamp;
+}
+
+uint64_t PerformanceSampler::getElapsed () const
+{
+	return elapsed;
+}
+
+//Deltas are meaningful only after two snapshots
+bool PerformanceSampler::isValid () const
+{
+	return snapshots > 1;
+}
+
+uint64_t PerformanceSampler::getTSCDelta (DWORD cpuIndex) const
+{
+	return deltaTSC[cpuIndex];
+}
+
+uint64_t PerformanceSampler::getAPERFDelta (DWORD cpuIndex) const
+{
+	return deltaAPERF[cpuIndex];
+}
+
+uint64_t PerformanceSampler::getMPERFDelta (DWORD cpuIndex) const
+{
+	return deltaMPERF[cpuIndex];
+}
+
+uint64_t PerformanceSampler::getEventDelta (unsigned int eventIndex, DWORD cpuIndex) const
+{
+	return deltaEvents[eventIndex][cpuIndex];
+}
+
+/*
+ * Metrics
+ */
+
+//Average frequency, in MHz, while the core was in C0
+DWORD PerformanceSampler::getEffectiveFrequency (DWORD cpuIndex) const
+{
+	if (deltaMPERF[cpuIndex] == 0)
+		return 0;
+
+	return (DWORD) (((TSCClock::getFrequency() / 1000000) * deltaAPERF[cpuIndex]) / deltaMPERF[cpuIndex]);
+}
+
+//Average frequency, in MHz, delivered over the whole sampling window (idle time counts as 0 MHz)
+DWORD PerformanceSampler::getDeliveredFrequency (DWORD cpuIndex) const
+{
+	uint64_t microseconds;
+
+	microseconds = TSCClock::cyclesToMicroseconds(deltaTSC[cpuIndex]);
+
+	if (microseconds == 0)
+		return 0;
+
+	return (DWORD) (deltaAPERF[cpuIndex] / microseconds);
+}
+
+//Percentage of the sampling window spent in C0
+DWORD PerformanceSampler::getBusy (DWORD cpuIndex) const
+{
+	if (deltaTSC[cpuIndex] == 0)
+		return 0;
+
+	return (DWORD) ((deltaMPERF[cpuIndex] * 100) / deltaTSC[cpuIndex]);
+}
+
+//Percentage of P0 capacity delivered in the sampling window, frequency invariant
+DWORD PerformanceSampler::getInvariantLoad (DWORD cpuIndex) const
+{
+	if (deltaTSC[cpuIndex] == 0)
+		return 0;
+
+	return (DWORD) ((deltaAPERF[cpuIndex] * 100) / deltaTSC[cpuIndex]);
+}
+
+/*
+ * Destructor. Frees resources.
+ *
+ */
+
+PerformanceSampler::~PerformanceSampler ()
+{
+	unsigned int eventIndex;
+
+	delete tscRegister;
+	delete aperfRegister;
+	delete mperfRegister;
+
+	free(prevTSC);
+	free(prevAPERF);
+	free(prevMPERF);
+
+	free(deltaTSC);
+	free(deltaAPERF);
+	free(deltaMPERF);
+
+	for (eventIndex = 0; eventIndex < eventCount; eventIndex++)
+	{
+		free(prevEvents[eventIndex]);
+		free(deltaEvents[eventIndex]);
+	}
+}
@@ -0,0 +1,81 @@
+/*
+ * PerformanceSampler.h
+ *
+ * Sample engine shared by monitors and scaler
+ *
+ */
+
+#ifndef PERFORMANCESAMPLER_H_
+#define PERFORMANCESAMPLER_H_
+
+#include "Processor.h"
+#include "MSRObject.h"
+#include "PerformanceCounter.h"
+
+//Maximum number of performance counters a sampler can read in a snapshot
+#define SAMPLER_MAX_EVENTS 32
+
+class PerformanceSampler {
+protected:
+
+	PROCESSORMASK cpuMask;
+	DWORD cpuCount;
+
+	bool frequencyCounters; //Samples APERF and MPERF too
+
+	MSRObject *tscRegister;
+	MSRObject *aperfRegister;
+	MSRObject *mperfRegister;
+
+	uint64_t *prevTSC;
+	uint64_t *prevAPERF;
+	uint64_t *prevMPERF;
+
+	uint64_t *deltaTSC;
+	uint64_t *deltaAPERF;
+	uint64_t *deltaMPERF;
+
+	unsigned int eventCount;
+	PerformanceCounter *eventCounters[SAMPLER_MAX_EVENTS];
+	uint64_t *prevEvents[SAMPLER_MAX_EVENTS];
+	uint64_t *deltaEvents[SAMPLER_MAX_EVENTS];
+
+	uint64_t timestamp; //Timestamp of the last snapshot, in nanoseconds
+	uint64_t elapsed; //Nanoseconds elapsed between the last two snapshots
+	unsigned int snapshots; //Number of snapshots taken so far
+
+	static uint64_t registerDelta (uint64_t prev, uint64_t current);
+
+public:
+	PerformanceSampler (PROCESSORMASK cpuMask);
+
+	static bool isFrequencyCountersSupported ();
+	bool setFrequencyCounters (bool enable);
+	bool getFrequencyCounters () const;
+
+	unsigned int addEventCounter (PerformanceCounter *perfCounter);
+	unsigned int getEventCount () const;
+
+	bool takeSnapshot ();
+
+	DWORD getCount () const;
+	PROCESSORMASK getCpuMask () const;
+	uint64_t getTimestamp () const;
+	uint64_t getElapsed () const;
+	bool isValid () const;
+
+	uint64_t getTSCDelta (DWORD cpuIndex) const;
+	uint64_t getAPERFDelta (DWORD cpuIndex) const;
+	uint64_t getMPERFDelta (DWORD cpuIndex) const;
+	uint64_t getEventDelta (unsigned int eventIndex, DWORD cpuIndex) const;
+
+	//Metrics
+	DWORD getEffectiveFrequency (DWORD cpuIndex) const;
+	DWORD getDeliveredFrequency (DWORD cpuIndex) const;
+	DWORD getBusy (DWORD cpuIndex) const;
+	DWORD getInvariantLoad (DWORD cpuIndex) const;
+
+	virtual ~PerformanceSampler ();
+};
+
+#endif /* PERFORMANCESAMPLER_H_ */
@@ -200,6 +200,11 @@ void Processor::showHTLink() {
 	return;
 }
 
+void Processor::showNUMADistance() {
+	printf ("\n\t(No NUMA distance informations available for this processor family)\n");
+	return;
+}
+
 void Processor::showHTC() {
 	printf ("\n\t(No detailed Hardware Thermal Control informations available for this processor family)\n");
 	return;
@@ -284,6 +289,125 @@ DWORD Processor::HTLinkToFreq (DWORD reg) {
 	}
 }
 
+/*
+ * Finds the node connected to node through the route (a request route bitmask, see printRoute).
+ * The routing table does not name the node at the other end of a link, so the neighbour is
+ * deduced: it is the node reached through route that every other node reached through the
+ * same route uses as a way back to node. Returns -1 if no neighbour can be deduced.
+ *
+ * Known limitation: the way back is read from the routes of the other nodes, so the deduction
+ * assumes symmetric routing, where a node reaches node and candidate through the same link only
+ * if candidate is on its way to node. The request routes of systems with asymmetric routing
+ * (a different path in each direction) can make the real neighbour fail the test or, more
+ * rarely, let a farther node pass it: such pairs are reported unreachable or with wrong hops.
+ */
+static int getRouteNeighbour(DWORD nodes, const DWORD *routes, DWORD node, DWORD route) {
+
+	DWORD candidate, other;
+	bool neighbour;
+
+	for (candidate = 0; candidate < nodes; candidate++) {
+
+		if (candidate == node || routes[node * nodes + candidate] != route)
+			continue;
+
+		neighbour = true;
+
+		for (other = 0; other < nodes; other++) {
+
+			if (other == node || other == candidate || routes[node * nodes + other] != route)
+				continue;
+
+			//A node between node and candidate would route them in different directions
+			if (routes[other * nodes + candidate] != routes[other * nodes + node])
+				neighbour = false;
+		}
+
+		if (neighbour)
+			return candidate;
+	}
+
+	return -1;
+}
+
+/*
+ * Builds the node-to-node hop matrix following the request routes. routes and hops are
+ * nodes by nodes matrices, routes[src * nodes + dst] is the request route of src to dst.
+ * Unreachable pairs get NUMA_UNREACHABLE hops.
+ */
+void Processor::computeNUMAHops(DWORD nodes, const DWORD *routes, DWORD *hops) {
+
+	DWORD src, dst, current, count;
+	int next;
+
+	for (src = 0; src < nodes; src++) {
+		for (dst = 0; dst < nodes; dst++) {
+
+			current = src;
+			count = 0;
+
+			while (current != dst && count < nodes) {
+
+				if (routes[current * nodes + dst] & HT_ROUTE_SELF)
+					break;
+
+				next = getRouteNeighbour(nodes, routes, current, routes[current * nodes + dst]);
+
+				if (next < 0)
+					break;
+
+				current = next;
+				count++;
+			}
+
+			hops[src * nodes + dst] = (current == dst) ? count : NUMA_UNREACHABLE;
+		}
+	}
+}
+
+DWORD Processor::NUMAHopsToDistance(DWORD hops) {
+
+	if (hops == NUMA_UNREACHABLE)
+		return NUMA_UNREACHABLE;
+
+	return NUMA_LOCAL_DISTANCE + (hops * NUMA_HOP_DISTANCE);
+}
+
+/*
+ * Prints the hop matrix and the same distances as a SLIT table, one row per node, in the format
+ * of /sys/devices/system/node/node<n>/distance
+ */
+void Processor::printNUMADistance(DWORD nodes, const DWORD *hops) {
+
+	DWORD src, dst;
+
+	printf("Hops:\n");
+	printf("node ");
+	for (dst = 0; dst < nodes; dst++)
+		printf("%4u", dst);
+	printf("\n");
+
+	for (src = 0; src < nodes; src++) {
+		printf("%4u ", src);
+		for (dst = 0; dst < nodes; dst++) {
+			if (hops[src * nodes + dst] == NUMA_UNREACHABLE)
+				printf("   -");
+			else
+				printf("%4u", hops[src * nodes + dst]);
+		}
+		printf("\n");
+	}
+
+	printf("\nSLIT distances:\n");
+
+	for (src = 0; src < nodes; src++) {
+		printf("node%u:", src);
+		for (dst = 0; dst < nodes; dst++)
+			printf(" %u", NUMAHopsToDistance(hops[src * nodes + dst]));
+		printf("\n");
+	}
+}
+
 void Processor::setSpecFamilyBase (int familyBase) {
 	this->familyBase=familyBase;
 }
@@ -406,6 +530,22 @@ DWORD Processor::getTDP ()
 	return this->TDP;
 }
 
+DWORD Processor::getCoresPerComputeUnit(void) {
+	return 1;
+}
+
+float Processor::getNodeTDPWatts(void) {
+	return -1;
+}
+
+float Processor::getPowerLimit(void) {
+	return -1;
+}
+
+bool Processor::setPowerLimit(float watts) {
+	return false;
+}
+
 
 int Processor::getMaxSlots ()
 {
@@ -730,6 +870,51 @@ void Processor::setHTLinkSpeed(DWORD, DWORD) {
 	return;
 }
 
+DWORD Processor::getHTLinkSpeed(DWORD link, DWORD Sublink) {
+	return 0;
+}
+
+DWORD Processor::getHTLinkWidth(DWORD link, DWORD Sublink, DWORD *WidthIn, DWORD *WidthOut, bool *pfCoherent, bool *pfUnganged) {
+
+	*WidthIn = 0;
+	*WidthOut = 0;
+	*pfCoherent = false;
+	*pfUnganged = false;
+
+	return 0;
+}
+
+/*
+ * Fills linkCapacity with the capacity in MB/s of each link of each node, HT_LINKS_PER_NODE
+ * links per node, zero for links not connected. Capacity of a link is its frequency (two
+ * transfers per clock) by its output width. Only sublink 0 is considered, which covers the
+ * whole link when ganged.
+ */
+void Processor::getHTLinkCapacity(DWORD *linkCapacity) {
+
+	DWORD WidthIn, WidthOut;
+	bool fCoherent, fUnganged;
+	DWORD i, link;
+
+	for (i = 0; i < getProcessorNodes(); i++) {
+
+		setNode(i);
+
+		for (link = 0; link < HT_LINKS_PER_NODE; link++) {
+
+			linkCapacity[i * HT_LINKS_PER_NODE + link] = 0;
+
+			getHTLinkWidth(link, 0, &WidthIn, &WidthOut, &fCoherent, &fUnganged);
+
+			if (WidthIn == 0 || WidthOut == 0)
+				continue;
+
+			//MB/s = MHz * 2 transfers per clock * width bits / 8
+			linkCapacity[i * HT_LINKS_PER_NODE + link] = (HTLinkToFreq(getHTLinkSpeed(link, 0)) * 2 * WidthOut) / 8;
+		}
+	}
+}
+
 //Various settings
 
 bool Processor::getC1EStatus() {
@@ -753,11 +938,71 @@ void Processor::perfMonitorCPUUsage() {
 	return;
 }
 
-void Processor::perfMonitorFPUUsage() {
+void Processor::perfMonitorFPUUsage(DWORD profilePeriod) {
+	return;
+}
+
+void Processor::perfMonitorDCMA(DWORD profilePeriod) {
+	return;
+}
+
+void Processor::perfMonitorEffectiveFrequency() {
+	return;
+}
+
+void Processor::perfMonitorEvents(const char *eventList, DWORD quantum, const char *attribution) {
+	return;
+}
+
+void Processor::perfCounterBenchmark() {
+	return;
+}
+
+void Processor::perfMonitorNorthbridge(const char *eventList) {
+	return;
+}
+
+void Processor::perfMonitorMemoryBandwidth() {
+	return;
+}
+
+void Processor::perfMonitorHTLink() {
+	return;
+}
+
+void Processor::perfMonitorNUMATraffic() {
+	return;
+}
+
+void Processor::perfMonitorDramPages() {
+	return;
+}
+
+void Processor::perfMonitorFPUModules() {
+	return;
+}
+
+void Processor::perfMonitorIBS(DWORD period) {
+	return;
+}
+
+void Processor::perfMonitorSamples(const char *eventSpec, DWORD period) {
+	return;
+}
+
+void Processor::perfMonitorIPC() {
+	return;
+}
+
+void Processor::perfMonitorCacheMPKI() {
+	return;
+}
+
+void Processor::perfMonitorDTLB() {
 	return;
 }
 
-void Processor::perfMonitorDCMA() {
+void Processor::perfMonitorCoherence() {
 	return;
 }
 
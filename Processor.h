@@ -53,11 +53,45 @@
 #define BASE_PERC_REG 0xc0010004
 #define TIME_STAMP_COUNTER_REG 0x00000010
 
+//Maximum and Actual Performance Frequency Clock Count registers (Family 10h and later)
+//MPERF increments at P0 frequency while the core is in C0, APERF at the actual frequency
+#define MPERF_REG 0x000000E7
+#define APERF_REG 0x000000E8
+
 //Family 15h Performance Registers
 #define BASE_PESR_REG_15 0xC0010200
 #define BASE_PERC_REG_15 0xC0010201
 #define APML_TDP_LIMIT_REG_15 0xC0010075
 
+//Performance counter slot mask, one bit per PERF_CTL, allowing all the slots
+#define PERFCOUNTER_ALL_SLOTS 0xffffffff
+
+//Family 15h Northbridge Performance Registers, shared by all the cores of a node
+#define BASE_NB_PESR_REG_15 0xC0010240
+#define BASE_NB_PERC_REG_15 0xC0010241
+#define NB_PERF_SLOTS_15 4
+
+//Instruction-Based Sampling op registers, Family 10h and later
+#define IBS_OP_CTL_REG 0xC0011033
+#define IBS_OP_RIP_REG 0xC0011034
+#define IBS_OP_DATA_REG 0xC0011035
+#define IBS_OP_DATA2_REG 0xC0011036
+#define IBS_OP_DATA3_REG 0xC0011037
+#define IBS_DC_LIN_AD_REG 0xC0011038
+#define IBS_DC_PHYS_AD_REG 0xC0011039
+
+//HyperTransport links per node, each one with a transmit bandwidth event
+#define HT_LINKS_PER_NODE 4
+
+//HyperTransport routing table has an entry per node, up to 8 nodes
+#define HT_ROUTE_MAX_NODES 8
+#define HT_ROUTE_SELF 0x1 //Request route bit 0 delivers to the node itself
+
+//SLIT-style distances: 10 is local memory, each HyperTransport hop adds 6, 255 is unreachable
+#define NUMA_LOCAL_DISTANCE 10
+#define NUMA_HOP_DISTANCE 6
+#define NUMA_UNREACHABLE 0xff
+
 //Performance Event constants (used for IDLE counting for CPU Usage
 //counter)
 #define IDLE_COUNTER_EAX 0x430076
@@ -93,6 +127,16 @@
 	DWORD pstate;DWORD vid;DWORD fid;DWORD did;
 };
 
+//DRAM page locality helper structure: static settings of a DCT
+struct dramPageSettings {
+	bool valid;
+	DWORD dataRate; //MT/s, twice the memory clock
+	DWORD Tcl, Trcd, Trp, Tras; //Memory clocks
+	bool bankSwizzle;
+	bool channelInterleave; //DCT select interleaving, node wide
+	bool ganged; //DCTs ganged as a 128 bit channel, Family 10h only
+};
+
 
 
 class PState {
@@ -102,6 +146,8 @@ public:
 	void setPState(DWORD);
 };
 
+class PerformanceCounter;
+
 class Processor {
 protected:
 
@@ -112,9 +158,26 @@ protected:
 
 		public:
 			static void perfMonitorCPUUsage (class Processor *p);
-			static void perfMonitorFPUUsage (class Processor *p);
-			static void perfMonitorDCMA (class Processor *p); //Data Cache Misaligned Accesses
+			static void perfMonitorFPUUsage (class Processor *p, DWORD profilePeriod);
+			static void perfMonitorDCMA (class Processor *p, DWORD profilePeriod); //Data Cache Misaligned Accesses
+			static void perfMonitorEffectiveFrequency (class Processor *p);
+			static void perfMonitorEvents (class Processor *p, const char *eventList, DWORD quantum, const char *attribution);
+			static void perfMonitorNorthbridge (class Processor *p, const char *eventList);
+			static void perfMonitorMemoryBandwidth (class Processor *p);
+			static void perfMonitorHTLink (class Processor *p);
+			static void perfMonitorNUMATraffic (class Processor *p, const DWORD *hops);
+			static void perfMonitorDramPages (class Processor *p, const struct dramPageSettings *settings);
+			static void perfMonitorFPUModules (class Processor *p, DWORD coresPerUnit);
+			static void perfMonitorIBS (class Processor *p, DWORD period);
+			static void perfMonitorSamples (class Processor *p, const char *eventSpec, DWORD period);
+			static void perfMonitorIPC (class Processor *p);
+			static void perfMonitorCacheMPKI (class Processor *p);
+			static void perfMonitorDTLB (class Processor *p);
+			static void perfMonitorCoherence (class Processor *p);
 			static void perfCounterGetInfo (class Processor *p);
+			static unsigned int setupCounter (PerformanceCounter *perfCounter, unsigned short int eventSelect, unsigned char unitMask,
+					DWORD slotMask = PERFCOUNTER_ALL_SLOTS);
+			static void perfCounterBenchmark (class Processor *p);
 	};
 
 
@@ -213,6 +276,9 @@ public:
 	//Public method to show some detailed information about Hypertransport Link
 	virtual void showHTLink (void);
 
+	//Public method to show node-to-node hop counts and SLIT-style NUMA distances
+	virtual void showNUMADistance (void);
+
 	//Public method to show some detailed information about Hardware Thermal Control
 	virtual void showHTC (void);
 
@@ -237,6 +303,16 @@ public:
 
 	DWORD HTLinkToFreq(DWORD);
 
+	//HT link registers, processors without HT links report no links
+	virtual DWORD getHTLinkSpeed(DWORD link, DWORD Sublink);
+	virtual DWORD getHTLinkWidth(DWORD link, DWORD Sublink, DWORD *WidthIn, DWORD *WidthOut, bool *pfCoherent, bool *pfUnganged);
+	void getHTLinkCapacity(DWORD *linkCapacity);
+
+	//NUMA helpers: hop matrix from request routes and its SLIT-style print
+	static void computeNUMAHops(DWORD nodes, const DWORD *routes, DWORD *hops);
+	static DWORD NUMAHopsToDistance(DWORD hops);
+	void printNUMADistance(DWORD nodes, const DWORD *hops);
+
 	DWORD getProcessorCores() {
 		return processorCores;
 	}
@@ -316,6 +392,14 @@ public:
 	virtual void setNumBoostStates(DWORD);
 	virtual DWORD getTDP(void);
 
+	//Cores sharing a compute unit (and its clock), 1 when cores are independent
+	virtual DWORD getCoresPerComputeUnit(void);
+
+	//Node power limit, in Watts. Negative values when not supported
+	virtual float getNodeTDPWatts(void);
+	virtual float getPowerLimit(void);
+	virtual bool setPowerLimit(float);
+
 	//Temperature registers
 	virtual DWORD getTctlRegister(void);
 
@@ -377,8 +461,23 @@ public:
 	virtual void perfCounterGetInfo();
 	virtual void perfCounterGetValue(unsigned int);
 	virtual void perfMonitorCPUUsage();
-	virtual void perfMonitorFPUUsage();
-	virtual void perfMonitorDCMA(); //Data Cache Misaligned Accesses
+	virtual void perfMonitorFPUUsage(DWORD);
+	virtual void perfMonitorDCMA(DWORD); //Data Cache Misaligned Accesses
+	virtual void perfMonitorEffectiveFrequency(); //APERF/MPERF effective frequency
+	virtual void perfMonitorEvents(const char *, DWORD, const char *); //Events from the catalog, multiplexed every quantum ms, per core and per attribution target
+	virtual void perfCounterBenchmark(); //Cost of MSR, perf read() and rdpmc counter reads
+	virtual void perfMonitorNorthbridge(const char *); //Northbridge events, once per node
+	virtual void perfMonitorMemoryBandwidth(); //DRAM read/write bandwidth per node and DCT
+	virtual void perfMonitorHTLink(); //HyperTransport link transmit utilization per node
+	virtual void perfMonitorNUMATraffic(); //Node-to-node DRAM request matrix, local vs remote
+	virtual void perfMonitorDramPages(); //DRAM page hit, miss and conflict ratios per DCT
+	virtual void perfMonitorFPUModules(); //Shared FPU contention per compute unit
+	virtual void perfMonitorIBS(DWORD); //IBS op sampling, DC miss latency histograms
+	virtual void perfMonitorSamples(const char *, DWORD); //Top processes and IPs causing an event
+	virtual void perfMonitorIPC(); //Per-core IPC and dispatch stall breakdown
+	virtual void perfMonitorCacheMPKI(); //L1D, L2 and L3 misses per kilo instruction
+	virtual void perfMonitorDTLB(); //DTLB misses per core and page walks per process
+	virtual void perfMonitorCoherence(); //Locked ops, dirty transfers, probes and contended lines
 
 
 	//Scaler helper methods
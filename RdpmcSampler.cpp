@@ -0,0 +1,347 @@
+/*
+ * RdpmcSampler.cpp
+ *
+ * RdpmcSampler reads performance counters without system calls and without inter-processor
+ * interrupts. For each cpu in the mask a thread is pinned on that cpu and, every interval
+ * microseconds, reads its local counters with the rdpmc instruction through the perf user pages
+ * (see PerformanceCounter::readPerfPage). Each thread publishes its last sample under a sequence
+ * counter, so takeSnapshot() can collect consistent samples from all the cpus without locks.
+ *
+ * Requires linux and the perf backend. The kernel must allow rdpmc to user space, see
+ * /sys/bus/event_source/devices/cpu/rdpmc.
+ *
+ * Instructions on how to use:
+ *
+ * 1 - Select the perf backend with PerformanceCounter::setBackend()
+ * 2 - Program and enable performance counters, then map their perf pages with mapPerfPages()
+ * 3 - Instantiate the object giving the same cpuMask of the counters and add the counters with
+ * 		addEventCounter(). The sampler does not own the counters
+ * 4 - Call start() to run the sampler threads
+ * 5 - Call takeSnapshot() once per tick and read deltas with getEventDelta() once isValid()
+ * 6 - Call stop() to join the threads
+ *
+ */
+
+#include <string.h>
+
+#include "RdpmcSampler.h"
+#include "TSCClock.h"
+
+#ifdef __linux
+#include <sched.h>
+#include <time.h>
+
+#define RDPMC_BARRIER() __sync_synchronize()
+#else
+#define RDPMC_BARRIER() MemoryBarrier()
+#endif
+
+RdpmcSampler::RdpmcSampler (PROCESSORMASK cpuMask)
+{
+	DWORD cpu;
+
+	this->cpuMask = cpuMask;
+	this->cpuCount = 0;
+
+	for (cpu = 0; cpu < MAX_CORES; cpu++)
+		if (cpuMask & ((PROCESSORMASK)1 << cpu))
+			this->cpuCount++;
+
+	this->cpuNumbers = (DWORD *) calloc(cpuCount, sizeof(DWORD));
+
+	this->cpuCount = 0;
+	for (cpu = 0; cpu < MAX_CORES; cpu++)
+		if (cpuMask & ((PROCESSORMASK)1 << cpu))
+			this->cpuNumbers[this->cpuCount++] = cpu;
+
+	this->eventCount = 0;
+	this->interval = 1000;
+	this->running = false;
+	this->snapshots = 0;
+
+	this->published = (struct RdpmcCpuSample *) calloc(cpuCount, sizeof(struct RdpmcCpuSample));
+
+#ifdef __linux
+	this->threads = (pthread_t *) calloc(cpuCount, sizeof(pthread_t));
+	this->threadArgs = (struct RdpmcThread *) calloc(cpuCount, sizeof(struct RdpmcThread));
+#endif
+}
+
+bool RdpmcSampler::isSupported ()
+{
+#if defined(__linux) && (defined(__i386__) || defined(__x86_64__))
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*
+ * Adds a performance counter, programmed with the perf backend and with perf pages mapped.
+ * Returns the event index to be used with getEventDelta(), or -1 (0xffffffff) if the sampler
+ * cannot hold more counters or is running
+ */
+unsigned int RdpmcSampler::addEventCounter (PerformanceCounter *perfCounter)
+{
+	if (eventCount >= RDPMC_MAX_EVENTS || running)
+		return -1;
+
+	counters[eventCount] = perfCounter;
+	prevValues[eventCount] = (uint64_t *) calloc(cpuCount, sizeof(uint64_t));
+	deltaValues[eventCount] = (uint64_t *) calloc(cpuCount, sizeof(uint64_t));
+
+	return eventCount++;
+}
+
+#ifdef __linux
+void *RdpmcSampler::samplerThread (void *arg)
+{
+	struct RdpmcThread *thread;
+
+	thread = (struct RdpmcThread *) arg;
+	thread->sampler->sampleLoop(thread->cpuIndex);
+
+	return NULL;
+}
+#endif
+
+/*
+ * Body of the sampler thread of cpuIndex: pins the thread on its cpu, then reads the local counters
+ * every interval and publishes them
+ */
+void RdpmcSampler::sampleLoop (DWORD cpuIndex)
+{
+#ifdef __linux
+	struct RdpmcCpuSample *sample;
+	uint64_t values[RDPMC_MAX_EVENTS];
+	uint64_t start, end;
+	struct timespec pause;
+	cpu_set_t cpuSet;
+	unsigned int event;
+
+	sample = &published[cpuIndex];
+
+	CPU_ZERO(&cpuSet);
+	CPU_SET(cpuNumbers[cpuIndex], &cpuSet);
+
+	if (pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) != 0)
+	{
+		sample->failed = true;
+		return;
+	}
+
+	pause.tv_sec = interval / 1000000;
+	pause.tv_nsec = (interval % 1000000) * 1000;
+
+	while (running)
+	{
+		start = TSCClock::readTSC();
+
+		for (event = 0; event < eventCount; event++)
+		{
+			if (!counters[event]->readPerfPage(cpuIndex, &values[event]))
+			{
+				sample->failed = true;
+				return;
+			}
+		}
+
+		end = TSCClock::readTSC();
+
+		sample->sequence++;
+		RDPMC_BARRIER();
+
+		memcpy(sample->values, values, eventCount * sizeof(uint64_t));
+		sample->samples++;
+		sample->cycles += end - start;
+
+		RDPMC_BARRIER();
+		sample->sequence++;
+
+		nanosleep(&pause, NULL);
+	}
+#endif
+}
+
+/*
+ * Starts one sampler thread per cpu, sampling every interval microseconds, and waits for the
+ * first sample of each thread.
+ *
+ * Returns true if all the threads are sampling, else stops them and returns false
+ */
+bool RdpmcSampler::start (DWORD interval)
+{
+#ifdef __linux
+	DWORD cpuIndex;
+	unsigned int wait;
+	bool ready;
+
+	if (running || eventCount == 0 || !isSupported())
+		return false;
+
+	this->interval = (interval > 0) ? interval : 1;
+	this->snapshots = 0;
+
+	memset(published, 0, cpuCount * sizeof(struct RdpmcCpuSample));
+
+	running = true;
+
+	for (cpuIndex = 0; cpuIndex < cpuCount; cpuIndex++)
+	{
+		threadArgs[cpuIndex].sampler = this;
+		threadArgs[cpuIndex].cpuIndex = cpuIndex;
+
+		if (pthread_create(&threads[cpuIndex], NULL, samplerThread, &threadArgs[cpuIndex]) != 0)
+		{
+			running = false;
+
+			while (cpuIndex > 0)
+				pthread_join(threads[--cpuIndex], NULL);
+
+			return false;
+		}
+	}
+
+	//Waits up to one second for the first sample of each thread
+	for (wait = 0; wait < 1000; wait++)
+	{
+		ready = true;
+
+		for (cpuIndex = 0; cpuIndex < cpuCount; cpuIndex++)
+		{
+			if (published[cpuIndex].failed)
+			{
+				stop();
+				return false;
+			}
+
+			if (published[cpuIndex].samples == 0)
+				ready = false;
+		}
+
+		if (ready)
+			return true;
+
+		Sleep(1);
+	}
+
+	stop();
+	return false;
+#else
+	return false;
+#endif
+}
+
+void RdpmcSampler::stop ()
+{
+#ifdef __linux
+	DWORD cpuIndex;
+
+	if (!running)
+		return;
+
+	running = false;
+
+	for (cpuIndex = 0; cpuIndex < cpuCount; cpuIndex++)
+		pthread_join(threads[cpuIndex], NULL);
+#endif
+}
+
+/*
+ * Collects the last sample published by each thread and computes deltas against the previous
+ * snapshot. A sample is consistent if the sequence counter is even and does not change while
+ * copying it.
+ *
+ * Returns false if a sampler thread has failed
+ */
+bool RdpmcSampler::takeSnapshot ()
+{
+	uint64_t values[RDPMC_MAX_EVENTS];
+	unsigned int sequence, event;
+	DWORD cpuIndex;
+
+	for (cpuIndex = 0; cpuIndex < cpuCount; cpuIndex++)
+	{
+		if (published[cpuIndex].failed)
+			return false;
+
+		do {
+			sequence = published[cpuIndex].sequence;
+			RDPMC_BARRIER();
+
+			memcpy(values, published[cpuIndex].values, eventCount * sizeof(uint64_t));
+
+			RDPMC_BARRIER();
+		} while ((sequence & 1) || sequence != published[cpuIndex].sequence);
+
+		for (event = 0; event < eventCount; event++)
+		{
+			deltaValues[event][cpuIndex] = PerformanceCounter::counterDelta(prevValues[event][cpuIndex], values[event]);
+			prevValues[event][cpuIndex] = values[event];
+		}
+	}
+
+	snapshots++;
+
+	return true;
+}
+
+/*
+ * Getters
+ */
+
+//Deltas are meaningful only after two snapshots
+bool RdpmcSampler::isValid () const
+{
+	return snapshots > 1;
+}
+
+DWORD RdpmcSampler::getCount () const
+{
+	return cpuCount;
+}
+
+uint64_t RdpmcSampler::getEventDelta (unsigned int eventIndex, DWORD cpuIndex) const
+{
+	return deltaValues[eventIndex][cpuIndex];
+}
+
+uint64_t RdpmcSampler::getSampleCount (DWORD cpuIndex) const
+{
+	return published[cpuIndex].samples;
+}
+
+//Average time, in nanoseconds, a thread spends reading all its counters
+uint64_t RdpmcSampler::getSampleCost (DWORD cpuIndex) const
+{
+	if (published[cpuIndex].samples == 0)
+		return 0;
+
+	return TSCClock::cyclesToNanoseconds(published[cpuIndex].cycles / published[cpuIndex].samples);
+}
+
+/*
+ * Destructor. Stops the threads, if still running, and frees resources.
+ *
+ */
+
+RdpmcSampler::~RdpmcSampler ()
+{
+	unsigned int event;
+
+	stop();
+
+	for (event = 0; event < eventCount; event++)
+	{
+		free(prevValues[event]);
+		free(deltaValues[event]);
+	}
+
+	free(published);
+	free(cpuNumbers);
+
+#ifdef __linux
+	free(threads);
+	free(threadArgs);
+#endif
+}
@@ -0,0 +1,82 @@
+/*
+ * RdpmcSampler.h
+ *
+ * Per-cpu sampler threads reading performance counters with rdpmc
+ *
+ */
+
+#ifndef RDPMCSAMPLER_H_
+#define RDPMCSAMPLER_H_
+
+#include "Processor.h"
+#include "PerformanceCounter.h"
+
+#ifdef __linux
+#include <pthread.h>
+#endif
+
+#define RDPMC_MAX_EVENTS 8
+
+//Last sample published by a sampler thread, protected by a sequence counter
+struct RdpmcCpuSample {
+	volatile unsigned int sequence; //Odd while the thread is writing
+	uint64_t values[RDPMC_MAX_EVENTS];
+	uint64_t samples; //Samples taken so far
+	uint64_t cycles; //TSC cycles spent reading the counters
+	volatile bool failed;
+};
+
+class RdpmcSampler {
+protected:
+
+	PROCESSORMASK cpuMask;
+	DWORD cpuCount;
+	DWORD *cpuNumbers; //Absolute cpu number of each cpuIndex
+
+	PerformanceCounter *counters[RDPMC_MAX_EVENTS];
+	unsigned int eventCount;
+
+	DWORD interval; //Microseconds between two samples
+	volatile bool running;
+
+	struct RdpmcCpuSample *published;
+	uint64_t *prevValues[RDPMC_MAX_EVENTS];
+	uint64_t *deltaValues[RDPMC_MAX_EVENTS];
+	unsigned int snapshots;
+
+#ifdef __linux
+	struct RdpmcThread {
+		RdpmcSampler *sampler;
+		DWORD cpuIndex;
+	};
+
+	pthread_t *threads;
+	struct RdpmcThread *threadArgs;
+
+	static void *samplerThread (void *arg);
+#endif
+
+	void sampleLoop (DWORD cpuIndex);
+
+public:
+	RdpmcSampler (PROCESSORMASK cpuMask);
+
+	static bool isSupported ();
+
+	unsigned int addEventCounter (PerformanceCounter *perfCounter);
+
+	bool start (DWORD interval);
+	void stop ();
+
+	bool takeSnapshot ();
+	bool isValid () const;
+
+	DWORD getCount () const;
+	uint64_t getEventDelta (unsigned int eventIndex, DWORD cpuIndex) const;
+	uint64_t getSampleCount (DWORD cpuIndex) const;
+	uint64_t getSampleCost (DWORD cpuIndex) const;
+
+	virtual ~RdpmcSampler ();
+};
+
+#endif /* RDPMCSAMPLER_H_ */
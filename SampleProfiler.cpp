@@ -0,0 +1,422 @@
+/*
+ * SampleProfiler.cpp
+ *
+ * SampleProfiler tells who causes the events a monitor counts. An event is opened through
+ * perf_event_open on each cpu in the mask with a sample period: each time the counter overflows
+ * the kernel handles the interrupt and writes a sample, with the instruction pointer and the
+ * pid of the interrupted task, to a per-cpu ring buffer mmap'd by this class.
+ *
+ * The ring buffers are read without locks: the kernel publishes data_head, the reader consumes
+ * the records up to data_head and then publishes data_tail to give the space back. Records the
+ * kernel cannot write because the ring is full are reported as lost, so drain() must be called
+ * often enough for the sample rate.
+ *
+ * Memory is bounded: besides the fixed size ring buffers, samples are aggregated in fixed size
+ * top offenders tables with the space-saving algorithm. When a table is full, a new key replaces
+ * the entry with the lowest count and inherits that count, so the heaviest keys are always kept
+ * and their counts are overestimated by at most the replaced count.
+ *
+ * Instructions on how to use:
+ *
+ * 1 - Instantiate the object giving a cpuMask
+ * 2 - Call start() with the event and the sample period
+ * 3 - Call drain() periodically, read top offenders with getTopPids() and getTopIps(), then
+ * 		call reset() to start a new window
+ * 4 - Call stop() or delete the object
+ *
+ */
+
+#include <string.h>
+
+#include "SampleProfiler.h"
+
+#ifdef __linux
+#include <unistd.h>
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+SampleProfiler::SampleProfiler (PROCESSORMASK cpuMask)
+{
+	DWORD cpu, cpuIndex;
+
+	this->cpuMask = cpuMask;
+	this->cpuCount = 0;
+
+	for (cpu = 0; cpu < MAX_CORES; cpu++)
+		if (cpuMask & ((PROCESSORMASK)1 << cpu))
+			this->cpuCount++;
+
+	this->cpus = (struct ProfilerCpu *) calloc(cpuCount, sizeof(struct ProfilerCpu));
+
+	for (cpuIndex = 0; cpuIndex < cpuCount; cpuIndex++)
+		this->cpus[cpuIndex].fd = -1;
+
+	this->ringSize = 0;
+	this->running = false;
+}
+
+bool SampleProfiler::isSupported ()
+{
+#ifdef __linux
+	return true;
+#else
+	return false;
+#endif
+}
+
+//Reads the command name of pid from /proc. Returns false if the process does not exist anymore
+bool SampleProfiler::getProcessName (DWORD pid, char *name, size_t length)
+{
+#ifdef __linux
+	char path[64];
+	FILE *file;
+	size_t size;
+
+	if (pid == 0)
+	{
+		strncpy(name, "idle", length);
+		return true;
+	}
+
+	sprintf(path, "/proc/%u/comm", pid);
+
+	file = fopen(path, "r");
+	if (file == NULL)
+		return false;
+
+	size = fread(name, 1, length - 1, file);
+	fclose(file);
+
+	name[size] = '\0';
+	if (size > 0 && name[size - 1] == '\n')
+		name[size - 1] = '\0';
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*
+ * Opens the event on each cpu with a sample period, maps the ring buffers and enables the events.
+ * Event is a raw AMD event, encoded as in PERF_CTL register.
+ *
+ * Returns false if the event cannot be opened or mapped on any cpu
+ */
+bool SampleProfiler::start (unsigned short int eventSelect, unsigned char unitMask, uint64_t period)
+{
+#ifdef __linux
+	struct perf_event_attr attr;
+	DWORD cpu, cpuIndex;
+
+	if (running || period == 0)
+		return false;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_RAW;
+	attr.config = (eventSelect & 0xff) | (((uint64_t) unitMask) << 8) | (((uint64_t) ((eventSelect & 0xf00) >> 8)) << 32);
+	attr.sample_period = period;
+	attr.sample_type = PERF_SAMPLE_IP | PERF_SAMPLE_TID;
+	attr.disabled = 1;
+
+	ringSize = (PROFILER_RING_PAGES + 1) * sysconf(_SC_PAGESIZE);
+
+	running = true;
+
+	cpuIndex = 0;
+	for (cpu = 0; cpu < MAX_CORES; cpu++)
+	{
+		if (!(this->cpuMask & ((PROCESSORMASK)1 << cpu)))
+			continue;
+
+		cpus[cpuIndex].fd = syscall(__NR_perf_event_open, &attr, -1, cpu, -1, 0);
+
+		if (cpus[cpuIndex].fd == -1)
+		{
+			stop();
+			return false;
+		}
+
+		cpus[cpuIndex].ring = mmap(NULL, ringSize, PROT_READ | PROT_WRITE, MAP_SHARED, cpus[cpuIndex].fd, 0);
+
+		if (cpus[cpuIndex].ring == MAP_FAILED)
+		{
+			cpus[cpuIndex].ring = NULL;
+			stop();
+			return false;
+		}
+
+		cpuIndex++;
+	}
+
+	reset();
+
+	for (cpuIndex = 0; cpuIndex < cpuCount; cpuIndex++)
+	{
+		if (ioctl(cpus[cpuIndex].fd, PERF_EVENT_IOC_ENABLE, 0) == -1)
+		{
+			stop();
+			return false;
+		}
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*
+ * Space-saving count of key in a top offenders table: counts an existing entry, else adds a
+ * new entry, else replaces the entry with the lowest count
+ */
+void SampleProfiler::countEntry (struct ProfilerEntry *entries, unsigned int *entryCount, uint64_t key, DWORD pid)
+{
+	unsigned int entry, lowest;
+
+	for (entry = 0; entry < *entryCount; entry++)
+	{
+		if (entries[entry].key == key && entries[entry].pid == pid)
+		{
+			entries[entry].count++;
+			return;
+		}
+	}
+
+	if (*entryCount < PROFILER_TOP_ENTRIES)
+	{
+		entries[*entryCount].key = key;
+		entries[*entryCount].pid = pid;
+		entries[*entryCount].count = 1;
+		(*entryCount)++;
+		return;
+	}
+
+	lowest = 0;
+	for (entry = 1; entry < PROFILER_TOP_ENTRIES; entry++)
+		if (entries[entry].count < entries[lowest].count)
+			lowest = entry;
+
+	entries[lowest].key = key;
+	entries[lowest].pid = pid;
+	entries[lowest].count++;
+}
+
+void SampleProfiler::processRecord (DWORD cpuIndex, const unsigned char *record)
+{
+#ifdef __linux
+	const struct perf_event_header *header;
+	uint64_t ip, lost;
+	DWORD pid;
+
+	header = (const struct perf_event_header *) record;
+
+	switch (header->type)
+	{
+	case PERF_RECORD_SAMPLE:
+		//PERF_SAMPLE_IP then PERF_SAMPLE_TID (pid, tid)
+		memcpy(&ip, record + sizeof(struct perf_event_header), sizeof(uint64_t));
+		memcpy(&pid, record + sizeof(struct perf_event_header) + sizeof(uint64_t), sizeof(DWORD));
+
+		cpus[cpuIndex].samples++;
+		countEntry(cpus[cpuIndex].pids, &cpus[cpuIndex].pidCount, pid, pid);
+		countEntry(cpus[cpuIndex].ips, &cpus[cpuIndex].ipCount, ip, pid);
+		break;
+
+	case PERF_RECORD_LOST:
+		//id then lost
+		memcpy(&lost, record + sizeof(struct perf_event_header) + sizeof(uint64_t), sizeof(uint64_t));
+		cpus[cpuIndex].lost += lost;
+		break;
+
+	default:
+		break;
+	}
+#endif
+}
+
+/*
+ * Consumes the records written by the kernel in all the ring buffers since the last call.
+ * Records wrapping around the end of a ring are copied out before being processed.
+ *
+ * Returns false if the profiler is not running
+ */
+bool SampleProfiler::drain ()
+{
+#ifdef __linux
+	volatile struct perf_event_mmap_page *page;
+	unsigned char record[PROFILER_RECORD_SIZE];
+	struct perf_event_header header;
+	unsigned char *data;
+	uint64_t head, tail, dataSize, position, first;
+	DWORD cpuIndex;
+
+	if (!running)
+		return false;
+
+	dataSize = ringSize - sysconf(_SC_PAGESIZE);
+
+	for (cpuIndex = 0; cpuIndex < cpuCount; cpuIndex++)
+	{
+		page = (volatile struct perf_event_mmap_page *) cpus[cpuIndex].ring;
+		data = (unsigned char *) cpus[cpuIndex].ring + sysconf(_SC_PAGESIZE);
+
+		head = page->data_head;
+		__sync_synchronize();
+
+		tail = page->data_tail;
+
+		while (tail + sizeof(struct perf_event_header) <= head)
+		{
+			position = tail & (dataSize - 1);
+
+			first = dataSize - position;
+			if (first > sizeof(struct perf_event_header))
+				first = sizeof(struct perf_event_header);
+
+			memcpy(&header, data + position, first);
+			memcpy((unsigned char *) &header + first, data, sizeof(struct perf_event_header) - first);
+
+			if (header.size == 0)
+				break;
+
+			if (header.size <= PROFILER_RECORD_SIZE)
+			{
+				first = dataSize - position;
+				if (first > header.size)
+					first = header.size;
+
+				memcpy(record, data + position, first);
+				memcpy(record + first, data, header.size - first);
+
+				processRecord(cpuIndex, record);
+			}
+
+			tail += header.size;
+		}
+
+		//Records must be read before the kernel can overwrite them
+		__sync_synchronize();
+		page->data_tail = tail;
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+//Clears counts and top offenders, to begin a new window
+void SampleProfiler::reset ()
+{
+	DWORD cpuIndex;
+
+	for (cpuIndex = 0; cpuIndex < cpuCount; cpuIndex++)
+	{
+		cpus[cpuIndex].samples = 0;
+		cpus[cpuIndex].lost = 0;
+		cpus[cpuIndex].pidCount = 0;
+		cpus[cpuIndex].ipCount = 0;
+	}
+}
+
+void SampleProfiler::stop ()
+{
+#ifdef __linux
+	DWORD cpuIndex;
+
+	for (cpuIndex = 0; cpuIndex < cpuCount; cpuIndex++)
+	{
+		if (cpus[cpuIndex].fd != -1)
+			ioctl(cpus[cpuIndex].fd, PERF_EVENT_IOC_DISABLE, 0);
+
+		if (cpus[cpuIndex].ring != NULL)
+			munmap(cpus[cpuIndex].ring, ringSize);
+
+		if (cpus[cpuIndex].fd != -1)
+			close(cpus[cpuIndex].fd);
+
+		cpus[cpuIndex].ring = NULL;
+		cpus[cpuIndex].fd = -1;
+	}
+#endif
+
+	running = false;
+}
+
+/*
+ * Getters
+ */
+
+DWORD SampleProfiler::getCount () const
+{
+	return cpuCount;
+}
+
+uint64_t SampleProfiler::getSamples (DWORD cpuIndex) const
+{
+	return cpus[cpuIndex].samples;
+}
+
+uint64_t SampleProfiler::getLost (DWORD cpuIndex) const
+{
+	return cpus[cpuIndex].lost;
+}
+
+//Copies up to maxEntries entries of a table, sorted by descending count. Returns the entries copied
+static unsigned int copyTopEntries (const struct ProfilerEntry *table, unsigned int tableCount,
+		struct ProfilerEntry *entries, unsigned int maxEntries)
+{
+	struct ProfilerEntry sorted[PROFILER_TOP_ENTRIES];
+	struct ProfilerEntry swap;
+	unsigned int i, j, best;
+
+	memcpy(sorted, table, tableCount * sizeof(struct ProfilerEntry));
+
+	if (maxEntries > tableCount)
+		maxEntries = tableCount;
+
+	//Partial selection sort, tables are small
+	for (i = 0; i < maxEntries; i++)
+	{
+		best = i;
+		for (j = i + 1; j < tableCount; j++)
+			if (sorted[j].count > sorted[best].count)
+				best = j;
+
+		swap = sorted[i];
+		sorted[i] = sorted[best];
+		sorted[best] = swap;
+
+		entries[i] = sorted[i];
+	}
+
+	return maxEntries;
+}
+
+unsigned int SampleProfiler::getTopPids (DWORD cpuIndex, struct ProfilerEntry *entries, unsigned int maxEntries) const
+{
+	return copyTopEntries(cpus[cpuIndex].pids, cpus[cpuIndex].pidCount, entries, maxEntries);
+}
+
+unsigned int SampleProfiler::getTopIps (DWORD cpuIndex, struct ProfilerEntry *entries, unsigned int maxEntries) const
+{
+	return copyTopEntries(cpus[cpuIndex].ips, cpus[cpuIndex].ipCount, entries, maxEntries);
+}
+
+/*
+ * Destructor. Disables the events and frees resources.
+ *
+ */
+
+SampleProfiler::~SampleProfiler ()
+{
+	stop();
+
+	free(cpus);
+}
@@ -0,0 +1,70 @@
+/*
+ * SampleProfiler.h
+ *
+ * Counter overflow sampling through the perf_event ring buffers
+ *
+ */
+
+#ifndef SAMPLEPROFILER_H_
+#define SAMPLEPROFILER_H_
+
+#include "Processor.h"
+
+#define PROFILER_RING_PAGES 8 //Data pages of each per-cpu ring buffer, must be a power of two
+#define PROFILER_TOP_ENTRIES 64 //Entries of each top offenders table
+#define PROFILER_RECORD_SIZE 256 //Largest record copied out of the ring buffer
+
+//Top offenders table entry. Key is a pid or an instruction pointer
+struct ProfilerEntry {
+	uint64_t key;
+	DWORD pid;
+	uint64_t count;
+};
+
+//Per-cpu ring buffer and top offenders, written by the reader only
+struct ProfilerCpu {
+	int fd;
+	void *ring;
+	uint64_t samples;
+	uint64_t lost;
+	struct ProfilerEntry pids[PROFILER_TOP_ENTRIES];
+	struct ProfilerEntry ips[PROFILER_TOP_ENTRIES];
+	unsigned int pidCount;
+	unsigned int ipCount;
+};
+
+class SampleProfiler {
+protected:
+
+	PROCESSORMASK cpuMask;
+	DWORD cpuCount;
+
+	struct ProfilerCpu *cpus;
+	size_t ringSize; //Bytes mapped for each cpu, control page included
+
+	bool running;
+
+	static void countEntry (struct ProfilerEntry *entries, unsigned int *entryCount, uint64_t key, DWORD pid);
+	void processRecord (DWORD cpuIndex, const unsigned char *record);
+
+public:
+	SampleProfiler (PROCESSORMASK cpuMask);
+
+	static bool isSupported ();
+	static bool getProcessName (DWORD pid, char *name, size_t length);
+
+	bool start (unsigned short int eventSelect, unsigned char unitMask, uint64_t period);
+	bool drain ();
+	void reset ();
+	void stop ();
+
+	DWORD getCount () const;
+	uint64_t getSamples (DWORD cpuIndex) const;
+	uint64_t getLost (DWORD cpuIndex) const;
+	unsigned int getTopPids (DWORD cpuIndex, struct ProfilerEntry *entries, unsigned int maxEntries) const;
+	unsigned int getTopIps (DWORD cpuIndex, struct ProfilerEntry *entries, unsigned int maxEntries) const;
+
+	virtual ~SampleProfiler ();
+};
+
+#endif /* SAMPLEPROFILER_H_ */
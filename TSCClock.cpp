@@ -0,0 +1,240 @@
+/*
+ * TSCClock.cpp
+ *
+ * This class provides nanosecond resolution timestamps using the processor Time Stamp Counter.
+ *
+ * At startup, calibrate() measures the TSC frequency against the operating system monotonic clock
+ * and checks if the TSC can be trusted as a clock source:
+ *
+ * - the TSC must be invariant (CPUID Fn8000_0007 EDX bit 8), so it ticks at a constant rate
+ * 		regardless of pstate transitions and C-states
+ * - the TSCs of all the cpus in the system must agree, else timestamps taken on different
+ * 		cores (or nodes) are not comparable
+ *
+ * When the TSC is not reliable, getNanoseconds() and the other getters fall back to the
+ * monotonic clock, so callers never need to care about the clock source. Timestamps are 64 bit
+ * wide and do not wrap in any practical amount of time.
+ *
+ * cyclesToNanoseconds() and cyclesToMicroseconds() convert TSC deltas (for example those
+ * read from TIME_STAMP_COUNTER_REG of each core) in real time intervals.
+ *
+ */
+
+#ifdef _WIN32
+	#include <windows.h>
+	#include <intrin.h>
+#endif
+
+#ifdef __linux
+	#include <time.h>
+#endif
+
+#include "TSCClock.h"
+#include "MSRObject.h"
+
+//Calibration window in milliseconds
+#define TSC_CALIBRATION_TIME 20
+
+//Maximum allowed disagreement between two cpus TSCs, in microseconds
+#define TSC_SYNC_TOLERANCE 100
+
+uint64_t TSCClock::tscFrequency=0;
+uint64_t TSCClock::baseTSC=0;
+uint64_t TSCClock::baseNanoseconds=0;
+bool TSCClock::calibrated=false;
+bool TSCClock::invariant=false;
+bool TSCClock::synchronized=false;
+
+/*
+ * Reads the time stamp counter of the cpu the caller is currently running on
+ */
+uint64_t TSCClock::readTSC ()
+{
+#ifdef _WIN32
+	return __rdtsc();
+#else
+	unsigned int eax, edx;
+
+	__asm__ __volatile__ ("rdtsc" : "=a" (eax), "=d" (edx));
+
+	return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+/*
+ * Operating system monotonic clock, in nanoseconds
+ */
+uint64_t TSCClock::getMonotonicNanoseconds ()
+{
+#ifdef _WIN32
+	LARGE_INTEGER counter, frequency;
+
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+
+	return ((uint64_t)counter.QuadPart / frequency.QuadPart) * 1000000000 +
+		((uint64_t)counter.QuadPart % frequency.QuadPart) * 1000000000 / frequency.QuadPart;
+#else
+	struct timespec tp;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &tp))
+		return 0;
+
+	return (uint64_t)tp.tv_sec * 1000000000 + tp.tv_nsec;
+#endif
+}
+
+/*
+ * Reads the TSC of every cpu in cpuMask through its MSR and checks that it lies between two
+ * readings of the local TSC taken just before and just after. If any cpu falls outside that
+ * window (plus a small tolerance) TSCs are not synchronized among cores or nodes.
+ */
+bool TSCClock::checkSynchronization (PROCESSORMASK cpuMask)
+{
+	DWORD eax, edx;
+	DWORD cpu;
+	uint64_t before, after, remote;
+	uint64_t tolerance;
+
+	tolerance = (tscFrequency / 1000000) * TSC_SYNC_TOLERANCE;
+
+	for (cpu = 0; cpu < MAX_CORES; cpu++)
+	{
+		if (!(cpuMask & ((PROCESSORMASK)1 << cpu)))
+			continue;
+
+		before = readTSC();
+
+		if (!RdmsrPx(TIME_STAMP_COUNTER_REG, &eax, &edx, (PROCESSORMASK)1 << cpu))
+			return false;
+
+		after = readTSC();
+
+		remote = ((uint64_t)edx << 32) | eax;
+
+		if ((remote + tolerance < before) || (remote > after + tolerance))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Measures the TSC frequency against the monotonic clock and checks if the TSC is invariant and
+ * synchronized among all the cpus in cpuMask.
+ *
+ * Returns true if the TSC can be used as a clock source, false if the monotonic clock will be used
+ * instead.
+ */
+bool TSCClock::calibrate (PROCESSORMASK cpuMask)
+{
+	DWORD eax, ebx, ecx, edx;
+	uint64_t startNs, endNs;
+	uint64_t startTSC, endTSC;
+
+	//TscInvariant is reported in CPUID Function 8000_0007 reg EDX bit 8
+	if (Cpuid(0x80000007, &eax, &ebx, &ecx, &edx) == TRUE)
+		invariant = (edx >> 8) & 0x1;
+	else
+		invariant = false;
+
+	startNs = getMonotonicNanoseconds();
+	startTSC = readTSC();
+
+	Sleep(TSC_CALIBRATION_TIME);
+
+	endNs = getMonotonicNanoseconds();
+	endTSC = readTSC();
+
+	if ((endNs <= startNs) || (endTSC <= startTSC))
+	{
+		printf("TSCClock::calibrate - unable to calibrate time stamp counter\n");
+		calibrated = false;
+		return false;
+	}
+
+	tscFrequency = ((endTSC - startTSC) * 1000000000) / (endNs - startNs);
+
+	baseTSC = endTSC;
+	baseNanoseconds = endNs;
+	calibrated = true;
+
+	synchronized = checkSynchronization(cpuMask);
+
+	if (!invariant)
+		printf("Warning: time stamp counter is not invariant, using system clock for timestamps\n");
+	else if (!synchronized)
+		printf("Warning: time stamp counters are not synchronized among cores, using system clock for timestamps\n");
+
+	return isReliable();
+}
+
+/*
+ * Current timestamp in nanoseconds. Time origin is arbitrary, only differences are meaningful
+ */
+uint64_t TSCClock::getNanoseconds ()
+{
+	if (!isReliable())
+		return getMonotonicNanoseconds();
+
+	return baseNanoseconds + cyclesToNanoseconds(readTSC() - baseTSC);
+}
+
+uint64_t TSCClock::getMicroseconds ()
+{
+	return getNanoseconds() / 1000;
+}
+
+uint64_t TSCClock::getMilliseconds ()
+{
+	return getNanoseconds() / 1000000;
+}
+
+/*
+ * Converts a TSC delta in nanoseconds. Division is split to avoid overflows on long intervals.
+ * Returns 0 if the clock has not been calibrated.
+ */
+uint64_t TSCClock::cyclesToNanoseconds (uint64_t cycles)
+{
+	if (tscFrequency == 0)
+		return 0;
+
+	return (cycles / tscFrequency) * 1000000000 + ((cycles % tscFrequency) * 1000000000) / tscFrequency;
+}
+
+uint64_t TSCClock::cyclesToMicroseconds (uint64_t cycles)
+{
+	if (tscFrequency == 0)
+		return 0;
+
+	return (cycles / tscFrequency) * 1000000 + ((cycles % tscFrequency) * 1000000) / tscFrequency;
+}
+
+/*
+ * Getters
+ */
+
+uint64_t TSCClock::getFrequency ()
+{
+	return tscFrequency;
+}
+
+bool TSCClock::isCalibrated ()
+{
+	return calibrated;
+}
+
+bool TSCClock::isInvariant ()
+{
+	return invariant;
+}
+
+bool TSCClock::isSynchronized ()
+{
+	return synchronized;
+}
+
+bool TSCClock::isReliable ()
+{
+	return calibrated && invariant && synchronized;
+}
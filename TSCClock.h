@@ -0,0 +1,46 @@
+/*
+ * TSCClock.h
+ *
+ * High resolution clock based on the processor Time Stamp Counter
+ *
+ */
+
+#ifndef TSCCLOCK_H_
+#define TSCCLOCK_H_
+
+#include "Processor.h"
+
+class TSCClock {
+
+	static uint64_t tscFrequency; //TSC ticks per second, measured by calibrate()
+	static uint64_t baseTSC; //TSC value at calibration time
+	static uint64_t baseNanoseconds; //Monotonic clock value at calibration time
+	static bool calibrated;
+	static bool invariant; //CPUID reports an invariant TSC
+	static bool synchronized; //TSCs of all the cpus agree with each other
+
+	static uint64_t getMonotonicNanoseconds ();
+	static bool checkSynchronization (PROCESSORMASK cpuMask);
+
+public:
+
+	static bool calibrate (PROCESSORMASK cpuMask);
+
+	static uint64_t readTSC ();
+
+	static uint64_t getNanoseconds ();
+	static uint64_t getMicroseconds ();
+	static uint64_t getMilliseconds ();
+
+	static uint64_t cyclesToNanoseconds (uint64_t cycles);
+	static uint64_t cyclesToMicroseconds (uint64_t cycles);
+
+	static uint64_t getFrequency ();
+	static bool isCalibrated ();
+	static bool isInvariant ();
+	static bool isSynchronized ();
+	static bool isReliable ();
+
+};
+
+#endif /* TSCCLOCK_H_ */
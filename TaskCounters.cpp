@@ -0,0 +1,499 @@
+/*
+ * TaskCounters.cpp
+ *
+ * TaskCounters counts events per process instead of per cpu: for each thread of the process an
+ * event group is opened through perf_event_open with the thread id and no cpu, so the kernel
+ * saves and restores the counts when the thread is scheduled, on whatever cpu it runs. Counts of
+ * all the threads are summed per process. Threads created after attach() are not counted.
+ *
+ * A cgroup is counted as a whole instead with attachCgroup(): the kernel only supports cgroup
+ * events on a cpu, so an event group is opened on each cpu of the mask with PERF_FLAG_PID_CGROUP
+ * and the cgroup directory, and counts of all the cpus are summed. Tasks that join the cgroup later
+ * are counted too. cgroup v1 needs the perf_event controller, cgroup v2 has it always.
+ *
+ * Events are given as PerformanceCounter objects, so the event catalog and the PerformanceCounter
+ * setters can be used to describe them; only their raw event and mode bits are used.
+ *
+ * Requires linux. Unprivileged users can count only their own processes, depending on
+ * perf_event_paranoid.
+ *
+ * Instructions on how to use:
+ *
+ * 1 - Instantiate the object and add the events with addEvent()
+ * 2 - Attach the processes with attach() and the cgroups with attachCgroup()
+ * 3 - Call takeSnapshot() once per tick and read deltas with getEventDelta()
+ *
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+#include "TaskCounters.h"
+
+#ifdef __linux
+#include <unistd.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+TaskCounters::TaskCounters ()
+{
+	this->eventCount = 0;
+	this->processCount = 0;
+	this->threadCount = 0;
+
+	this->threads = (struct TaskThread *) calloc(TASK_MAX_THREADS, sizeof(struct TaskThread));
+}
+
+bool TaskCounters::isSupported ()
+{
+#ifdef __linux
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*
+ * Fills pids with the processes using most resident memory, largest first. Those are the ones
+ * that suffer most from TLB misses. Returns the number of processes found.
+ */
+unsigned int TaskCounters::getLargestProcesses (DWORD *pids, unsigned int maxProcesses)
+{
+#ifdef __linux
+	uint64_t resident[TASK_MAX_PROCESSES];
+	struct dirent *entry;
+	DIR *proc;
+	DWORD pid;
+	uint64_t memory;
+	unsigned int count, position;
+
+	if (maxProcesses > TASK_MAX_PROCESSES)
+		maxProcesses = TASK_MAX_PROCESSES;
+
+	proc = opendir("/proc");
+	if (proc == NULL)
+		return 0;
+
+	count = 0;
+
+	while ((entry = readdir(proc)) != NULL)
+	{
+		pid = strtoul(entry->d_name, NULL, 10);
+		if (pid == 0)
+			continue;
+
+		memory = getResidentMemory(pid);
+		if (memory == 0)
+			continue;
+
+		//Insertion in the sorted list, dropping the smallest when full
+		position = (count < maxProcesses) ? count++ : maxProcesses;
+
+		while (position > 0 && resident[position - 1] < memory)
+		{
+			if (position < maxProcesses)
+			{
+				resident[position] = resident[position - 1];
+				pids[position] = pids[position - 1];
+			}
+			position--;
+		}
+
+		if (position < maxProcesses)
+		{
+			resident[position] = memory;
+			pids[position] = pid;
+		}
+	}
+
+	closedir(proc);
+
+	return count;
+#else
+	return 0;
+#endif
+}
+
+//Returns the resident memory of pid in KB, 0 for kernel threads and processes that don't exist anymore
+uint64_t TaskCounters::getResidentMemory (DWORD pid)
+{
+#ifdef __linux
+	char path[64];
+	FILE *file;
+	unsigned long long size, resident;
+
+	sprintf(path, "/proc/%u/statm", pid);
+
+	file = fopen(path, "r");
+	if (file == NULL)
+		return 0;
+
+	if (fscanf(file, "%llu %llu", &size, &resident) != 2)
+		resident = 0;
+
+	fclose(file);
+
+	return (resident * sysconf(_SC_PAGESIZE)) / 1024;
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Finds where cgroups are mounted: the perf_event controller of cgroup v1, if present, else the
+ * unified cgroup v2 hierarchy. Returns false if neither is mounted
+ */
+bool TaskCounters::getCgroupRoot (char *path, size_t length)
+{
+#ifdef __linux
+	struct stat info;
+
+	if (stat("/sys/fs/cgroup/perf_event", &info) == 0 && S_ISDIR(info.st_mode))
+	{
+		strncpy(path, "/sys/fs/cgroup/perf_event", length);
+		return true;
+	}
+
+	if (stat("/sys/fs/cgroup/cgroup.controllers", &info) == 0)
+	{
+		strncpy(path, "/sys/fs/cgroup", length);
+		return true;
+	}
+#endif
+
+	return false;
+}
+
+/*
+ * Fills names with the cgroups right below the root (eg: system.slice, docker), that is the top
+ * level containers. Returns the number of cgroups found
+ */
+unsigned int TaskCounters::getCgroups (char names[][TASK_NAME_LENGTH], unsigned int maxCgroups)
+{
+#ifdef __linux
+	char root[TASK_NAME_LENGTH];
+	struct dirent *entry;
+	DIR *directory;
+	unsigned int count;
+
+	if (!getCgroupRoot(root, sizeof(root)))
+		return 0;
+
+	directory = opendir(root);
+	if (directory == NULL)
+		return 0;
+
+	count = 0;
+
+	while ((entry = readdir(directory)) != NULL && count < maxCgroups)
+	{
+		if (entry->d_type != DT_DIR || entry->d_name[0] == '.')
+			continue;
+
+		snprintf(names[count], TASK_NAME_LENGTH, "%.*s", TASK_NAME_LENGTH - 1, entry->d_name);
+		count++;
+	}
+
+	closedir(directory);
+
+	return count;
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Adds an event described by perfCounter: event select, unit mask, counter mask and mode bits
+ * are used. Events must be added before attaching processes.
+ * Returns the event index to be used with getEventDelta(), or -1 (0xffffffff) if there is no room.
+ */
+unsigned int TaskCounters::addEvent (PerformanceCounter *perfCounter)
+{
+	if (eventCount >= TASK_MAX_EVENTS || processCount > 0)
+		return -1;
+
+	configs[eventCount] = perfCounter->getRawConfig();
+	excludeUser[eventCount] = !perfCounter->getCountUserMode();
+	excludeKernel[eventCount] = !perfCounter->getCountOsMode();
+
+	return eventCount++;
+}
+
+//Opens the event group of a thread, the first event leads the group
+bool TaskCounters::attachThread (unsigned int process, DWORD tid)
+{
+#ifdef __linux
+	struct perf_event_attr attr;
+	struct TaskThread *thread;
+	unsigned int event;
+
+	if (threadCount >= TASK_MAX_THREADS)
+		return false;
+
+	thread = &threads[threadCount];
+	thread->process = process;
+
+	for (event = 0; event < eventCount; event++)
+	{
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_RAW;
+		attr.config = configs[event];
+		attr.exclude_user = excludeUser[event];
+		attr.exclude_kernel = excludeKernel[event];
+		attr.read_format = PERF_FORMAT_GROUP;
+
+		thread->fds[event] = syscall(__NR_perf_event_open, &attr, tid, -1, (event == 0) ? -1 : thread->fds[0], 0);
+
+		if (thread->fds[event] == -1)
+		{
+			while (event > 0)
+				close(thread->fds[--event]);
+
+			return false;
+		}
+	}
+
+	threadCount++;
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+//Opens the event group of a cgroup on cpu, the first event leads the group
+bool TaskCounters::attachCgroupCpu (unsigned int process, int cgroupFd, DWORD cpu)
+{
+#ifdef __linux
+	struct perf_event_attr attr;
+	struct TaskThread *thread;
+	unsigned int event;
+
+	if (threadCount >= TASK_MAX_THREADS)
+		return false;
+
+	thread = &threads[threadCount];
+	thread->process = process;
+
+	for (event = 0; event < eventCount; event++)
+	{
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_RAW;
+		attr.config = configs[event];
+		attr.exclude_user = excludeUser[event];
+		attr.exclude_kernel = excludeKernel[event];
+		attr.read_format = PERF_FORMAT_GROUP;
+
+		thread->fds[event] = syscall(__NR_perf_event_open, &attr, cgroupFd, cpu, (event == 0) ? -1 : thread->fds[0], PERF_FLAG_PID_CGROUP);
+
+		if (thread->fds[event] == -1)
+		{
+			while (event > 0)
+				close(thread->fds[--event]);
+
+			return false;
+		}
+	}
+
+	threadCount++;
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*
+ * Starts counting the events on all the threads of pid. Returns false if the process can't be
+ * counted at all, because it doesn't exist or the user has no rights on it.
+ */
+bool TaskCounters::attach (DWORD pid)
+{
+#ifdef __linux
+	struct dirent *entry;
+	char path[64];
+	DIR *tasks;
+	DWORD tid;
+	unsigned int attached;
+
+	if (processCount >= TASK_MAX_PROCESSES || eventCount == 0)
+		return false;
+
+	sprintf(path, "/proc/%u/task", pid);
+
+	tasks = opendir(path);
+	if (tasks == NULL)
+		return false;
+
+	attached = 0;
+
+	while ((entry = readdir(tasks)) != NULL)
+	{
+		tid = strtoul(entry->d_name, NULL, 10);
+		if (tid == 0)
+			continue;
+
+		if (attachThread(processCount, tid))
+			attached++;
+	}
+
+	closedir(tasks);
+
+	if (attached == 0)
+		return false;
+
+	memset(&processes[processCount], 0, sizeof(struct TaskProcess));
+	processes[processCount].pid = pid;
+	processCount++;
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*
+ * Starts counting the events of the tasks in cgroup, a path relative to the cgroup root (see
+ * getCgroupRoot) or an absolute one, on all the cpus in cpuMask. Returns false if the cgroup
+ * doesn't exist or can't be counted on any cpu.
+ */
+bool TaskCounters::attachCgroup (const char *cgroup, PROCESSORMASK cpuMask)
+{
+#ifdef __linux
+	char path[TASK_NAME_LENGTH * 2];
+	int cgroupFd;
+	DWORD cpu;
+	unsigned int attached;
+
+	if (processCount >= TASK_MAX_PROCESSES || eventCount == 0)
+		return false;
+
+	if (cgroup[0] == '/')
+	{
+		strncpy(path, cgroup, sizeof(path) - 1);
+		path[sizeof(path) - 1] = '\0';
+	}
+	else
+	{
+		if (!getCgroupRoot(path, TASK_NAME_LENGTH))
+			return false;
+
+		strcat(path, "/");
+		strncat(path, cgroup, TASK_NAME_LENGTH - 1);
+	}
+
+	cgroupFd = open(path, O_RDONLY);
+	if (cgroupFd == -1)
+		return false;
+
+	attached = 0;
+
+	for (cpu = 0; cpu < MAX_CORES; cpu++)
+		if (cpuMask & ((PROCESSORMASK)1 << cpu))
+			if (attachCgroupCpu(processCount, cgroupFd, cpu))
+				attached++;
+
+	//Events keep a reference to the cgroup, the directory is not needed anymore
+	close(cgroupFd);
+
+	if (attached == 0)
+		return false;
+
+	memset(&processes[processCount], 0, sizeof(struct TaskProcess));
+	strncpy(processes[processCount].cgroup, cgroup, TASK_NAME_LENGTH - 1);
+	processCount++;
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*
+ * Reads the groups of all the threads, sums them per process and computes deltas against the
+ * previous snapshot. Threads that exited keep their last counts.
+ */
+bool TaskCounters::takeSnapshot ()
+{
+#ifdef __linux
+	//Group read format: number of events, values
+	uint64_t buffer[1 + TASK_MAX_EVENTS];
+	unsigned int process, thread, event;
+
+	for (process = 0; process < processCount; process++)
+		memset(processes[process].values, 0, sizeof(processes[process].values));
+
+	for (thread = 0; thread < threadCount; thread++)
+	{
+		if (read(threads[thread].fds[0], buffer, sizeof(buffer)) < (ssize_t) ((1 + eventCount) * sizeof(uint64_t)))
+			return false;
+
+		for (event = 0; event < eventCount; event++)
+			processes[threads[thread].process].values[event] += buffer[1 + event];
+	}
+
+	for (process = 0; process < processCount; process++)
+	{
+		for (event = 0; event < eventCount; event++)
+		{
+			processes[process].deltaValues[event] = processes[process].values[event] - processes[process].prevValues[event];
+			processes[process].prevValues[event] = processes[process].values[event];
+		}
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*
+ * Getters
+ */
+
+unsigned int TaskCounters::getProcessCount () const
+{
+	return processCount;
+}
+
+DWORD TaskCounters::getPid (unsigned int process) const
+{
+	return processes[process].pid;
+}
+
+//Returns the cgroup path of process, or an empty string if it is a process
+const char *TaskCounters::getCgroup (unsigned int process) const
+{
+	return processes[process].cgroup;
+}
+
+uint64_t TaskCounters::getEventDelta (unsigned int eventIndex, unsigned int process) const
+{
+	return processes[process].deltaValues[eventIndex];
+}
+
+/*
+ * Destructor. Closes the events and frees resources.
+ *
+ */
+
+TaskCounters::~TaskCounters ()
+{
+#ifdef __linux
+	unsigned int thread, event;
+
+	for (thread = 0; thread < threadCount; thread++)
+		for (event = 0; event < eventCount; event++)
+			close(threads[thread].fds[event]);
+#endif
+
+	free(threads);
+}
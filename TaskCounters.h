@@ -0,0 +1,73 @@
+/*
+ * TaskCounters.h
+ *
+ * Per-process and per-cgroup performance counters through perf_event_open
+ *
+ */
+
+#ifndef TASKCOUNTERS_H_
+#define TASKCOUNTERS_H_
+
+#include "Processor.h"
+#include "PerformanceCounter.h"
+
+#define TASK_MAX_EVENTS 4 //Events counted for each process, in a single group
+#define TASK_MAX_PROCESSES 16
+#define TASK_MAX_THREADS 1024 //Threads (and cgroup cpus) counted overall, each one takes a file descriptor per event
+#define TASK_NAME_LENGTH 128
+
+//An event group, opened on a thread of a process or on a cpu for a cgroup
+struct TaskThread {
+	unsigned int process; //Index of the process (or cgroup) the group belongs to
+	int fds[TASK_MAX_EVENTS];
+};
+
+struct TaskProcess {
+	DWORD pid; //0 for cgroups
+	char cgroup[TASK_NAME_LENGTH]; //Path relative to the cgroup root, empty for processes
+	uint64_t values[TASK_MAX_EVENTS]; //Sum of the counts of the threads
+	uint64_t prevValues[TASK_MAX_EVENTS];
+	uint64_t deltaValues[TASK_MAX_EVENTS];
+};
+
+class TaskCounters {
+protected:
+
+	uint64_t configs[TASK_MAX_EVENTS]; //Raw events, see PerformanceCounter::getRawConfig
+	bool excludeUser[TASK_MAX_EVENTS];
+	bool excludeKernel[TASK_MAX_EVENTS];
+	unsigned int eventCount;
+
+	struct TaskProcess processes[TASK_MAX_PROCESSES];
+	unsigned int processCount;
+
+	struct TaskThread *threads;
+	unsigned int threadCount;
+
+	bool attachThread (unsigned int process, DWORD tid);
+	bool attachCgroupCpu (unsigned int process, int cgroupFd, DWORD cpu);
+
+public:
+	TaskCounters ();
+
+	static bool isSupported ();
+	static unsigned int getLargestProcesses (DWORD *pids, unsigned int maxProcesses);
+	static uint64_t getResidentMemory (DWORD pid);
+	static bool getCgroupRoot (char *path, size_t length);
+	static unsigned int getCgroups (char names[][TASK_NAME_LENGTH], unsigned int maxCgroups);
+
+	unsigned int addEvent (PerformanceCounter *perfCounter);
+	bool attach (DWORD pid);
+	bool attachCgroup (const char *cgroup, PROCESSORMASK cpuMask);
+
+	bool takeSnapshot ();
+
+	unsigned int getProcessCount () const;
+	DWORD getPid (unsigned int process) const;
+	const char *getCgroup (unsigned int process) const;
+	uint64_t getEventDelta (unsigned int eventIndex, unsigned int process) const;
+
+	virtual ~TaskCounters ();
+};
+
+#endif /* TASKCOUNTERS_H_ */
@@ -20,6 +20,10 @@
 
 #include "config.h"
 #include "scaler.h"
+#include "TSCClock.h"
+#include "PerformanceEvents.h"
+#include "PerformanceMultiplexer.h"
+#include "TaskCounters.h"
 
 #include "source_version.h"
 #include "version.h"
@@ -157,7 +161,7 @@ void processorStatus (Processor *p) {
 void processorTempMonitoring (Processor *p) {
 
 	unsigned int node, core;
-	unsigned int nexttick;
+	uint64_t nexttick, now;
 
 	printf("Detected processor: %s\n", p->getProcessorStrId());
 
@@ -193,11 +197,11 @@ void processorTempMonitoring (Processor *p) {
 
 	printf ("\nTemperature table (monitoring):\n");
 
-	nexttick = GetTickCount();
+	nexttick = TSCClock::getMilliseconds();
 
 	while (1)
 	{
-		int sleepval;
+		DWORD sleepval;
 
 		for (node = 0; node < p->getProcessorNodes(); node++)
 		{
@@ -214,10 +218,12 @@ void processorTempMonitoring (Processor *p) {
 			break;
 		}
 		nexttick += 1000;
-		sleepval = nexttick - GetTickCount();
-		if (sleepval < 0) {
-			nexttick -= sleepval;
+		now = TSCClock::getMilliseconds();
+		if (nexttick < now) {
+			nexttick = now;
 			sleepval = 0;
+		} else {
+			sleepval = nexttick - now;
 		}
 		Sleep(sleepval);
 	};
@@ -286,6 +292,7 @@ void printUsage (const char *name) {
 	printf (" -dram\n\tLists detailed DRAM timings\n\n");
 	printf (" -htc\n\tShows Hardware Thermal Control status\n\n");
 	printf (" -htstatus\n\tShows Hypertransport status\n\n");
+	printf (" -numadist\n\tShows node-to-node hops and SLIT-style NUMA distances\n\n");
 	printf ("\t ----- PState VID, FID, DID manipulation -----\n\n");
 	printf (" -node <nodeId>\n\tSet the active operating node. Use \"all\" to affect all nodes\n\tin the system. "
 			"By default all nodes in the system are selected.\n\tIf your system has a single processor you can safely ignore\n\t"
@@ -347,6 +354,7 @@ void printUsage (const char *name) {
 
 	printf ("\t ----- Hypertransport Link -----\n\n");
 	printf (" -htstatus\n\tShows Hypertransport status\n\n");
+	printf (" -numadist\n\tShows node-to-node hops and SLIT-style NUMA distances\n\n");
 	printf (" -htset <link> <speedReg>\n\tSet the hypertransport link frequency register\n\n");
 	
 	printf ("\t ----- Various and others -----\n\n");
@@ -359,15 +367,38 @@ void printUsage (const char *name) {
 	printf ("\t ----- Performance Counters -----\n\n");
 	printf (" -pcgetinfo\n\tShows various informations about Performance Counters\n\n");
 	printf (" -pcgetvalue <counter>\n\tShows the raw value of a specific performance counter\n\tslot of a specific core\n\n");
+	printf (" -pcevents\n\tShows the performance events available for the current processor\n\n");
+	printf (" -pcmonitor <event>[,<event>...][/<event>...]\n\tCostantly monitors a list of performance events. Each event can be\n\tan event name from -pcevents or a raw event select, optionally\n\tfollowed by :<unitmask> (eg: cycles,instructions or 0x76,0xc0:0x00)\n\t");
+	printf ("A slash separates groups of events that are always counted\n\ttogether. When there are more events than counter slots, groups\n\tare multiplexed and counts are scaled\n\n");
+	printf (" -pcbackend <msr|perf>\n\tSelects how performance counters are accessed: msr programs the\n\tcounter registers directly (default), perf lets the linux kernel\n\tarbitrate the counters through perf_event_open, avoiding conflicts\n\twith the NMI watchdog and other perf users. Must precede monitors\n\n");
+	printf (" -pcnbmonitor <event>[,<event>...]\n\tCostantly monitors a list of northbridge events (see -pcevents)\n\tonce per node. Family 15h processors use northbridge counters\n\n");
+	printf (" -pcbench\n\tMeasures the cost of reading performance counters through MSRs,\n\tperf read() and rdpmc from per-cpu pinned threads\n\n");
+	printf (" -pcsample <event> <period>\n\tCostantly shows, for each core, the processes and the code addresses\n\tthat cause most of an event (see -pcmonitor for the syntax), sampling\n\tone event every period events through perf_event_open\n\n");
+	printf (" -pcprofile <period>\n\tMakes -perf-fpuusage and -perf-dcma show also the processes and\n\tthe code addresses that cause the events (FPU operations for\n\t-perf-fpuusage), sampling one event every period events. Requires\n\t-pcbackend perf. Must precede the monitor\n\n");
+	printf (" -pcattrib <targets>\n\tCounts the events of -pcmonitor also for each target, a comma\n\tseparated list of pids, cgroup paths (eg: system.slice/docker.service)\n\tand the keyword cgroups for all the top level cgroups. Up to %d events\n\tare attributed, requires -pcbackend perf. Must precede -pcmonitor\n\n", TASK_MAX_EVENTS);
+	printf (" -pcquantum <ms>\n\tSets the time slice of each event group when -pcmonitor\n\tmultiplexes counters (default %d ms). Must precede -pcmonitor\n\n", MULTIPLEXER_DEFAULT_QUANTUM);
 	printf (" -perf-cpuusage\n\tCostantly monitors CPU Usage using performance counters\n\n");
 	printf (" -perf-fpuusage\n\tCostantly monitors FPU Usage using performance counters\n\n");
 	printf (" -perf-dcma\n\tCostantly monitors Data Cache Misaligned Accesses\n\n");
+	printf (" -perf-efffreq\n\tCostantly monitors effective frequency, busy time and frequency\n\tinvariant load using APERF/MPERF registers\n\n");
+	printf (" -perf-ipc\n\tCostantly monitors instructions per cycle and the breakdown of\n\tdispatch stalls per core\n\n");
+	printf (" -perf-mpki\n\tCostantly monitors L1 data cache, L2 and L3 misses per kilo\n\tinstruction and miss ratios per core and per node\n\n");
+	printf (" -perf-dtlb\n\tCostantly monitors data TLB misses and page walks per core and the\n\tpage walk rate of the largest processes, flagging the ones that\n\twould benefit from huge pages. Requires -pcbackend perf\n\n");
+	printf (" -perf-coherence\n\tCostantly monitors locked ops, dirty cache to cache transfers and probes\n\tper core and node, and the most contended cache lines (needs IBS)\n\n");
+	printf (" -perf-drampages\n\tCostantly monitors DRAM page hit, miss and conflict ratios per node and\n\tDCT, next to DRAM timings, with advice on bank swizzle, page policy and\n\tchannel interleaving (Family 10h and 15h only)\n\n");
+	printf (" -perf-fpumodules\n\tCostantly monitors FPU pipe utilization and FP scheduler stalls per\n\tcompute unit, flagging FPUs shared by two FP-heavy threads and suggesting\n\twhere to move them (Family 15h only)\n\n");
+	printf (" -perf-membw\n\tCostantly monitors DRAM read and write bandwidth per node and\n\tper DRAM controller\n\n");
+	printf (" -perf-htlink\n\tCostantly monitors HyperTransport links transmit bandwidth and\n\tutilization per node and link\n\n");
+	printf (" -perf-numa\n\tCostantly monitors memory traffic from each node to each node and\n\tthe share of remote memory traffic\n\n");
+	printf (" -perf-ibs <period>\n\tCostantly profiles data cache miss latency, data source and NUMA\n\tlocality with Instruction-Based Sampling, tagging an op every\n\tperiod ops (eg: 65536). Shows per-core statistics and per-node\n\tlatency histograms\n\n");
 
 	printf ("\t ----- Daemon Mode -----\n\n");
 	printf (" -autorecall\n\tSet up daemon mode, autorecalling command line parameters\n\tevery 60 seconds\n\n");
 	printf (" -scaler\n\tSet up CPU Scaler mode. In this mode TurionPowerControl takes\n\t");
 	printf ("care of CPU power management and power state transitions.\n\t");
 	printf ("OS Scaler must be disable for reliable operation\n\n");
+	printf (" -powercap <watts>\n\tCaps each node to watts: programs the APM TDP limit on Family 15h\n\tprocessors with APM enabled, else caps pstates in software from an\n\testimate of the node power. Must precede -scaler\n\n");
+	printf (" -scalerpolicy <step|rocket|predictive|costaware|thermal|powercap>\n\tSelects the scaler policy. predictive forecasts the load of each\n\tcore and sets the slowest pstate expected to serve it, with the\n\thysteresis and minimum residency of the SCALER config section.\n\tcostaware measures the pstate transition time of each core and\n\tswitches only when the gain over the next period exceeds it.\n\tthermal fits a thermal model per node and caps pstates before\n\tTctl is predicted to reach the HTC temperature limit.\n\tMust precede -scaler\n\n");
 	printf (" -CM\n\tEnabled Costant Monitor of frequency, voltage and pstate. Also will\n\t");
 	printf ("show every anomalous transition over pstate maximum register (useful to\n\t");
 	printf ("report pstate 6/7 anomalous transitions)\n\n");
@@ -831,11 +862,17 @@ int main (int argc,const char **argv) {
 
 	bool autoRecall=false;
 	int autoRecallTimer=60;
+	unsigned int pcQuantum=MULTIPLEXER_DEFAULT_QUANTUM;
+	const char *pcAttribution=NULL;
+	unsigned int ibsPeriod;
+	unsigned int pcProfilePeriod=0;
+	unsigned int pcSamplePeriod;
 	
 	CfgManager *cfgInstance;
 	int errorLine;
 	
 	Scaler *scaler;
+	int powerBudget;
 
 	int rv;
 	int parsed = 0;
@@ -860,6 +897,10 @@ int main (int argc,const char **argv) {
 		return -2;
 	}
 	
+	//Calibrates the time stamp counter against system clock, all the timestamps
+	//and the time intervals used by monitors and scaler are based on it
+	TSCClock::calibrate(processor->getMask(processor->ALL_CORES, processor->ALL_NODES));
+
 	//Initializes currentNode and currentCore
 	currentNode=processor->ALL_NODES;
 	currentCore=processor->ALL_CORES;
@@ -1357,6 +1398,13 @@ int main (int argc,const char **argv) {
 			continue;
 		}
 
+		//Shows node-to-node hops and NUMA distances from the HyperTransport routing tables
+		if (strcmp(argv[argvStep], "-numadist") == 0) {
+
+			processor->showNUMADistance();
+			continue;
+		}
+
 		//Set Hypertransport Link frequency for current nodes
 		if (strcmp(argv[argvStep], "-htset") == 0) {
 
@@ -1496,8 +1544,121 @@ int main (int argc,const char **argv) {
 
 		//Costantly monitors Performance counter value about a specific performance counter
 		if (strcmp(argv[argvStep], "-pcmonitor") == 0) {
-			printf("ERROR: -pcmonitor is currently not implemented\n");
-			break;
+
+			if (argv[argvStep + 1] == NULL) {
+				printf("ERROR: -pcmonitor requires an argument\n");
+				break;
+			}
+			processor->perfMonitorEvents(argv[argvStep + 1], pcQuantum, pcAttribution);
+			argvStep++;
+			continue;
+		}
+
+		//Selects how performance counters are programmed: directly through MSRs or through
+		//the kernel perf_event_open interface
+		if (strcmp(argv[argvStep], "-pcbackend") == 0) {
+
+			if (argv[argvStep + 1] == NULL) {
+				printf("ERROR: -pcbackend requires an argument\n");
+				break;
+			}
+			if (strcmp(argv[argvStep + 1], "msr") == 0) {
+				PerformanceCounter::setBackend(PERFCOUNTER_BACKEND_MSR);
+			} else if (strcmp(argv[argvStep + 1], "perf") == 0) {
+				if (!PerformanceCounter::setBackend(PERFCOUNTER_BACKEND_PERF)) {
+					printf("ERROR: perf_event_open backend is not available\n");
+					break;
+				}
+			} else {
+				printf("ERROR: invalid backend -- %s\n", argv[argvStep + 1]);
+				break;
+			}
+			argvStep++;
+			continue;
+		}
+
+		//Counts the events of -pcmonitor per process and per cgroup too
+		if (strcmp(argv[argvStep], "-pcattrib") == 0) {
+
+			if (argv[argvStep + 1] == NULL) {
+				printf("ERROR: -pcattrib requires an argument\n");
+				break;
+			}
+			pcAttribution = argv[argvStep + 1];
+			argvStep++;
+			continue;
+		}
+
+		//Sets the time slice of each event group when -pcmonitor multiplexes counters
+		if (strcmp(argv[argvStep], "-pcquantum") == 0) {
+
+			if (argv[argvStep + 1] == NULL) {
+				printf("ERROR: -pcquantum requires an argument\n");
+				break;
+			}
+			if (requireUnsignedInteger(argc, argv, argvStep + 1, &pcQuantum) || pcQuantum == 0) {
+				printf("ERROR: invalid quantum -- %s\n", argv[argvStep + 1]);
+				break;
+			}
+			argvStep++;
+			continue;
+		}
+
+		//Samples the events of -perf-fpuusage and -perf-dcma to show who causes them
+		if (strcmp(argv[argvStep], "-pcprofile") == 0) {
+
+			if (argv[argvStep + 1] == NULL) {
+				printf("ERROR: -pcprofile requires an argument\n");
+				break;
+			}
+			if (requireUnsignedInteger(argc, argv, argvStep + 1, &pcProfilePeriod) || pcProfilePeriod == 0) {
+				printf("ERROR: invalid sample period -- %s\n", argv[argvStep + 1]);
+				break;
+			}
+			argvStep++;
+			continue;
+		}
+
+		//Costantly shows the processes and the code that cause an event
+		if (strcmp(argv[argvStep], "-pcsample") == 0) {
+
+			if (argv[argvStep + 1] == NULL || argv[argvStep + 2] == NULL) {
+				printf("ERROR: -pcsample requires two arguments\n");
+				break;
+			}
+			if (requireUnsignedInteger(argc, argv, argvStep + 2, &pcSamplePeriod) || pcSamplePeriod == 0) {
+				printf("ERROR: invalid sample period -- %s\n", argv[argvStep + 2]);
+				break;
+			}
+			processor->perfMonitorSamples(argv[argvStep + 1], pcSamplePeriod);
+			argvStep += 2;
+			continue;
+		}
+
+		//Costantly monitors northbridge events, once per node
+		if (strcmp(argv[argvStep], "-pcnbmonitor") == 0) {
+
+			if (argv[argvStep + 1] == NULL) {
+				printf("ERROR: -pcnbmonitor requires an argument\n");
+				break;
+			}
+			processor->perfMonitorNorthbridge(argv[argvStep + 1]);
+			argvStep++;
+			continue;
+		}
+
+		//Measures the cost of the different performance counter access paths
+		if (strcmp(argv[argvStep], "-pcbench") == 0) {
+
+			processor->perfCounterBenchmark();
+			continue;
+		}
+
+		//Shows the performance events available for the current processor
+		if (strcmp(argv[argvStep], "-pcevents") == 0) {
+
+			PerformanceEvents::printCatalog(PerformanceEvents::getFamilyFlag(processor->getSpecFamilyExtended()));
+			continue;
 		}
 
 		//Handle -set switch. That is a user friendly way to set up a pstate or a pstate/core
@@ -1531,14 +1692,100 @@ int main (int argc,const char **argv) {
 		//Costantly monitors FPU Usage
 		if (strcmp(argv[argvStep], "-perf-fpuusage") == 0) {
 
-			processor->perfMonitorFPUUsage ();
+			processor->perfMonitorFPUUsage (pcProfilePeriod);
 			continue;
 		}
 
 		//Constantly monitors Data Cache Misaligned Accesses
 		if (strcmp(argv[argvStep], "-perf-dcma") == 0) {
 
-			processor->perfMonitorDCMA();
+			processor->perfMonitorDCMA(pcProfilePeriod);
+			continue;
+		}
+
+		//Constantly monitors IPC and dispatch stalls per core
+		if (strcmp(argv[argvStep], "-perf-ipc") == 0) {
+
+			processor->perfMonitorIPC();
+			continue;
+		}
+
+		//Constantly monitors cache misses per kilo instruction per core and node
+		if (strcmp(argv[argvStep], "-perf-mpki") == 0) {
+
+			processor->perfMonitorCacheMPKI();
+			continue;
+		}
+
+		//Constantly monitors DTLB misses per core and page walks per process
+		if (strcmp(argv[argvStep], "-perf-dtlb") == 0) {
+
+			processor->perfMonitorDTLB();
+			continue;
+		}
+
+		//Constantly monitors coherence traffic and contended cache lines
+		if (strcmp(argv[argvStep], "-perf-coherence") == 0) {
+
+			processor->perfMonitorCoherence();
+			continue;
+		}
+
+		//Constantly monitors DRAM page hits, misses and conflicts per DCT
+		if (strcmp(argv[argvStep], "-perf-drampages") == 0) {
+
+			processor->perfMonitorDramPages();
+			continue;
+		}
+
+		//Constantly monitors the FPU shared by the cores of each compute unit
+		if (strcmp(argv[argvStep], "-perf-fpumodules") == 0) {
+
+			processor->perfMonitorFPUModules();
+			continue;
+		}
+
+		//Constantly monitors DRAM bandwidth per node
+		if (strcmp(argv[argvStep], "-perf-membw") == 0) {
+
+			processor->perfMonitorMemoryBandwidth();
+			continue;
+		}
+
+		//Constantly monitors HyperTransport link utilization per node
+		if (strcmp(argv[argvStep], "-perf-htlink") == 0) {
+
+			processor->perfMonitorHTLink();
+			continue;
+		}
+
+		//Constantly monitors memory traffic between nodes
+		if (strcmp(argv[argvStep], "-perf-numa") == 0) {
+
+			processor->perfMonitorNUMATraffic();
+			continue;
+		}
+
+		//Constantly profiles memory access latency with Instruction-Based Sampling
+		if (strcmp(argv[argvStep], "-perf-ibs") == 0) {
+
+			if (argv[argvStep + 1] == NULL) {
+				printf("ERROR: -perf-ibs requires an argument\n");
+				break;
+			}
+			if (requireUnsignedInteger(argc, argv, argvStep + 1, &ibsPeriod) || ibsPeriod == 0) {
+				printf("ERROR: invalid period -- %s\n", argv[argvStep + 1]);
+				break;
+			}
+			processor->perfMonitorIBS(ibsPeriod);
+			argvStep++;
+			continue;
+		}
+
+		//Constantly monitors effective frequency using APERF/MPERF registers
+		if (strcmp(argv[argvStep], "-perf-efffreq") == 0) {
+
+			processor->perfMonitorEffectiveFrequency();
 			continue;
 		}
 
@@ -1569,6 +1816,44 @@ int main (int argc,const char **argv) {
 			continue;
 		}
 
+		//Selects the scaler policy
+		if (strcmp(argv[argvStep], "-scalerpolicy") == 0) {
+
+			if (argv[argvStep + 1] == NULL) {
+				printf("ERROR: -scalerpolicy requires an argument\n");
+				break;
+			}
+			if (strcmp(argv[argvStep + 1], "step") == 0) {
+				scaler->setPolicy(POLICY_STEP);
+			} else if (strcmp(argv[argvStep + 1], "rocket") == 0) {
+				scaler->setPolicy(POLICY_ROCKET);
+			} else if (strcmp(argv[argvStep + 1], "predictive") == 0) {
+				scaler->setPolicy(POLICY_PREDICTIVE);
+			} else if (strcmp(argv[argvStep + 1], "costaware") == 0) {
+				scaler->setPolicy(POLICY_COSTAWARE);
+			} else if (strcmp(argv[argvStep + 1], "thermal") == 0) {
+				scaler->setPolicy(POLICY_THERMAL);
+			} else {
+				printf("ERROR: invalid scaler policy -- %s\n", argv[argvStep + 1]);
+				break;
+			}
+			argvStep++;
+			continue;
+		}
+
+		//Selects power capping with a per-node budget
+		if (strcmp(argv[argvStep], "-powercap") == 0) {
+
+			if (requireInteger(argc, argv, argvStep + 1, &powerBudget) || powerBudget <= 0) {
+				printf("ERROR: -powercap requires a budget in Watts\n");
+				break;
+			}
+			scaler->setPolicy(POLICY_POWERCAP);
+			scaler->setPowerBudget(powerBudget);
+			argvStep++;
+			continue;
+		}
+
 		if (strcmp(argv[argvStep], "-scaler") == 0) {
 
 			printf ("Scaler is not active in this version.\n");
@@ -272,8 +272,68 @@ int CfgManager::consumeScalerSection () {
 				scaler->setPolicy (POLICY_ROCKET);
 			else if (strcmp(strTemp,"step")==0)
 				scaler->setPolicy (POLICY_STEP);
+			else if (strcmp(strTemp,"predictive")==0)
+				scaler->setPolicy (POLICY_PREDICTIVE);
+			else if (strcmp(strTemp,"costaware")==0)
+				scaler->setPolicy (POLICY_COSTAWARE);
+			else if (strcmp(strTemp,"thermal")==0)
+				scaler->setPolicy (POLICY_THERMAL);
+			else if (strcmp(strTemp,"powercap")==0)
+				scaler->setPolicy (POLICY_POWERCAP);
 			else return true;
 
+		} else if (strcmp (line,"load")==0) {
+			fscanf (cfgFile, "%s", strTemp);
+			if (strcmp(strTemp,"idle")==0)
+				scaler->setLoadSource (LOAD_IDLE_COUNTER);
+			else if (strcmp(strTemp,"invariant")==0)
+				scaler->setLoadSource (LOAD_FREQUENCY_INVARIANT);
+			else return true;
+
+		} else if (strcmp (line,"mode")==0) {
+			fscanf (cfgFile, "%s", strTemp);
+			if (strcmp(strTemp,"central")==0)
+				scaler->setMode (SCALER_CENTRAL);
+			else if (strcmp(strTemp,"agents")==0)
+				scaler->setMode (SCALER_AGENTS);
+			else return true;
+
+		} else if (strcmp (line,"alpha")==0) {
+			fscanf (cfgFile, "%d", &temp);
+			if ((temp<1) || (temp>100)) return true;
+			scaler->setForecastAlpha (temp);
+		} else if (strcmp (line,"beta")==0) {
+			fscanf (cfgFile, "%d", &temp);
+			if ((temp<0) || (temp>100)) return true;
+			scaler->setForecastBeta (temp);
+		} else if (strcmp (line,"hysteresis")==0) {
+			fscanf (cfgFile, "%d", &temp);
+			if ((temp<0) || (temp>100)) return true;
+			scaler->setHysteresis (temp);
+		} else if (strcmp (line,"residency")==0) {
+			fscanf (cfgFile, "%d", &temp);
+			if (temp<0) return true;
+			scaler->setMinResidency (temp);
+		} else if (strcmp (line,"horizon")==0) {
+			fscanf (cfgFile, "%d", &temp);
+			if ((temp<1) || (temp>60)) return true;
+			scaler->setThermalHorizon (temp);
+		} else if (strcmp (line,"thermalmargin")==0) {
+			fscanf (cfgFile, "%d", &temp);
+			if ((temp<0) || (temp>30)) return true;
+			scaler->setThermalMargin (temp);
+		} else if (strcmp (line,"powerbudget")==0) {
+			fscanf (cfgFile, "%d", &temp);
+			if (temp<1) return true;
+			scaler->setPowerBudget (temp);
+		} else if (strcmp (line,"powertolerance")==0) {
+			fscanf (cfgFile, "%d", &temp);
+			if ((temp<1) || (temp>50)) return true;
+			scaler->setPowerTolerance (temp);
+		} else if (strcmp (line,"nodetdp")==0) {
+			fscanf (cfgFile, "%d", &temp);
+			if (temp<1) return true;
+			scaler->setNodeTDP (temp);
 		} else if (strcmp (line,"upperthreshold")==0) {
 			fscanf (cfgFile, "%d", &temp);
 			if ((temp<0) || (temp>100)) return true;
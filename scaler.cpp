@@ -1,5 +1,10 @@
 #include "scaler.h"
 
+#ifdef __linux
+#include <sched.h>
+#include <time.h>
+#endif
+
 //TODO: IMPORTANT ********* Scaler must be completely revised
 
 Scaler::Scaler(class Processor *prc) {
@@ -13,12 +18,36 @@ Scaler::Scaler(class Processor *prc) {
 
 	policy = POLICY_STEP;
 
+	loadSource = LOAD_IDLE_COUNTER;
+
+	mode = SCALER_CENTRAL;
+
 	upperThreshold = 70;
 	lowerThreshold = 20;
 
 	midUpperThreshold = (100 + upperThreshold) >> 1;
 	midLowerThreshold = (100 - lowerThreshold) >> 1;
 
+	forecastAlpha = DEFAULT_FORECAST_ALPHA;
+	forecastBeta = DEFAULT_FORECAST_BETA;
+	hysteresis = DEFAULT_HYSTERESIS;
+	minResidency = DEFAULT_MIN_RESIDENCY;
+
+	thermalHorizon = DEFAULT_THERMAL_HORIZON;
+	thermalMargin = DEFAULT_THERMAL_MARGIN;
+
+	powerBudget = 0;
+	powerTolerance = DEFAULT_POWER_TOLERANCE;
+	nodeTDP = 0;
+
+	coresPerUnit = processor->getCoresPerComputeUnit();
+
+	if (coresPerUnit < 1)
+		coresPerUnit = 1;
+
+	coreRequests = 0;
+	coalescedRequests = 0;
+
 	PState ps(0);
 	ps = processor->getMaximumPState();
 
@@ -34,6 +63,14 @@ void Scaler::setPolicy(int policy) {
 	this->policy = policy;
 }
 
+void Scaler::setLoadSource(int loadSource) {
+	this->loadSource = loadSource;
+}
+
+void Scaler::setMode(int mode) {
+	this->mode = mode;
+}
+
 void Scaler::setUpperThreshold(int thres) {
 
 	if (thres > 100)
@@ -54,6 +91,86 @@ void Scaler::setLowerThreshold(int thres) {
 	midLowerThreshold = (100 - lowerThreshold) >> 1;
 }
 
+void Scaler::setForecastAlpha(int alpha) {
+
+	if (alpha < 1)
+		forecastAlpha = 1;
+	else if (alpha > 100)
+		forecastAlpha = 100;
+	else
+		forecastAlpha = alpha;
+}
+
+void Scaler::setForecastBeta(int beta) {
+
+	if (beta < 0)
+		forecastBeta = 0;
+	else if (beta > 100)
+		forecastBeta = 100;
+	else
+		forecastBeta = beta;
+}
+
+void Scaler::setHysteresis(int hyst) {
+
+	if (hyst < 0)
+		hysteresis = 0;
+	else if (hyst > upperThreshold)
+		hysteresis = upperThreshold;
+	else
+		hysteresis = hyst;
+}
+
+void Scaler::setMinResidency(int residency) {
+
+	if (residency < 0)
+		minResidency = 0;
+	else
+		minResidency = residency;
+}
+
+void Scaler::setThermalHorizon(int horizon) {
+
+	if (horizon < 1)
+		thermalHorizon = 1;
+	else
+		thermalHorizon = horizon;
+}
+
+void Scaler::setThermalMargin(int margin) {
+
+	if (margin < 0)
+		thermalMargin = 0;
+	else
+		thermalMargin = margin;
+}
+
+void Scaler::setPowerBudget(int watts) {
+
+	if (watts < 0)
+		powerBudget = 0;
+	else
+		powerBudget = watts;
+}
+
+void Scaler::setPowerTolerance(int tolerance) {
+
+	if (tolerance < 1)
+		powerTolerance = 1;
+	else if (tolerance > 50)
+		powerTolerance = 50;
+	else
+		powerTolerance = tolerance;
+}
+
+void Scaler::setNodeTDP(int watts) {
+
+	if (watts < 0)
+		nodeTDP = 0;
+	else
+		nodeTDP = watts;
+}
+
 /* Scaling methods:
 
  STEP	- Stepped scaling, means that when CPU usage goes over 70% for a core,
@@ -72,111 +189,564 @@ void Scaler::setLowerThreshold(int thres) {
  If cpu core usage is 0%, core is set to slowest frequency. If CPU core
  usage is below 10%, core is set to a slower pstate two step backward.
  If CPU usage is below 20%, core is set to one step backward.
+
+ PREDICTIVE - Each core keeps a Holt forecast (level and trend, smoothed with
+ alpha and beta, beta 0 is a plain EWMA) of its load. The core is set to the
+ slowest pstate whose frequency serves the forecast below the upper threshold.
+ Moving to a slower pstate requires the forecast to stay below the upper
+ threshold minus the hysteresis, and any transition requires the core to have
+ spent the minimum residency in the current pstate, unless the forecast
+ exceeds the current pstate frequency.
+
+ COSTAWARE - At startup the scaler measures how long each core takes to switch
+ pstate, timing forcePState() until COFVID_STATUS reports the new pstate. The
+ core is moved to the slowest pstate serving its load below the upper
+ threshold only when the gain over the next sampling period exceeds the
+ transition time: busy time saved when raising, dynamic energy (Vcore^2*f)
+ saved when lowering, both expressed in microseconds at the current pstate.
+
+ THERMAL - Cores are scaled as in STEP, but each node fits a first order RC
+ thermal model from its Tctl and the activity of its cores. The model predicts
+ Tctl the horizon ahead and the node cores are capped to the fastest pstate
+ that keeps the prediction the margin below HTCTempLimit, before HTC kicks in.
+ Model parameters and prediction error are reported periodically.
+
+ POWERCAP - Cores are scaled as in STEP within a per-node watt budget. Where
+ supported (Family 15h with APM enabled) the budget is programmed as the APM
+ TDP limit and enforced by the processor. Else a software controller caps the
+ node pstates from an estimate of the node power, the node TDP scaled by the
+ activity of its cores. The cap is tightened when the estimate exceeds the
+ budget plus the tolerance and relaxed, after the minimum residency, only if
+ the estimate at the faster cap stays below the budget minus the tolerance.
+
+ On processors with compute units (Family 15h) the cores of a unit share their
+ clock, so the policy requests of sibling cores are coalesced: all the cores of
+ a unit are set to the fastest pstate requested in the unit.
+
+ Scaling modes:
+
+ CENTRAL - A single thread reads the counters of all the cores and forces the
+ pstate of each one. Each tick reads and writes MSRs of remote cpus, so each
+ cpu gets inter-processor interrupts from the scaler.
+
+ AGENTS - An agent thread per cpu, pinned on it, reads its own counters and
+ writes its own PSTATE_CTRL register, so MSR accesses never leave the cpu.
+ Agents apply the same policy and share only its parameters and tables.
  */
 
 int Scaler::initializeCounters() {
-	DWORD cpuIndex, nodeId, coreId;
-	PROCESSORMASK cpuMask;
 	unsigned int perfCounterSlot;
 
+	this->perfCounter = NULL;
+	this->sampler = NULL;
+	this->prevPerfCounters = NULL;
+	this->coreLoad = NULL;
+
 	try {
 
 		this->processor->setNode(this->processor->ALL_NODES);
 		this->processor->setCore(this->processor->ALL_CORES);
 
-		cpuMask = this->processor->getMask();
+		this->cpuMask = this->processor->getMask();
 		/* We do this to do some "caching" of the mask, instead of calculating each time
 		 we need to retrieve the time stamp counter */
 
-		// Allocating space for previous values of counters.
+		// Allocating space for previous values of counters and for the computed loads
 		this->prevPerfCounters = (uint64_t *) calloc(
 				this->processor->getProcessorCores() * this->processor->getProcessorNodes(),
 				sizeof(uint64_t));
-		this->prevTSCCounters = (uint64_t *) calloc(
+		this->coreLoad = (uint64_t *) calloc(
 				this->processor->getProcessorCores() * this->processor->getProcessorNodes(),
 				sizeof(uint64_t));
 
-		// MSR Object to retrieve the time stamp counter for all the nodes and all the processors
-		this->tscCounter = new MSRObject();
+		// Sampler retrieves the time stamp counter (and APERF/MPERF when required)
+		// for all the nodes and all the processors
+		this->sampler = new PerformanceSampler(this->cpuMask);
+
+		if (this->loadSource == LOAD_FREQUENCY_INVARIANT) {
+
+			if (!this->sampler->setFrequencyCounters(true))
+				throw "processor does not support APERF/MPERF registers";
+
+		} else {
+
+			//Creates a new performance counter, for now we set slot 0, but we will
+			//use the findAvailable slot method to find an available method to be used
+			this->perfCounter = new PerformanceCounter(this->cpuMask, 0, this->processor->getMaxSlots());
+
+			//Event 0x76 is Idle Counter
+			perfCounter->setEventSelect(0x76);
+			perfCounter->setCountOsMode(true);
+			perfCounter->setCountUserMode(true);
+			perfCounter->setCounterMask(0);
+			perfCounter->setEdgeDetect(false);
+			perfCounter->setEnableAPICInterrupt(false);
+			perfCounter->setInvertCntMask(false);
+			perfCounter->setUnitMask(0);
 
-		//Creates a new performance counter, for now we set slot 0, but we will
-		//use the findAvailable slot method to find an available method to be used
-		this->perfCounter = new PerformanceCounter(cpuMask, 0, this->processor->getMaxSlots());
+			//Finds an available slot for our purpose
+			perfCounterSlot = this->perfCounter->findAvailableSlot();
 
-		//Event 0x76 is Idle Counter
-		perfCounter->setEventSelect(0x76);
-		perfCounter->setCountOsMode(true);
-		perfCounter->setCountUserMode(true);
-		perfCounter->setCounterMask(0);
-		perfCounter->setEdgeDetect(false);
-		perfCounter->setEnableAPICInterrupt(false);
-		perfCounter->setInvertCntMask(false);
-		perfCounter->setUnitMask(0);
+			//findAvailableSlot() returns -2 in case of error
+			if (perfCounterSlot == 0xfffffffe)
+				throw "unable to access performance counter slots";
 
-		//Finds an available slot for our purpose
-		perfCounterSlot = this->perfCounter->findAvailableSlot();
+			//findAvailableSlot() returns -1 in case there aren't available slots
+			if (perfCounterSlot == 0xffffffff)
+				throw "unable to find an available performance counter slot";
 
-		//findAvailableSlot() returns -2 in case of error
-		if (perfCounterSlot == 0xfffffffe)
-			throw "unable to access performance counter slots";
+			printf("Performance counter will use slot #%d\n", perfCounterSlot);
 
-		//findAvailableSlot() returns -1 in case there aren't available slots
-		if (perfCounterSlot == 0xffffffff)
-			throw "unable to find an available performance counter slot";
+			//In case there are no errors, we program the object with the slot itself has found
+			this->perfCounter->setSlot(perfCounterSlot);
 
-		printf("Performance counter will use slot #%d\n", perfCounterSlot);
+			// Program the counter slot
+			if (!this->perfCounter->program())
+				throw "unable to program performance counter parameters";
 
-		//In case there are no errors, we program the object with the slot itself has found
-		this->perfCounter->setSlot(perfCounterSlot);
+			// Enable the counter slot
+			if (!this->perfCounter->enable())
+				throw "unable to enable performance counters";
 
-		// Program the counter slot
-		if (!this->perfCounter->program())
-			throw "unable to program performance counter parameters";
+			//With the perf backend agents read their counter with rdpmc
+			if (this->mode == SCALER_AGENTS && PerformanceCounter::getBackend() == PERFCOUNTER_BACKEND_PERF &&
+					!this->perfCounter->mapPerfPages())
+				throw "scaler agents need rdpmc access to perf counters, see /sys/bus/event_source/devices/cpu/rdpmc";
 
-		// Enable the counter slot
-		if (!this->perfCounter->enable())
-			throw "unable to enable performance counters";
+		}
 
 		/* Here we take a snapshot of the performance counter and a snapshot of the time
 		 * stamp counter to initialize the arrays to let them not show erratic huge numbers
 		 * on first step
 		 */
-
-		if (!this->perfCounter->takeSnapshot())
+		if (!this->takeSnapshot())
 			throw "unable to retrieve performance counter data";
 
-		if (!this->tscCounter->readMSR(TIME_STAMP_COUNTER_REG, cpuMask))
-			throw "unable to retrieve time stamp counter";
+	} catch (char const *str) {
 
-		cpuIndex = 0;
-		for (nodeId = 0; nodeId < this->processor->getProcessorNodes(); nodeId++) {
-			for (coreId = 0x0; coreId < this->processor->getProcessorCores(); coreId++) {
-				this->prevPerfCounters[cpuIndex] = this->perfCounter->getCounter(cpuIndex);
-				this->prevTSCCounters[cpuIndex]
-						= this->tscCounter->getBits(cpuIndex, 0, 64);
-				cpuIndex++;
-			}
-		}
+		freeCounters();
 
-		this->perfCounter->disable();
+		printf("Scaler.cpp::initializeCounters - %s\n", str);
 
-	} catch (char const *str) {
+		return -1; //In case of error, we return -1
+
+	}
+
+	return 0; //In case of success, we return 0
+
+}
+
+void Scaler::freeCounters() {
 
+	if (this->perfCounter) {
 		if (this->perfCounter->getEnabled())
 			this->perfCounter->disable();
+		delete this->perfCounter;
+	}
 
-		free(this->perfCounter);
-		free(this->tscCounter);
-		free(this->prevPerfCounters);
-		free(this->prevTSCCounters);
+	delete this->sampler;
 
-		printf("Scaler.cpp::initializeCounters - %s\n", str);
+	free(this->prevPerfCounters);
+	free(this->coreLoad);
 
-		return -1; //In case of error, we return -1
+	this->perfCounter = NULL;
+	this->sampler = NULL;
+	this->prevPerfCounters = NULL;
+	this->coreLoad = NULL;
+
+}
+
+/*
+ * Takes a snapshot of the counters and computes the load of each core over the exact
+ * interval elapsed since the previous snapshot, as reported by the time stamp counter.
+ *
+ * Load is expressed in MHz, so it can be compared with the performance tables: with the
+ * idle counter it is the number of non-halted cycles per microsecond, with APERF/MPERF it
+ * is the frequency invariant delivered frequency.
+ */
+bool Scaler::takeSnapshot() {
 
+	DWORD cpuIndex;
+	uint64_t elapsed;
+	uint64_t counter;
+
+	if (!this->sampler->takeSnapshot())
+		return false;
+
+	if (this->loadSource == LOAD_FREQUENCY_INVARIANT) {
+
+		for (cpuIndex=0;cpuIndex<this->sampler->getCount();cpuIndex++)
+			this->coreLoad[cpuIndex]=this->sampler->getDeliveredFrequency(cpuIndex);
+
+		return true;
 	}
 
-	return 0; //In case of success, we return 0
+	if (!this->perfCounter->takeSnapshot())
+		return false;
+
+	for (cpuIndex=0;cpuIndex<this->sampler->getCount();cpuIndex++) {
+
+		elapsed=TSCClock::cyclesToMicroseconds(this->sampler->getTSCDelta(cpuIndex));
+
+		if (elapsed==0)
+			elapsed=1;
+
+		counter=this->perfCounter->getCounter(cpuIndex);
+
+		this->coreLoad[cpuIndex]=PerformanceCounter::counterDelta(this->prevPerfCounters[cpuIndex], counter)/elapsed;
+		this->prevPerfCounters[cpuIndex]=counter;
+	}
+
+	return true;
+
+}
+
+/*
+ * Computes the load of the agent cpu, in MHz like takeSnapshot() does, reading its counter (or
+ * APERF) and its time stamp counter locally. Must run on the agent cpu. prevCounter and prevTSC
+ * hold the values of the previous call and are updated.
+ */
+bool Scaler::readLocalLoad(struct ScalerAgent *agent, uint64_t *prevCounter, uint64_t *prevTSC, uint64_t *load) {
+
+	uint64_t counter, tsc, elapsed;
+
+	tsc=TSCClock::readTSC();
+
+	if (this->loadSource == LOAD_FREQUENCY_INVARIANT) {
+
+		if (!agent->msrObject->readMSR(APERF_REG, (PROCESSORMASK)1 << agent->cpu))
+			return false;
+
+		counter=agent->msrObject->getBits(0, 0, 64);
+
+		elapsed=TSCClock::cyclesToMicroseconds(tsc-*prevTSC);
+
+		if (elapsed==0)
+			elapsed=1;
+
+		*load=(counter-*prevCounter)/elapsed;
+
+	} else {
+
+		if (!this->perfCounter->readLocal(agent->cpuIndex, &counter))
+			return false;
+
+		elapsed=TSCClock::cyclesToMicroseconds(tsc-*prevTSC);
+
+		if (elapsed==0)
+			elapsed=1;
+
+		*load=PerformanceCounter::counterDelta(*prevCounter, counter)/elapsed;
+	}
+
+	*prevCounter=counter;
+	*prevTSC=tsc;
+
+	return true;
+
+}
+
+/*
+ * Forces pstate on the agent cpu writing its PSTATE_CTRL register, as forcePState() does, without
+ * touching the node and core selection of the processor object shared by all the agents
+ */
+bool Scaler::writeLocalPState(struct ScalerAgent *agent, unsigned char pstate) {
+
+	if (!agent->msrObject->readMSR(BASE_PSTATE_CTRL_REG, (PROCESSORMASK)1 << agent->cpu))
+		return false;
+
+	//To force a pstate, we act on setting the first 3 bits of register. All other bits must be zero
+	agent->msrObject->setBits(0, 64, 0);
+	agent->msrObject->setBits(0, 3, pstate);
+
+	return agent->msrObject->writeMSR();
+
+}
+
+#ifdef __linux
+void *Scaler::agentThread(void *arg) {
+
+	struct ScalerAgent *agent;
+
+	agent=(struct ScalerAgent *)arg;
+	agent->scaler->agentLoop(agent);
+
+	return NULL;
+
+}
+#endif
+
+/*
+ * Body of an agent: pins the thread on its cpu, then every sampling period computes the local
+ * load and applies the policy to its own core only. PSTATE_CTRL is written only when the
+ * requested pstate changes.
+ */
+void Scaler::agentLoop(struct ScalerAgent *agent) {
+
+#ifdef __linux
+	unsigned char reqPState, curPState;
+	unsigned int enabledPowerStates;
+	DWORD targetUnit;
+	DWORD first, last, sibling;
+	uint64_t prevCounter, prevTSC, load;
+	struct ScalerForecast forecast;
+	struct timespec pause;
+	cpu_set_t cpuSet;
+
+	forecast.initialized=false;
+
+	CPU_ZERO(&cpuSet);
+	CPU_SET(agent->cpu, &cpuSet);
+
+	if (pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet)!=0) {
+		agent->failed=true;
+		return;
+	}
+
+	enabledPowerStates=this->processor->getMaximumPState().getPState();
+
+	pause.tv_sec=this->samplingRate/1000;
+	pause.tv_nsec=(this->samplingRate%1000)*1000000;
+
+	prevCounter=0;
+	prevTSC=TSCClock::readTSC();
+
+	//First reading initializes previous values
+	if (!readLocalLoad(agent, &prevCounter, &prevTSC, &load)) {
+		agent->failed=true;
+		return;
+	}
+
+	//Forces the slowest pstate, so the agent always knows the state of its core
+	curPState=this->slowestPowerState;
+
+	if (!writeLocalPState(agent, curPState)) {
+		agent->failed=true;
+		return;
+	}
+
+	while (this->agentsRunning) {
+
+		nanosleep(&pause, NULL);
+
+		if (!readLocalLoad(agent, &prevCounter, &prevTSC, &load)) {
+			agent->failed=true;
+			return;
+		}
+
+		reqPState=curPState;
+
+		targetUnit=(reqPState*enabledPowerStates)+agent->cpuIndex;
+
+		if (this->policy==POLICY_PREDICTIVE) {
+			reqPState=predictPState(&forecast, load, curPState, agent->cpuIndex);
+		}
+		else if (this->policy==POLICY_COSTAWARE) {
+			reqPState=costAwarePState(load, curPState, agent->cpuIndex);
+		}
+		else if (load>raiseTable[targetUnit]) {
+			if (this->policy==POLICY_ROCKET)
+				reqPState=0;
+			else if (reqPState!=0)
+				reqPState--;
+		}
+		else if (load<reduceTable[targetUnit] && reqPState<enabledPowerStates) {
+			reqPState++;
+		}
+
+		//Sibling agents publish their requests, the unit runs the fastest one
+		if (this->coresPerUnit>1) {
+
+			this->agentRequests[agent->cpuIndex]=reqPState;
+
+			getUnitCores(agent->cpuIndex, &first, &last);
+
+			for (sibling=first;sibling<=last;sibling++)
+				if (this->agentRequests[sibling]<reqPState)
+					reqPState=this->agentRequests[sibling];
+
+			agent->requests++;
+
+			if (reqPState!=this->agentRequests[agent->cpuIndex])
+				agent->coalesced++;
+		}
+
+		if (reqPState==curPState)
+			continue;
+
+		if (!writeLocalPState(agent, reqPState)) {
+			agent->failed=true;
+			return;
+		}
+
+		curPState=reqPState;
+
+	}
+#else
+	agent->failed=true;
+#endif
+
+}
+
+/*
+ * Runs an agent per cpu and waits for CTRL-C. Returns when all the agents have terminated.
+ */
+void Scaler::loopAgents() {
+
+#ifdef __linux
+	struct ScalerAgent *agents;
+	pthread_t *threads;
+	DWORD units, cpuIndex, cpu, started;
+	bool failed;
+
+	units=this->processor->getProcessorCores()*this->processor->getProcessorNodes();
+
+	agents=(struct ScalerAgent *)calloc(units, sizeof(struct ScalerAgent));
+	threads=(pthread_t *)calloc(units, sizeof(pthread_t));
+
+	//Agents start in the slowest pstate
+	this->agentRequests=(volatile unsigned char *)calloc(units, sizeof(unsigned char));
+
+	for (cpuIndex=0;cpuIndex<units;cpuIndex++)
+		this->agentRequests[cpuIndex]=this->slowestPowerState;
+
+	this->agentsRunning=true;
+
+	Signal::activateSignalHandler(SIGINT);
+
+	cpuIndex=0;
+	started=0;
+	failed=false;
+
+	for (cpu=0;cpu<MAX_CORES && cpuIndex<units;cpu++) {
+
+		if (!(this->cpuMask & ((PROCESSORMASK)1 << cpu)))
+			continue;
+
+		agents[cpuIndex].scaler=this;
+		agents[cpuIndex].cpuIndex=cpuIndex;
+		agents[cpuIndex].cpu=cpu;
+		agents[cpuIndex].msrObject=new MSRObject();
+
+		if (pthread_create(&threads[cpuIndex], NULL, agentThread, &agents[cpuIndex])!=0) {
+			delete agents[cpuIndex].msrObject;
+			failed=true;
+			break;
+		}
+
+		started++;
+		cpuIndex++;
+	}
+
+	if (!failed)
+		printf("Scaler agents pinned on %u cpus\n", started);
+
+	while (!failed && !Signal::getSignalStatus()) {
+
+		Sleep(this->samplingRate);
+
+		for (cpuIndex=0;cpuIndex<started;cpuIndex++) {
+			if (agents[cpuIndex].failed) {
+				printf("Scaler agent of cpu %u failed, terminating\n", agents[cpuIndex].cpu);
+				failed=true;
+			}
+		}
+
+	}
+
+	this->agentsRunning=false;
+
+	for (cpuIndex=0;cpuIndex<started;cpuIndex++) {
+		pthread_join(threads[cpuIndex], NULL);
+
+		delete agents[cpuIndex].msrObject;
+
+		this->coreRequests+=agents[cpuIndex].requests;
+		this->coalescedRequests+=agents[cpuIndex].coalesced;
+	}
+
+	free(agents);
+	free(threads);
+	free((void *)this->agentRequests);
+#else
+	printf("Scaler agents are not supported on this system, using central scaler\n");
+
+	if (this->policy == POLICY_ROCKET)
+		loopPolicyRocket();
+	else if (this->policy == POLICY_PREDICTIVE)
+		loopPolicyPredictive();
+	else if (this->policy == POLICY_COSTAWARE)
+		loopPolicyCostAware();
+	else
+		loopPolicyStep();
+#endif
+
+}
+
+/*
+ * Gives the first and the last cpuIndex of the compute unit holding cpuIndex. Units do not span
+ * nodes.
+ */
+void Scaler::getUnitCores(DWORD cpuIndex, DWORD *first, DWORD *last) {
+
+	DWORD cores, coreIndex;
+
+	cores=this->processor->getProcessorCores();
+	coreIndex=cpuIndex%cores;
+
+	*first=cpuIndex-(coreIndex%this->coresPerUnit);
+	*last=*first+this->coresPerUnit-1;
+
+	if (*last>=cpuIndex-coreIndex+cores)
+		*last=cpuIndex-coreIndex+cores-1;
+
+}
+
+/*
+ * Forces the pstates requested in ps by the central policies. The cores of a compute unit are
+ * set to the fastest pstate requested in the unit; ps is updated with the applied pstates.
+ */
+void Scaler::applyPStates(PState **ps) {
+
+	DWORD cpuIndex, nodeIndex, coreIndex, first, last, sibling;
+	unsigned char reqPState, unitPState;
+
+	cpuIndex=0;
+
+	for (nodeIndex=0;nodeIndex<this->processor->getProcessorNodes();nodeIndex++) {
+
+		this->processor->setNode(nodeIndex);
+
+		for (coreIndex=0;coreIndex<this->processor->getProcessorCores();coreIndex++) {
+
+			this->processor->setCore(coreIndex);
+
+			if (this->coresPerUnit>1) {
+
+				reqPState=ps[cpuIndex]->getPState();
+				unitPState=reqPState;
+
+				getUnitCores(cpuIndex, &first, &last);
+
+				for (sibling=first;sibling<=last;sibling++)
+					if (ps[sibling]->getPState()<unitPState)
+						unitPState=ps[sibling]->getPState();
+
+				this->coreRequests++;
+
+				if (unitPState!=reqPState) {
+					this->coalescedRequests++;
+					ps[cpuIndex]->setPState(unitPState);
+				}
+			}
+
+			this->processor->forcePState(ps[cpuIndex]->getPState());
+
+			cpuIndex++;
+
+		}
+
+	}
 
 }
 
@@ -186,7 +756,6 @@ void Scaler::loopPolicyRocket() {
 	unsigned int enabledPowerStates;
 	DWORD units, cpuIndex, targetUnit, nodeIndex, coreIndex;
 	uint64_t deltaUsage;
-	unsigned int divisor;
 
 	PState **ps;
 
@@ -197,15 +766,13 @@ void Scaler::loopPolicyRocket() {
 	for (cpuIndex=0;cpuIndex<units;cpuIndex++)
 		ps[cpuIndex]=new PState(2);
 
-	divisor=(1000000/1000)*this->samplingRate;
-
 	enabledPowerStates=this->processor->getMaximumPState().getPState();
 
 	Signal::activateSignalHandler( SIGINT);
 
 	while (!Signal::getSignalStatus()) {
 
-		if (!this->perfCounter->takeSnapshot())
+		if (!this->takeSnapshot())
 			throw "unable to retrieve performance counter data";
 
 		cpuIndex=0;
@@ -220,8 +787,7 @@ void Scaler::loopPolicyRocket() {
 
 				reqPState=ps[cpuIndex]->getPState();
 
-				deltaUsage = ((this->perfCounter->getCounter(cpuIndex))
-					- this->prevPerfCounters[cpuIndex])/divisor;
+				deltaUsage = this->coreLoad[cpuIndex];
 
 				targetUnit=(reqPState*enabledPowerStates)+cpuIndex;
 
@@ -233,10 +799,6 @@ void Scaler::loopPolicyRocket() {
 
 				ps[cpuIndex]->setPState(reqPState);
 
-				this->processor->forcePState(ps[cpuIndex]->getPState());
-
-				this->prevPerfCounters[cpuIndex] = this->perfCounter->getCounter(cpuIndex);
-
 				cpuIndex++;
 
 			}
@@ -245,6 +807,8 @@ void Scaler::loopPolicyRocket() {
 
 		//printf("\n");
 
+		applyPStates(ps);
+
 		Sleep(this->samplingRate);
 
 	}
@@ -261,7 +825,6 @@ void Scaler::loopPolicyStep() {
 	unsigned int enabledPowerStates;
 	DWORD units, cpuIndex, targetUnit, nodeIndex, coreIndex;
 	uint64_t deltaUsage;
-	unsigned int divisor;
 
 	PState **ps;
 
@@ -272,15 +835,13 @@ void Scaler::loopPolicyStep() {
 	for (cpuIndex=0;cpuIndex<units;cpuIndex++)
 		ps[cpuIndex]=new PState(2);
 
-	divisor=(1000000/1000)*this->samplingRate;
-
 	enabledPowerStates=this->processor->getMaximumPState().getPState();
 
 	Signal::activateSignalHandler( SIGINT);
 
 	while (!Signal::getSignalStatus()) {
 
-		if (!this->perfCounter->takeSnapshot())
+		if (!this->takeSnapshot())
 			throw "unable to retrieve performance counter data";
 
 		cpuIndex=0;
@@ -295,8 +856,7 @@ void Scaler::loopPolicyStep() {
 
 				reqPState=ps[cpuIndex]->getPState();
 
-				deltaUsage = ((this->perfCounter->getCounter(cpuIndex))
-					- this->prevPerfCounters[cpuIndex])/divisor;
+				deltaUsage = this->coreLoad[cpuIndex];
 
 				targetUnit=(reqPState*enabledPowerStates)+cpuIndex;
 
@@ -308,10 +868,6 @@ void Scaler::loopPolicyStep() {
 
 				ps[cpuIndex]->setPState(reqPState);
 
-				this->processor->forcePState(ps[cpuIndex]->getPState());
-
-				this->prevPerfCounters[cpuIndex] = this->perfCounter->getCounter(cpuIndex);
-
 				cpuIndex++;
 
 			}
@@ -320,6 +876,8 @@ void Scaler::loopPolicyStep() {
 
 		//printf("\n");
 
+		applyPStates(ps);
+
 		Sleep(this->samplingRate);
 
 	}
@@ -330,11 +888,847 @@ void Scaler::loopPolicyStep() {
 	free (ps);
 }
 
+/*
+ * Updates the forecast of a core with the last load and returns the pstate the core should
+ * run in the next sampling period (see PREDICTIVE policy). Loads and frequencies are in MHz.
+ */
+unsigned char Scaler::predictPState(struct ScalerForecast *forecast, uint64_t load, unsigned char curPState, DWORD cpuIndex) {
 
-void Scaler::createPerformanceTables () {
+	unsigned int enabledPowerStates;
+	DWORD units;
+	int64_t prevLevel, predicted;
+	unsigned char pstate, raisePState, reducePState;
 
-	PState ps(0);
-	PState ps_back(0);
+	units=this->processor->getProcessorCores()*this->processor->getProcessorNodes();
+
+	//Read once by the constructor: this runs per core per tick, also in the agent threads
+	enabledPowerStates=this->slowestPowerState;
+
+	//Holt double exponential smoothing, smoothing factors are in percent
+	if (!forecast->initialized) {
+		forecast->level=load;
+		forecast->trend=0;
+		forecast->residency=0;
+		forecast->initialized=true;
+	} else {
+		prevLevel=forecast->level;
+		forecast->level=(this->forecastAlpha*(int64_t)load+(100-this->forecastAlpha)*(forecast->level+forecast->trend))/100;
+		forecast->trend=(this->forecastBeta*(forecast->level-prevLevel)+(100-this->forecastBeta)*forecast->trend)/100;
+	}
+
+	predicted=forecast->level+forecast->trend;
+
+	if (predicted<0)
+		predicted=0;
+
+	forecast->residency++;
+
+	//Slowest pstate that serves the forecast below the upper threshold, and below the
+	//upper threshold minus hysteresis
+	raisePState=0;
+	reducePState=0;
+
+	for (pstate=enabledPowerStates;pstate>0;pstate--) {
+		if (predicted*100<=(int64_t)(frequencyTable[pstate*units+cpuIndex]*this->upperThreshold)) {
+			raisePState=pstate;
+			break;
+		}
+	}
+
+	for (pstate=enabledPowerStates;pstate>0;pstate--) {
+		if (predicted*100<=(int64_t)(frequencyTable[pstate*units+cpuIndex]*(this->upperThreshold-this->hysteresis))) {
+			reducePState=pstate;
+			break;
+		}
+	}
+
+	//Forecast exceeds the current pstate: raises at once
+	if (predicted>(int64_t)frequencyTable[curPState*units+cpuIndex] && raisePState<curPState) {
+		forecast->residency=0;
+		return raisePState;
+	}
+
+	if (forecast->residency<(unsigned int)this->minResidency)
+		return curPState;
+
+	if (raisePState<curPState) {
+		forecast->residency=0;
+		return raisePState;
+	}
+
+	if (reducePState>curPState) {
+		forecast->residency=0;
+		return reducePState;
+	}
+
+	return curPState;
+
+}
+
+void Scaler::loopPolicyPredictive() {
+
+	unsigned char reqPState, curPState;
+	DWORD units, cpuIndex, nodeIndex, coreIndex;
+
+	PState **ps;
+	struct ScalerForecast *forecasts;
+
+	units=this->processor->getProcessorCores()*this->processor->getProcessorNodes();
+
+	ps=(PState **)calloc (units, sizeof (PState *));
+	forecasts=(struct ScalerForecast *)calloc (units, sizeof (struct ScalerForecast));
+
+	for (cpuIndex=0;cpuIndex<units;cpuIndex++)
+		ps[cpuIndex]=new PState(this->slowestPowerState);
+
+	Signal::activateSignalHandler( SIGINT);
+
+	while (!Signal::getSignalStatus()) {
+
+		if (!this->takeSnapshot())
+			throw "unable to retrieve performance counter data";
+
+		cpuIndex=0;
+
+		for (nodeIndex=0;nodeIndex<this->processor->getProcessorNodes();nodeIndex++) {
+
+			this->processor->setNode(nodeIndex);
+
+			for (coreIndex=0;coreIndex<this->processor->getProcessorCores();coreIndex++) {
+
+				this->processor->setCore(coreIndex);
+
+				curPState=ps[cpuIndex]->getPState();
+
+				reqPState=predictPState(&forecasts[cpuIndex], this->coreLoad[cpuIndex], curPState, cpuIndex);
+
+				ps[cpuIndex]->setPState(reqPState);
+
+				cpuIndex++;
+
+			}
+
+		}
+
+		applyPStates(ps);
+
+		Sleep(this->samplingRate);
+
+	}
+
+	for (cpuIndex=0;cpuIndex<units;cpuIndex++)
+		delete ps[cpuIndex];
+
+	free (ps);
+	free (forecasts);
+}
+
+/*
+ * Measures, for each core, the time needed to switch between the fastest and the slowest
+ * enabled pstate: forces the pstate and polls COFVID_STATUS until the current pstate field
+ * reflects it. The cost includes the voltage slam and ramp times programmed in the
+ * northbridge (see getSlamTime() and getStepUpRampTime()).
+ *
+ * Returns false if a transition did not complete within TRANSITION_TIMEOUT or COFVID_STATUS
+ * could not be read; the core is skipped and given TRANSITION_TIMEOUT as cost.
+ */
+bool Scaler::measureTransitionCosts() {
+
+	MSRObject *msrObject;
+	DWORD nodeIndex, coreIndex, cpuIndex;
+	unsigned int sample, transitions;
+	unsigned char target;
+	uint64_t start, elapsed, total;
+	bool completed, readable, result;
+
+	transitionCost=(uint64_t *)calloc (this->processor->getProcessorCores()*this->processor->getProcessorNodes(), sizeof(uint64_t));
+
+	msrObject=new MSRObject();
+
+	printf ("Voltage slam time: %d, step up ramp time: %d, step down ramp time: %d\n",
+			this->processor->getSlamTime(), this->processor->getStepUpRampTime(), this->processor->getStepDownRampTime());
+
+	result=true;
+	cpuIndex=0;
+
+	for (nodeIndex=0;nodeIndex<this->processor->getProcessorNodes();nodeIndex++) {
+
+		this->processor->setNode(nodeIndex);
+
+		for (coreIndex=0;coreIndex<this->processor->getProcessorCores();coreIndex++) {
+
+			this->processor->setCore(coreIndex);
+
+			total=0;
+			transitions=0;
+			completed=true;
+			readable=true;
+
+			//Round trips between the fastest and the slowest pstate, the core is left in the slowest one
+			for (sample=0;sample<TRANSITION_SAMPLES*2 && completed;sample++) {
+
+				target=(sample & 1) ? this->slowestPowerState : 0;
+
+				start=TSCClock::getMicroseconds();
+				elapsed=0;
+
+				this->processor->forcePState(target);
+
+				completed=false;
+
+				do {
+
+					if (!msrObject->readMSR(COFVID_STATUS_REG, this->processor->getMask(coreIndex, nodeIndex))) {
+						readable=false;
+						break;
+					}
+
+					elapsed=TSCClock::getMicroseconds()-start;
+
+					if (msrObject->getBitsLow(0, 16, 3)==target) {
+						completed=true;
+						break;
+					}
+
+				} while (elapsed<TRANSITION_TIMEOUT);
+
+				if (!readable)
+					break;
+
+				total+=elapsed;
+				transitions++;
+
+			}
+
+			if (!readable) {
+				printf ("Node %u core %u - unable to read COFVID status, core skipped\n", nodeIndex, coreIndex);
+				this->processor->forcePState(this->slowestPowerState);
+				transitionCost[cpuIndex]=TRANSITION_TIMEOUT;
+				result=false;
+				cpuIndex++;
+				continue;
+			}
+
+			if (completed) {
+				transitionCost[cpuIndex]=total/transitions;
+			} else {
+				transitionCost[cpuIndex]=TRANSITION_TIMEOUT;
+				result=false;
+			}
+
+			printf ("Node %u core %u - pstate transition cost: %llu us\n", nodeIndex, coreIndex,
+					(unsigned long long)transitionCost[cpuIndex]);
+
+			cpuIndex++;
+
+		}
+
+	}
+
+	delete msrObject;
+
+	return result;
+
+}
+
+/*
+ * Returns the pstate core cpuIndex should run in the next sampling period (see COSTAWARE policy).
+ * Load and frequencies are in MHz.
+ */
+unsigned char Scaler::costAwarePState(uint64_t load, unsigned char curPState, DWORD cpuIndex) {
+
+	unsigned int enabledPowerStates;
+	DWORD units;
+	unsigned char pstate, target;
+	float window, busy, gain, curFrequency, newFrequency;
+
+	units=this->processor->getProcessorCores()*this->processor->getProcessorNodes();
+
+	//Read once by the constructor, see predictPState()
+	enabledPowerStates=this->slowestPowerState;
+
+	//Slowest pstate that serves the load below the upper threshold
+	target=0;
+
+	for (pstate=enabledPowerStates;pstate>0;pstate--) {
+		if (load*100<=frequencyTable[pstate*units+cpuIndex]*this->upperThreshold) {
+			target=pstate;
+			break;
+		}
+	}
+
+	if (target==curPState)
+		return curPState;
+
+	window=(float)this->samplingRate*1000;
+	curFrequency=(float)frequencyTable[curPState*units+cpuIndex];
+	newFrequency=(float)frequencyTable[target*units+cpuIndex];
+
+	if (curFrequency==0 || newFrequency==0 || powerTable[curPState*units+cpuIndex]==0)
+		return target;
+
+	//Fraction of the sampling period the core was busy
+	busy=(float)load/curFrequency;
+
+	if (busy>1)
+		busy=1;
+
+	if (target<curPState) {
+		//Busy time saved running the same work faster
+		gain=window*busy*(1-curFrequency/newFrequency);
+	} else {
+		//Dynamic energy saved running the same work slower, in microseconds at the current power
+		gain=window*busy*(1-(powerTable[target*units+cpuIndex]*curFrequency)/
+				(powerTable[curPState*units+cpuIndex]*newFrequency));
+	}
+
+	if (gain>(float)transitionCost[cpuIndex])
+		return target;
+
+	return curPState;
+
+}
+
+void Scaler::loopPolicyCostAware() {
+
+	unsigned char reqPState, curPState;
+	DWORD units, cpuIndex, nodeIndex, coreIndex;
+
+	PState **ps;
+
+	units=this->processor->getProcessorCores()*this->processor->getProcessorNodes();
+
+	ps=(PState **)calloc (units, sizeof (PState *));
+
+	//measureTransitionCosts() leaves all the cores in the slowest pstate
+	for (cpuIndex=0;cpuIndex<units;cpuIndex++)
+		ps[cpuIndex]=new PState(this->slowestPowerState);
+
+	Signal::activateSignalHandler( SIGINT);
+
+	while (!Signal::getSignalStatus()) {
+
+		if (!this->takeSnapshot())
+			throw "unable to retrieve performance counter data";
+
+		cpuIndex=0;
+
+		for (nodeIndex=0;nodeIndex<this->processor->getProcessorNodes();nodeIndex++) {
+
+			this->processor->setNode(nodeIndex);
+
+			for (coreIndex=0;coreIndex<this->processor->getProcessorCores();coreIndex++) {
+
+				this->processor->setCore(coreIndex);
+
+				curPState=ps[cpuIndex]->getPState();
+
+				reqPState=costAwarePState(this->coreLoad[cpuIndex], curPState, cpuIndex);
+
+				ps[cpuIndex]->setPState(reqPState);
+
+				cpuIndex++;
+
+			}
+
+		}
+
+		applyPStates(ps);
+
+		Sleep(this->samplingRate);
+
+	}
+
+	for (cpuIndex=0;cpuIndex<units;cpuIndex++)
+		delete ps[cpuIndex];
+
+	free (ps);
+}
+
+/*
+ * Activity of a node: the sum of the busy fraction of its cores, weighted by the power of their
+ * pstate relative to pstate 0. With cap greater than 0 the activity the node would have with
+ * its cores capped to that pstate, assuming they have the same work to do.
+ */
+float Scaler::nodeActivity(DWORD nodeIndex, PState **ps, unsigned char cap) {
+
+	DWORD units, cores, cpuIndex, coreIndex;
+	unsigned char pstate, curPState;
+	float busy, activity;
+
+	cores=this->processor->getProcessorCores();
+	units=cores*this->processor->getProcessorNodes();
+
+	activity=0;
+
+	for (coreIndex=0;coreIndex<cores;coreIndex++) {
+
+		cpuIndex=nodeIndex*cores+coreIndex;
+
+		curPState=ps[cpuIndex]->getPState();
+		pstate=(curPState<cap) ? cap : curPState;
+
+		if (frequencyTable[pstate*units+cpuIndex]==0 || powerTable[cpuIndex]==0)
+			continue;
+
+		busy=(float)this->coreLoad[cpuIndex]/frequencyTable[pstate*units+cpuIndex];
+
+		if (busy>1)
+			busy=1;
+
+		activity+=busy*powerTable[pstate*units+cpuIndex]/powerTable[cpuIndex];
+
+	}
+
+	return activity;
+
+}
+
+/*
+ * Recursive least squares update of the model with the temperature reached after a sampling
+ * period at activity, starting from model->lastTemp
+ */
+void Scaler::updateThermalModel(struct ScalerThermalModel *model, float temp, float activity) {
+
+	float phi[3], pPhi[3], gain[3];
+	float denominator, residual;
+	int i, j;
+
+	phi[0]=model->lastTemp;
+	phi[1]=activity;
+	phi[2]=1;
+
+	denominator=THERMAL_FORGETTING;
+
+	for (i=0;i<3;i++) {
+		pPhi[i]=0;
+		for (j=0;j<3;j++)
+			pPhi[i]+=model->covariance[i][j]*phi[j];
+		denominator+=phi[i]*pPhi[i];
+	}
+
+	residual=temp;
+
+	for (i=0;i<3;i++) {
+		gain[i]=pPhi[i]/denominator;
+		residual-=model->theta[i]*phi[i];
+	}
+
+	for (i=0;i<3;i++) {
+		model->theta[i]+=gain[i]*residual;
+		for (j=0;j<3;j++)
+			model->covariance[i][j]=(model->covariance[i][j]-gain[i]*pPhi[j])/THERMAL_FORGETTING;
+	}
+
+	//Without excitation (constant activity) the covariance grows unbounded, so it is reset
+	if (model->covariance[0][0]+model->covariance[1][1]+model->covariance[2][2]>1e6f) {
+		for (i=0;i<3;i++)
+			for (j=0;j<3;j++)
+				model->covariance[i][j]=(i==j) ? 1000 : 0;
+	}
+
+	model->samples++;
+
+}
+
+/*
+ * Tctl predicted after steps sampling periods at constant activity, or a negative value if the
+ * model is not stable yet
+ */
+float Scaler::predictTemperature(struct ScalerThermalModel *model, float temp, float activity, unsigned int steps) {
+
+	unsigned int step;
+
+	if (model->samples<THERMAL_MIN_SAMPLES || model->theta[0]<=0 || model->theta[0]>=1)
+		return -1;
+
+	for (step=0;step<steps;step++)
+		temp=model->theta[0]*temp+model->theta[1]*activity+model->theta[2];
+
+	return temp;
+
+}
+
+void Scaler::loopPolicyThermal() {
+
+	unsigned char reqPState, cap;
+	unsigned int enabledPowerStates, steps, tick, reportTicks, slot, i;
+	DWORD units, cpuIndex, targetUnit, nodeIndex, coreIndex;
+	float temp, predicted, diff, limit, a;
+
+	PState **ps;
+	struct ScalerThermalModel *models;
+
+	units=this->processor->getProcessorCores()*this->processor->getProcessorNodes();
+	enabledPowerStates=this->processor->getMaximumPState().getPState();
+
+	steps=(this->thermalHorizon*1000+this->samplingRate-1)/this->samplingRate;
+
+	if (steps<1)
+		steps=1;
+	if (steps>THERMAL_MAX_STEPS)
+		steps=THERMAL_MAX_STEPS;
+
+	reportTicks=(THERMAL_REPORT_PERIOD*1000)/this->samplingRate;
+
+	if (reportTicks<1)
+		reportTicks=1;
+
+	ps=(PState **)calloc (units, sizeof (PState *));
+	models=(struct ScalerThermalModel *)calloc (this->processor->getProcessorNodes(), sizeof (struct ScalerThermalModel));
+
+	for (cpuIndex=0;cpuIndex<units;cpuIndex++)
+		ps[cpuIndex]=new PState(this->slowestPowerState);
+
+	for (nodeIndex=0;nodeIndex<this->processor->getProcessorNodes();nodeIndex++) {
+
+		this->processor->setNode(nodeIndex);
+
+		models[nodeIndex].tempLimit=this->processor->HTCTempLimit();
+		models[nodeIndex].lastTemp=this->processor->getTctlRegister();
+
+		//A model that holds the temperature: a=1, b=0, c=0
+		models[nodeIndex].theta[0]=1;
+
+		for (i=0;i<3;i++)
+			models[nodeIndex].covariance[i][i]=1000;
+
+		for (slot=0;slot<=THERMAL_MAX_STEPS;slot++)
+			models[nodeIndex].predictions[slot]=-1;
+
+		if (models[nodeIndex].tempLimit==(DWORD)-1 || models[nodeIndex].tempLimit==0)
+			printf ("Node %u: HTC temperature limit not available, node will not be capped\n", nodeIndex);
+		else
+			printf ("Node %u: HTC temperature limit %u, capping %d degrees before, %d seconds ahead\n",
+					nodeIndex, models[nodeIndex].tempLimit, this->thermalMargin, this->thermalHorizon);
+
+	}
+
+	Signal::activateSignalHandler( SIGINT);
+
+	tick=0;
+
+	while (!Signal::getSignalStatus()) {
+
+		if (!this->takeSnapshot())
+			throw "unable to retrieve performance counter data";
+
+		tick++;
+		slot=tick%(THERMAL_MAX_STEPS+1);
+
+		for (nodeIndex=0;nodeIndex<this->processor->getProcessorNodes();nodeIndex++) {
+
+			this->processor->setNode(nodeIndex);
+
+			temp=this->processor->getTctlRegister();
+
+			//Fits the last period, run with the pstates in ps
+			updateThermalModel(&models[nodeIndex], temp, nodeActivity(nodeIndex, ps, 0));
+			models[nodeIndex].lastTemp=temp;
+
+			//Checks the prediction made a horizon ago
+			if (models[nodeIndex].predictions[slot]>=0) {
+
+				diff=models[nodeIndex].predictions[slot]-temp;
+
+				if (diff<0)
+					diff=-diff;
+
+				models[nodeIndex].error=(models[nodeIndex].error*models[nodeIndex].errorSamples+diff)/
+						(models[nodeIndex].errorSamples+1);
+				models[nodeIndex].errorSamples++;
+
+				models[nodeIndex].predictions[slot]=-1;
+			}
+
+			//Step policy requests
+			for (coreIndex=0;coreIndex<this->processor->getProcessorCores();coreIndex++) {
+
+				cpuIndex=nodeIndex*this->processor->getProcessorCores()+coreIndex;
+
+				reqPState=ps[cpuIndex]->getPState();
+
+				targetUnit=(reqPState*enabledPowerStates)+cpuIndex;
+
+				if (this->coreLoad[cpuIndex]>raiseTable[targetUnit]) { if (reqPState!=0) reqPState--; }
+				else if (this->coreLoad[cpuIndex]<reduceTable[targetUnit]) { reqPState++; }
+
+				ps[cpuIndex]->setPState(reqPState);
+
+			}
+
+			//Fastest cap that keeps the prediction below the limit minus the margin
+			models[nodeIndex].cap=0;
+			models[nodeIndex].predicted=predictTemperature(&models[nodeIndex], temp, nodeActivity(nodeIndex, ps, 0), steps);
+
+			if (models[nodeIndex].tempLimit!=(DWORD)-1 && models[nodeIndex].tempLimit!=0) {
+
+				limit=(float)models[nodeIndex].tempLimit-this->thermalMargin;
+
+				for (cap=0;cap<=enabledPowerStates;cap++) {
+
+					predicted=predictTemperature(&models[nodeIndex], temp, nodeActivity(nodeIndex, ps, cap), steps);
+
+					models[nodeIndex].cap=cap;
+					models[nodeIndex].predicted=predicted;
+
+					if (predicted<limit)
+						break;
+
+				}
+
+				for (coreIndex=0;coreIndex<this->processor->getProcessorCores();coreIndex++) {
+
+					cpuIndex=nodeIndex*this->processor->getProcessorCores()+coreIndex;
+
+					if (ps[cpuIndex]->getPState()<models[nodeIndex].cap)
+						ps[cpuIndex]->setPState(models[nodeIndex].cap);
+
+				}
+			}
+
+			if (models[nodeIndex].predicted>=0)
+				models[nodeIndex].predictions[(tick+steps)%(THERMAL_MAX_STEPS+1)]=models[nodeIndex].predicted;
+
+		}
+
+		applyPStates(ps);
+
+		if (tick%reportTicks==0) {
+
+			for (nodeIndex=0;nodeIndex<this->processor->getProcessorNodes();nodeIndex++) {
+
+				a=models[nodeIndex].theta[0];
+
+				printf ("Node %u - Tctl: %.0f predicted: %.1f cap: P%u", nodeIndex, models[nodeIndex].lastTemp,
+						models[nodeIndex].predicted, models[nodeIndex].cap);
+
+				//Time constant, steady state rise at unit activity and ambient of the RC model
+				if (a>0 && a<1)
+					printf (" - tau: %.1fs gain: %.1f ambient: %.1f", (float)this->samplingRate/(1000*(1-a)),
+							models[nodeIndex].theta[1]/(1-a), models[nodeIndex].theta[2]/(1-a));
+				else
+					printf (" - model not fitted yet");
+
+				printf (" - error: %.2f over %u predictions\n", models[nodeIndex].error, models[nodeIndex].errorSamples);
+
+			}
+
+		}
+
+		if (fflush(stdout) == EOF) {
+			break;
+		}
+
+		Sleep(this->samplingRate);
+
+	}
+
+	for (cpuIndex=0;cpuIndex<units;cpuIndex++)
+		delete ps[cpuIndex];
+
+	free (ps);
+	free (models);
+}
+
+bool Scaler::loopPolicyPowerCap() {
+
+	unsigned char reqPState, *caps;
+	unsigned int enabledPowerStates, tick, reportTicks, *residency;
+	DWORD units, cores, nodes, cpuIndex, targetUnit, nodeIndex, coreIndex;
+	float *tdp, *power, *savedLimits, upper, lower, estimate;
+	bool *hardware, estimated, result;
+
+	PState **ps;
+
+	cores=this->processor->getProcessorCores();
+	nodes=this->processor->getProcessorNodes();
+	units=cores*nodes;
+	enabledPowerStates=this->processor->getMaximumPState().getPState();
+
+	if (this->powerBudget==0) {
+		printf ("Power capping requires a power budget\n");
+		return false;
+	}
+
+	upper=(float)this->powerBudget*(100+this->powerTolerance)/100;
+	lower=(float)this->powerBudget*(100-this->powerTolerance)/100;
+
+	reportTicks=(POWER_REPORT_PERIOD*1000)/this->samplingRate;
+
+	if (reportTicks<1)
+		reportTicks=1;
+
+	ps=(PState **)calloc (units, sizeof (PState *));
+	caps=(unsigned char *)calloc (nodes, sizeof (unsigned char));
+	residency=(unsigned int *)calloc (nodes, sizeof (unsigned int));
+	tdp=(float *)calloc (nodes, sizeof (float));
+	power=(float *)calloc (nodes, sizeof (float));
+	savedLimits=(float *)calloc (nodes, sizeof (float));
+	hardware=(bool *)calloc (nodes, sizeof (bool));
+
+	for (cpuIndex=0;cpuIndex<units;cpuIndex++)
+		ps[cpuIndex]=new PState(this->slowestPowerState);
+
+	estimated=true;
+	result=true;
+
+	for (nodeIndex=0;nodeIndex<nodes;nodeIndex++) {
+
+		this->processor->setNode(nodeIndex);
+
+		tdp[nodeIndex]=(this->nodeTDP>0) ? this->nodeTDP : this->processor->getNodeTDPWatts();
+
+		//Programs the budget as APM TDP limit, saving the previous one
+		savedLimits[nodeIndex]=this->processor->getPowerLimit();
+
+		if (savedLimits[nodeIndex]>=0)
+			hardware[nodeIndex]=this->processor->setPowerLimit(this->powerBudget);
+
+		if (hardware[nodeIndex]) {
+			printf ("Node %u: %dW budget programmed as APM TDP limit\n", nodeIndex, this->powerBudget);
+		} else if (tdp[nodeIndex]>0) {
+			printf ("Node %u: %dW budget enforced by software, node TDP %.1fW\n", nodeIndex, this->powerBudget, tdp[nodeIndex]);
+		} else {
+			printf ("Node %u: node TDP unknown, set nodetdp in the SCALER section\n", nodeIndex);
+			estimated=false;
+		}
+
+	}
+
+	Signal::activateSignalHandler( SIGINT);
+
+	tick=0;
+
+	try {
+
+		if (!estimated)
+			throw "node power can't be estimated";
+
+		while (!Signal::getSignalStatus()) {
+
+			if (!this->takeSnapshot())
+				throw "unable to retrieve performance counter data";
+
+			tick++;
+
+			for (nodeIndex=0;nodeIndex<nodes;nodeIndex++) {
+
+				//Estimated power of the last period, smoothed to filter load spikes. Only nodes
+				//capped in hardware may have an unknown TDP, they are reported without estimate
+				if (tdp[nodeIndex]>0) {
+					estimate=tdp[nodeIndex]*(POWER_STATIC_PERCENT+(100-POWER_STATIC_PERCENT)*nodeActivity(nodeIndex, ps, 0)/cores)/100;
+					power[nodeIndex]=(tick==1) ? estimate : (power[nodeIndex]+estimate)/2;
+				}
+
+				//Step policy requests
+				for (coreIndex=0;coreIndex<cores;coreIndex++) {
+
+					cpuIndex=nodeIndex*cores+coreIndex;
+
+					reqPState=ps[cpuIndex]->getPState();
+
+					targetUnit=(reqPState*enabledPowerStates)+cpuIndex;
+
+					if (this->coreLoad[cpuIndex]>raiseTable[targetUnit]) { if (reqPState!=0) reqPState--; }
+					else if (this->coreLoad[cpuIndex]<reduceTable[targetUnit]) { reqPState++; }
+
+					ps[cpuIndex]->setPState(reqPState);
+
+				}
+
+				if (hardware[nodeIndex])
+					continue;
+
+				residency[nodeIndex]++;
+
+				//Tightens at once above the band, relaxes only if the faster cap is predicted below it
+				if (power[nodeIndex]>upper && caps[nodeIndex]<enabledPowerStates) {
+					caps[nodeIndex]++;
+					residency[nodeIndex]=0;
+				} else if (power[nodeIndex]<upper && caps[nodeIndex]>0 &&
+						residency[nodeIndex]>=(unsigned int)this->minResidency) {
+
+					estimate=tdp[nodeIndex]*(POWER_STATIC_PERCENT+(100-POWER_STATIC_PERCENT)*
+							nodeActivity(nodeIndex, ps, caps[nodeIndex]-1)/cores)/100;
+
+					if (estimate<lower) {
+						caps[nodeIndex]--;
+						residency[nodeIndex]=0;
+					}
+				}
+
+				for (coreIndex=0;coreIndex<cores;coreIndex++) {
+
+					cpuIndex=nodeIndex*cores+coreIndex;
+
+					if (ps[cpuIndex]->getPState()<caps[nodeIndex])
+						ps[cpuIndex]->setPState(caps[nodeIndex]);
+
+				}
+
+			}
+
+			applyPStates(ps);
+
+			if (tick%reportTicks==0) {
+
+				for (nodeIndex=0;nodeIndex<nodes;nodeIndex++) {
+
+					if (tdp[nodeIndex]>0)
+						printf ("Node %u - estimated power: %.1fW budget: %dW %s: P%u\n", nodeIndex, power[nodeIndex],
+								this->powerBudget, hardware[nodeIndex] ? "APM limit, no cap" : "cap", caps[nodeIndex]);
+					else
+						printf ("Node %u - estimated power: n/a budget: %dW %s: P%u\n", nodeIndex,
+								this->powerBudget, hardware[nodeIndex] ? "APM limit, no cap" : "cap", caps[nodeIndex]);
+
+				}
+
+			}
+
+			if (fflush(stdout) == EOF) {
+				break;
+			}
+
+			Sleep(this->samplingRate);
+
+		}
+
+	} catch (char const *str) {
+
+		printf ("Scaler.cpp::loopPolicyPowerCap - %s\n", str);
+		result=false;
+
+	}
+
+	//Restores the previous APM TDP limits
+	for (nodeIndex=0;nodeIndex<nodes;nodeIndex++) {
+
+		this->processor->setNode(nodeIndex);
+
+		if (hardware[nodeIndex])
+			this->processor->setPowerLimit(savedLimits[nodeIndex]);
+
+	}
+
+	for (cpuIndex=0;cpuIndex<units;cpuIndex++)
+		delete ps[cpuIndex];
+
+	free (ps);
+	free (caps);
+	free (residency);
+	free (tdp);
+	free (power);
+	free (savedLimits);
+	free (hardware);
+
+	return result;
+}
+
+void Scaler::createPerformanceTables () {
+
+	PState ps(0);
+	PState ps_back(0);
 	unsigned int i,unitIndex;
 	unsigned int nodeIndex, coreIndex;
 	unsigned int units; //units are total number of processors in the system
@@ -347,6 +1741,8 @@ void Scaler::createPerformanceTables () {
 
 	raiseTable=(uint64_t *)calloc (units*(enabledPowerStates+1), sizeof(uint64_t));
 	reduceTable=(uint64_t *)calloc (units*(enabledPowerStates+1), sizeof(uint64_t));
+	frequencyTable=(uint64_t *)calloc (units*(enabledPowerStates+1), sizeof(uint64_t));
+	powerTable=(float *)calloc (units*(enabledPowerStates+1), sizeof(float));
 
 	for (i=0;i<=enabledPowerStates;i++) {
 
@@ -365,6 +1761,10 @@ void Scaler::createPerformanceTables () {
 
 				targetUnit=(i*enabledPowerStates) + unitIndex;
 
+				frequencyTable[(i*units) + unitIndex]=this->processor->getFrequency(ps);
+				powerTable[(i*units) + unitIndex]=this->processor->getVCore(ps)*this->processor->getVCore(ps)*
+						this->processor->getFrequency(ps);
+
 				if (i==this->processor->getMaximumPState().getPState()) {
 					reduceTable[targetUnit]=0;
 					raiseTable[targetUnit]=this->processor->getFrequency(ps)*this->upperThreshold/100;
@@ -396,6 +1796,8 @@ void Scaler::createPerformanceTables () {
 
 void Scaler::beginScaling() {
 
+	bool interrupted;
+
 	if (initializeCounters()) {
 		perror(
 				"Scaler::beginScaling - performance counters initialization failed\n");
@@ -404,32 +1806,67 @@ void Scaler::beginScaling() {
 
 	createPerformanceTables();
 
-	this->perfCounter->enable();
+	if (this->coresPerUnit > 1)
+		printf ("Scaling compute units of %u cores\n", this->coresPerUnit);
 
-	switch (this->policy) {
-	case POLICY_STEP:
-		loopPolicyStep(); //loop will be terminated with a CTRL-C command
-		break;
-	case POLICY_ROCKET:
-		loopPolicyRocket();
-		break;
+	this->transitionCost=NULL;
+	interrupted=true;
+
+	if (this->policy == POLICY_COSTAWARE) {
+		if (!measureTransitionCosts())
+			printf ("Warning: some pstate transitions did not complete, their cores will switch rarely\n");
 	}
 
-	printf ("CTRL-C pressed. Terminating scaler and freeing resources... ");
+	if (this->mode == SCALER_AGENTS && this->policy == POLICY_THERMAL) {
+		printf ("Thermal policy models whole nodes, using central scaler\n");
+		loopPolicyThermal();
+	} else if (this->mode == SCALER_AGENTS && this->policy == POLICY_POWERCAP) {
+		printf ("Power capping budgets whole nodes, using central scaler\n");
+		interrupted=loopPolicyPowerCap();
+	} else if (this->mode == SCALER_AGENTS) {
+		loopAgents(); //agents apply the policy themselves
+	} else {
+		switch (this->policy) {
+		case POLICY_STEP:
+			loopPolicyStep(); //loop will be terminated with a CTRL-C command
+			break;
+		case POLICY_ROCKET:
+			loopPolicyRocket();
+			break;
+		case POLICY_PREDICTIVE:
+			loopPolicyPredictive();
+			break;
+		case POLICY_COSTAWARE:
+			loopPolicyCostAware();
+			break;
+		case POLICY_THERMAL:
+			loopPolicyThermal();
+			break;
+		case POLICY_POWERCAP:
+			interrupted=loopPolicyPowerCap();
+			break;
+		}
+	}
 
-	this->perfCounter->disable();
+	if (interrupted)
+		printf ("CTRL-C pressed. ");
 
-	if (this->perfCounter->getEnabled())
-		this->perfCounter->disable();
+	printf ("Terminating scaler and freeing resources... ");
 
-	free(this->perfCounter);
-	free(this->tscCounter);
-	free(this->prevPerfCounters);
-	free(this->prevTSCCounters);
+	freeCounters();
 
 	free(this->raiseTable);
 	free(this->reduceTable);
+	free(this->frequencyTable);
+	free(this->powerTable);
+	free(this->transitionCost);
 
 	printf ("done.\n");
 
+	if (this->coreRequests > 0)
+		printf ("Compute units: %llu of %llu core requests coalesced (%.1f%%)\n",
+				(unsigned long long)this->coalescedRequests,
+				(unsigned long long)this->coreRequests,
+				(float)this->coalescedRequests*100/this->coreRequests);
+
 }
@@ -4,17 +4,61 @@
 #include "MSRObject.h"
 #include "PerformanceCounter.h"
 #include "Signal.h"
+#include "TSCClock.h"
+#include "PerformanceSampler.h"
+
+#ifdef __linux
+#include <pthread.h>
+#endif
 
 #define POLICY_ROCKET 0
 #define POLICY_STEP 1
+#define POLICY_PREDICTIVE 2
+#define POLICY_COSTAWARE 3
+#define POLICY_THERMAL 4
+#define POLICY_POWERCAP 5
+
+#define LOAD_IDLE_COUNTER 0 //Core load from non-halted cycles (event 0x76)
+#define LOAD_FREQUENCY_INVARIANT 1 //Core load from APERF/MPERF registers
 
 #define DEFAULT_SAMPLING_RATE 1000 //Default sampling rate in milliseconds
 
+//Predictive policy defaults: smoothing factors in percent, hysteresis in percent of the
+//pstate frequency, minimum residency in sampling periods
+#define DEFAULT_FORECAST_ALPHA 50
+#define DEFAULT_FORECAST_BETA 20
+#define DEFAULT_HYSTERESIS 10
+#define DEFAULT_MIN_RESIDENCY 2
+
+//Transition cost measurement: round trips per core and time to wait for COFVID_STATUS, in microseconds
+#define TRANSITION_SAMPLES 4
+#define TRANSITION_TIMEOUT 10000
+
+//Thermal policy defaults: prediction horizon in seconds, margin below HTCTempLimit in degrees
+#define DEFAULT_THERMAL_HORIZON 5
+#define DEFAULT_THERMAL_MARGIN 2
+#define THERMAL_MAX_STEPS 64 //Longest prediction, in sampling periods
+#define THERMAL_MIN_SAMPLES 10 //Model updates before the model is used
+#define THERMAL_FORGETTING 0.99f //Recursive least squares forgetting factor
+#define THERMAL_REPORT_PERIOD 10 //Seconds between two model reports
+
+//Power capping defaults: tolerance around the budget in percent
+#define DEFAULT_POWER_TOLERANCE 5
+#define POWER_STATIC_PERCENT 30 //Share of the node TDP drawn regardless of activity, for the estimate
+#define POWER_REPORT_PERIOD 10 //Seconds between two power reports
+
+#define SCALER_CENTRAL 0 //A single thread samples and sets all the cores
+#define SCALER_AGENTS 1 //An agent thread per cpu, pinned on it, samples and sets its own core
+
 class Scaler {
 private:
 	int samplingRate;
 	
 	int policy;
+
+	int loadSource;
+
+	int mode;
 	
 	int upperThreshold;
 	int lowerThreshold;
@@ -22,30 +66,126 @@ private:
 	int midUpperThreshold;
 	int midLowerThreshold;
 
+	int forecastAlpha;
+	int forecastBeta;
+	int hysteresis;
+	int minResidency;
+
+	int thermalHorizon;
+	int thermalMargin;
+
+	int powerBudget; //Watts per node, 0 means no budget
+	int powerTolerance;
+	int nodeTDP; //Watts, 0 means read from the processor
+
 	Processor *processor;
+	PROCESSORMASK cpuMask;
 	
 	unsigned char slowestPowerState;
 
 	PerformanceCounter *perfCounter;
-	MSRObject *tscCounter;
+	PerformanceSampler *sampler;
 	uint64_t *prevPerfCounters;
-	uint64_t *prevTSCCounters;
+	uint64_t *coreLoad;
 	
 	uint64_t *raiseTable;
 	uint64_t *reduceTable;
+	uint64_t *frequencyTable; //Frequency of each pstate of each core, pstate*units+cpuIndex
+	float *powerTable; //Relative dynamic power (Vcore^2*f) of each pstate of each core, as frequencyTable
+	uint64_t *transitionCost; //Measured pstate transition time of each core, in microseconds
+
+	DWORD coresPerUnit; //Cores sharing a compute unit, they are scaled together
+	uint64_t coreRequests; //Per-core pstate requests in multi-core compute units
+	uint64_t coalescedRequests; //Requests overridden by the compute unit decision
+
+	//Holt forecast of the load of a core, for the predictive policy
+	struct ScalerForecast {
+		int64_t level;
+		int64_t trend;
+		unsigned int residency; //Sampling periods spent in the current pstate
+		bool initialized;
+	};
+
+	/*
+	 * First order RC thermal model of a node, fitted online with recursive least squares:
+	 * T[k+1] = a*T[k] + b*u[k] + c, where T is Tctl and u the node activity, the sum of the
+	 * busy fraction of its cores weighted by the relative power of their pstates
+	 */
+	struct ScalerThermalModel {
+		float theta[3]; //a, b, c
+		float covariance[3][3];
+		float lastTemp;
+		unsigned int samples;
+		DWORD tempLimit; //HTCTempLimit of the node
+		unsigned char cap; //Slowest pstate cores may be forced to use, 0 means no cap
+		float predicted; //Last prediction at the horizon
+		float predictions[THERMAL_MAX_STEPS+1]; //Predictions due at each future tick, negative when none
+		float error; //Mean absolute prediction error at the horizon, in degrees
+		unsigned int errorSamples;
+	};
+
+	//Agents share the policy parameters and the performance tables, read only
+	struct ScalerAgent {
+		Scaler *scaler;
+		DWORD cpuIndex;
+		DWORD cpu; //Absolute cpu number the agent is pinned on
+		MSRObject *msrObject; //Reused by the agent at every tick
+		volatile bool failed;
+		uint64_t requests;
+		uint64_t coalesced;
+	};
+
+	volatile bool agentsRunning;
+	volatile unsigned char *agentRequests; //Last pstate requested by each agent, per cpuIndex
+
+#ifdef __linux
+	static void *agentThread (void *arg);
+#endif
 
 	int initializeCounters ();
+	void freeCounters ();
+	bool takeSnapshot ();
+	bool readLocalLoad (struct ScalerAgent *agent, uint64_t *prevCounter, uint64_t *prevTSC, uint64_t *load);
+	bool writeLocalPState (struct ScalerAgent *agent, unsigned char pstate);
+	void agentLoop (struct ScalerAgent *agent);
 	void loopPolicyRocket ();
 	void loopPolicyStep ();
+	void loopPolicyPredictive ();
+	unsigned char predictPState (struct ScalerForecast *forecast, uint64_t load, unsigned char curPState, DWORD cpuIndex);
+	void loopPolicyCostAware ();
+	unsigned char costAwarePState (uint64_t load, unsigned char curPState, DWORD cpuIndex);
+	bool measureTransitionCosts ();
+	void loopPolicyThermal ();
+	float nodeActivity (DWORD nodeIndex, PState **ps, unsigned char cap);
+	void updateThermalModel (struct ScalerThermalModel *model, float temp, float activity);
+	float predictTemperature (struct ScalerThermalModel *model, float temp, float activity, unsigned int steps);
+	bool loopPolicyPowerCap (); //false if the budget could not be enforced
+	void loopAgents ();
+	void getUnitCores (DWORD cpuIndex, DWORD *first, DWORD *last);
+	void applyPStates (PState **ps);
 	void createPerformanceTables ();
 
 public:
 	void setSamplingFrequency (int);
 	
 	void setPolicy (int);
+	void setLoadSource (int);
+	void setMode (int);
 	
 	void setUpperThreshold (int);
 	void setLowerThreshold (int);
+
+	void setForecastAlpha (int);
+	void setForecastBeta (int);
+	void setHysteresis (int);
+	void setMinResidency (int);
+
+	void setThermalHorizon (int);
+	void setThermalMargin (int);
+
+	void setPowerBudget (int);
+	void setPowerTolerance (int);
+	void setNodeTDP (int);
 	
 	Scaler (class Processor *);
 	void beginScaling ();